@@ -0,0 +1,365 @@
+/*
+ *  rezActuator.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezActuator.h"
+#include "rezInstrument.h"
+
+/*
+ * NOSWEEP - sweep when no sweep is under way.
+ * NOFEEL - feeling when no calibration by hand is under way.
+ */
+
+#define NOSWEEP -1
+#define NOFEEL -1
+
+/*
+ * The store's calibration for the open unit is used if it has one, and
+ * if it has not and the unit can be swept, a sweep is started.
+ */
+
+static void RezActuatorCalibrate( RezActuator *actuator )
+{
+	const RezCalibration *calibration = RezCalibrationFind( &actuator->store, actuator->device.identity );
+
+	actuator->mapped = calibration != NULL;
+	if( actuator->mapped ) actuator->calibration = *calibration;
+	else RezCalibrationReset( &actuator->calibration );
+	actuator->sweep = !actuator->mapped && RezDeviceResponse( &actuator->device ) >= 0 ? 0 : NOSWEEP;
+	actuator->sweepAt = 0;
+}
+
+/*
+ * Try to open a device, at most once every RESCANMS.  A new device's
+ * motor is stopped, so the envelope is told nothing has been sent yet and
+ * its next speed goes out whatever it is.
+ */
+
+static void RezActuatorLook( RezActuator *actuator, RezTime now )
+{
+	REZ_PROBE( discover )
+
+	if( now < actuator->nextLook ) return;
+	REZ_PROBE_START( discover );
+	actuator->open = RezDeviceOpen( &actuator->device );
+	REZ_PROBE_STOP( discover, REZ_PROBE_DISCOVER );
+	actuator->nextLook = RezTimeNow() + REZ_MS( RESCANMS );
+	if( !actuator->open ) return;
+	actuator->failures = 0;
+	actuator->envelope.sent = 0;
+	actuator->written = 0;
+	RezActuatorCalibrate( actuator );
+	RezAtomicStore( &actuator->present, 1 );
+}
+
+static void RezActuatorLose( RezActuator *actuator )
+{
+	RezAtomicStore( &actuator->present, 0 );
+	RezDeviceClose( &actuator->device );
+	actuator->open = 0;
+}
+
+#define RezActuatorMapped( actuator, speed ) ( ( actuator )->mapped ? ( actuator )->calibration.table[ speed ] : ( speed ) )
+
+static int RezActuatorWrite( RezActuator *actuator, int speed, RezTrace *trace )
+{
+	RezTime started = RezTimeNow(), completed;
+	int written = RezDeviceSetSpeed( &actuator->device, RezActuatorMapped( actuator, speed ) );
+
+	actuator->written = written ? RezActuatorMapped( actuator, speed ) : -1;
+	if( written ) actuator->failures = 0;
+	else
+	{
+		actuator->latency->failed++;
+		if( ++actuator->failures >= LOSTWRITES ) RezActuatorLose( actuator );
+	}
+	completed = RezTimeNow();
+	if( trace == NULL )
+	{
+		RezLatencyRecord( actuator->latency, REZ_LATENCY_WRITE, completed > started ? completed - started : 0 );
+		return written;
+	}
+	trace->started = started;
+	trace->completed = completed;
+	RezLatencyTrace( actuator->latency, trace );
+	return written;
+}
+
+/*
+ * Take one step of a sweep: read how the rotor settled at the last
+ * speed, then send the next, or once every step has been read make the
+ * table and keep it.  Returns how long to wait for the next step.  The
+ * speeds are sent as they are, not through the table being replaced.
+ * The identity outlives a failed write closing the device.
+ */
+
+static int RezActuatorSweep( RezActuator *actuator )
+{
+	RezTime now = RezTimeNow();
+	int response;
+
+	if( now < actuator->sweepAt ) return ( int ) ( ( actuator->sweepAt - now ) / 1000000 ) + 1;
+	if( actuator->sweep > 0 )
+	{
+		response = RezDeviceResponse( &actuator->device );
+		actuator->swept[ actuator->sweep - 1 ] = ( unsigned char ) ( response < 0 ? 0 : response > 255 ? 255 : response );
+	}
+	if( actuator->sweep == REZ_CALIBRATION_STEPS )
+	{
+		RezActuatorWrite( actuator, 0, NULL );
+		memcpy( actuator->calibration.response, actuator->swept, sizeof( actuator->swept ) );
+		actuator->mapped = RezCalibrationBuild( &actuator->calibration, actuator->device.identity );
+		if( actuator->mapped )
+		{
+			RezMutexLock( &actuator->lock );
+			RezCalibrationKeep( &actuator->store, &actuator->calibration );
+			RezMutexUnlock( &actuator->lock );
+			RezAtomicStore( &actuator->calibrated, 1 );
+		}
+		actuator->sweep = NOSWEEP;
+		actuator->envelope.sent = 0;
+		return 0;
+	}
+	RezActuatorWrite( actuator, RezCalibrationSpeed( actuator->sweep ), NULL );
+	actuator->sweep++;
+	actuator->sweepAt = RezTimeNow() + REZ_MS( REZ_CALIBRATION_SETTLEMS );
+	return REZ_CALIBRATION_SETTLEMS;
+}
+
+/*
+ * End a calibration by hand, felt or not: stop the motor, so a parked
+ * thread need not stop it again, and go back to whatever calibration the
+ * unit now has.
+ */
+
+static void RezActuatorFelt( RezActuator *actuator )
+{
+	actuator->feeling = NOFEEL;
+	actuator->envelope.sent = 0;
+	if( !actuator->open ) return;
+	if( RezActuatorWrite( actuator, 0, NULL ) ) actuator->halted = 1;
+	if( actuator->open ) RezActuatorCalibrate( actuator );
+}
+
+/*
+ * Asked with no calibration by hand under way, start one, looking for a
+ * device first if there is none, in place of any sweep.  The speeds are
+ * sent as they are.  Asked during one, the speed a step before the one
+ * being held is the lowest felt, and becomes the unit's calibration.
+ */
+
+static void RezActuatorAsked( RezActuator *actuator )
+{
+	if( actuator->feeling == NOFEEL )
+	{
+		if( !actuator->open )
+		{
+			actuator->nextLook = 0;
+			RezActuatorLook( actuator, RezTimeNow() );
+			if( !actuator->open ) return;
+		}
+		actuator->sweep = NOSWEEP;
+		actuator->mapped = 0;
+		actuator->halted = 0;
+		actuator->feeling = 0;
+		actuator->feelAt = 0;
+		return;
+	}
+	RezCalibrationFelt( &actuator->calibration, actuator->device.identity, actuator->feeling - FEELSTEP );
+	RezMutexLock( &actuator->lock );
+	RezCalibrationKeep( &actuator->store, &actuator->calibration );
+	RezMutexUnlock( &actuator->lock );
+	RezAtomicStore( &actuator->calibrated, 1 );
+	RezActuatorFelt( actuator );
+}
+
+/*
+ * Take one step of a calibration by hand, giving up once full speed has
+ * been held for a step, or the device has gone.  Returns how long to wait
+ * for the next step.
+ */
+
+static int RezActuatorFeeling( RezActuator *actuator )
+{
+	RezTime now = RezTimeNow();
+
+	if( now < actuator->feelAt ) return ( int ) ( ( actuator->feelAt - now ) / 1000000 ) + 1;
+	if( !actuator->open || actuator->feeling == 255 )
+	{
+		RezActuatorFelt( actuator );
+		return 0;
+	}
+	actuator->feeling = actuator->feeling + FEELSTEP < 255 ? actuator->feeling + FEELSTEP : 255;
+	RezActuatorWrite( actuator, actuator->feeling, NULL );
+	actuator->feelAt = RezTimeNow() + REZ_MS( FEELSTEPMS );
+	return FEELSTEPMS;
+}
+
+/*
+ * Parked, the envelope is stopped dead and the device told to stop, then
+ * the thread sleeps until something changes, or for a tick if the stop
+ * did not go through.
+ */
+
+static int RezActuatorParked( RezActuator *actuator, unsigned long tick )
+{
+	RezEnvelopeStrike( &actuator->envelope, tick, 0 );
+	if( actuator->sweep > 0 ) actuator->sweep = 0;
+	if( actuator->open && !actuator->halted && RezActuatorWrite( actuator, 0, NULL ) )
+	{
+		actuator->halted = 1;
+		actuator->envelope.sent = 0;
+	}
+	return actuator->open && !actuator->halted ? ENVELOPETICKMS : -1;
+}
+
+/*
+ * Each pass takes any strike, looks for a device if there is none, sends
+ * whatever the envelope has for this tick, then sleeps until the next
+ * tick, or the next look, or until something happens if the envelope is
+ * still.  Without a device the envelope is still followed, only not
+ * written.  A write that runs past a tick just means the
+ * next pass is later; the envelope is read at the time it is read, so
+ * the motor skips speeds rather than falling behind.  When stopping the
+ * motor is always left stopped, and the thread goes round again rather
+ * than sleeping, since the raise that said so may have woken this pass.
+ * While a sweep or a calibration by hand is on, it has the device to
+ * itself, and a calibration by hand goes on even parked.
+ */
+
+static void RezActuatorMain( void *argument )
+{
+	RezActuator *actuator = ( RezActuator * ) argument;
+
+	for( ;; )
+	{
+		RezTrace trace;
+		RezTime now;
+		unsigned long tick;
+		int peak, pending, asked, speed, untilMS, lookMS;
+
+		asked = RezAtomicExchange( &actuator->asked, 0 );
+		RezMutexLock( &actuator->lock );
+		pending = actuator->pending;
+		peak = actuator->peak;
+		trace = actuator->trace;
+		actuator->pending = 0;
+		RezMutexUnlock( &actuator->lock );
+
+		tick = RezEnvelopeTick( RezTimeNow() );
+		if( pending ) RezEnvelopeStrike( &actuator->envelope, tick, peak );
+		if( RezAtomicLoad( &actuator->stop ) && !pending )
+		{
+			if( actuator->open && ( actuator->envelope.sent != 0 || actuator->sweep > 0 || actuator->feeling > 0 ) )
+				RezActuatorWrite( actuator, 0, NULL );
+			break;
+		}
+		while( asked-- > 0 ) RezActuatorAsked( actuator );
+		if( actuator->feeling != NOFEEL )
+		{
+			RezSignalWait( &actuator->wake, RezActuatorFeeling( actuator ) );
+			continue;
+		}
+		if( RezAtomicLoad( &actuator->parked ) )
+		{
+			RezSignalWait( &actuator->wake, RezActuatorParked( actuator, tick ) );
+			continue;
+		}
+		actuator->halted = 0;
+		if( !actuator->open ) RezActuatorLook( actuator, RezTimeNow() );
+		if( actuator->open && actuator->sweep != NOSWEEP )
+		{
+			RezSignalWait( &actuator->wake, RezActuatorSweep( actuator ) );
+			continue;
+		}
+		if( RezEnvelopeNext( &actuator->envelope, tick, &speed ) && actuator->open && RezActuatorMapped( actuator, speed ) != actuator->written )
+			RezActuatorWrite( actuator, speed, pending ? &trace : NULL );
+
+		if( RezAtomicLoad( &actuator->stop ) ) continue;
+		now = RezTimeNow();
+		if( RezEnvelopeIdle( &actuator->envelope, RezEnvelopeTick( now ) ) ) untilMS = -1;
+		else untilMS = ENVELOPETICKMS - ( int ) ( now / 1000000 % ENVELOPETICKMS );
+		if( !actuator->open )
+		{
+			lookMS = now >= actuator->nextLook ? 0 : ( int ) ( ( actuator->nextLook - now ) / 1000000 ) + 1;
+			if( untilMS < 0 || lookMS < untilMS ) untilMS = lookMS;
+		}
+		RezSignalWait( &actuator->wake, untilMS );
+	}
+}
+
+int RezActuatorStart( RezActuator *actuator, RezLatency *latency, const RezCalibrationStore *store )
+{
+	memset( actuator, 0, sizeof( RezActuator ) );
+	actuator->latency = latency;
+	actuator->sweep = NOSWEEP;
+	actuator->feeling = NOFEEL;
+	if( store != NULL ) actuator->store = *store;
+	else RezCalibrationStoreReset( &actuator->store );
+	RezCalibrationReset( &actuator->calibration );
+	actuator->nextLook = RezTimeNow();
+	RezEnvelopeDefaults( &actuator->envelope );
+	RezMutexInit( &actuator->lock );
+	if( !RezSignalInit( &actuator->wake ) )
+	{
+		RezMutexDestroy( &actuator->lock );
+		return 0;
+	}
+	if( !RezThreadStart( &actuator->thread, RezActuatorMain, actuator, REZ_PRIORITY_HIGH ) )
+	{
+		RezSignalDestroy( &actuator->wake );
+		RezMutexDestroy( &actuator->lock );
+		return 0;
+	}
+	return 1;
+}
+
+void RezActuatorStrike( RezActuator *actuator, int peak, const RezTrace *trace )
+{
+	RezMutexLock( &actuator->lock );
+	if( actuator->pending ) actuator->latency->superseded++;
+	actuator->pending = 1;
+	actuator->peak = peak;
+	actuator->trace = *trace;
+	actuator->trace.queued = RezTimeNow();
+	RezMutexUnlock( &actuator->lock );
+	RezSignalRaise( &actuator->wake );
+}
+
+void RezActuatorPark( RezActuator *actuator, int parked )
+{
+	RezAtomicStore( &actuator->parked, parked );
+	RezSignalRaise( &actuator->wake );
+}
+
+void RezActuatorFeel( RezActuator *actuator )
+{
+	RezAtomicAdd( &actuator->asked, 1 );
+	RezSignalRaise( &actuator->wake );
+}
+
+/*
+ * Once stopped there is no thread to race and no lock left to take.
+ */
+
+int RezActuatorCalibration( RezActuator *actuator, RezCalibrationStore *store )
+{
+	if( !RezAtomicExchange( &actuator->calibrated, 0 ) ) return 0;
+	if( !actuator->stopped ) RezMutexLock( &actuator->lock );
+	*store = actuator->store;
+	if( !actuator->stopped ) RezMutexUnlock( &actuator->lock );
+	return 1;
+}
+
+void RezActuatorStop( RezActuator *actuator )
+{
+	RezAtomicStore( &actuator->stop, 1 );
+	RezSignalRaise( &actuator->wake );
+	RezThreadJoin( &actuator->thread );
+	if( actuator->open ) RezActuatorLose( actuator );
+	RezSignalDestroy( &actuator->wake );
+	RezMutexDestroy( &actuator->lock );
+	actuator->stopped = 1;
+}
@@ -0,0 +1,158 @@
+/*
+ *  rezActuator.h
+ *  rezTunes
+ *
+ *  A high priority thread that owns the device, so the message handler
+ *  never waits on USB, not even to find it.  The thread looks for a unit
+ *  every RESCANMS until one opens, and gives it up again once LOSTWRITES
+ *  writes in a row have failed, as they do when it is pulled out, to go
+ *  back to looking.  Whether there is one is published in present.
+ *
+ *  The handler only says when a beat strikes and how hard; the thread
+ *  plays the envelope out to the device itself, once every
+ *  ENVELOPETICKMS while it is moving, and sleeps while it is still.
+ *  Strikes are taken with or without a device, so one plugged in part
+ *  way through a beat picks it up where it has got to.
+ *
+ *  There is only ever one strike waiting: a new one replaces any the
+ *  thread has not picked up yet, since it would start from the same
+ *  level anyway.  Each strike carries its trace, which the thread
+ *  finishes and records once the write it causes completes.
+ *
+ *  While the plugin has nothing to do the actuator is parked: the motor
+ *  is stopped, and the thread neither follows the envelope nor looks for
+ *  a device, so it does not wake at all until it is unparked.
+ *
+ *  Every speed goes through the device's calibration table on its way
+ *  out (see rezCalibration.h), and one that comes out the same as the
+ *  last one written is not written again.  written is that last one, or
+ *  -1 when a write failed and what the device has is not known.  The
+ *  thread is given a store of calibrations, and uses the one kept for the
+ *  unit it opens.  The first time a unit that can be calibrated is found
+ *  without one, the thread sweeps it, which takes REZ_CALIBRATION_STEPS
+ *  times REZ_CALIBRATION_SETTLEMS, and beats are followed but not written
+ *  meanwhile.  Parking part way through starts the sweep again next time.
+ *  A unit that cannot be swept is calibrated by hand instead, when asked
+ *  to: the thread runs it up from stopped, FEELSTEP at a time every
+ *  FEELSTEPMS, until asked again, and takes the speed a step before that
+ *  as the lowest that can be felt, allowing for the motor spinning up and
+ *  the user taking a moment to answer.  If it reaches full speed and
+ *  holds it for a step without being asked, it stops and nothing
+ *  changes.  Beats are followed but not written meanwhile, parked or
+ *  not.  A new calibration goes in the store, which is handed back for
+ *  whoever started the thread to keep.
+ */
+
+#ifndef REZACTUATOR_H_
+#define REZACTUATOR_H_
+
+#include "rezAtomic.h"
+#include "rezCalibration.h"
+#include "rezDevice.h"
+#include "rezEnvelope.h"
+#include "rezLatency.h"
+#include "rezThread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * RESCANMS - How often to look for a device while there is none.
+ * LOSTWRITES - How many failed writes in a row mean it has gone.
+ */
+
+#define RESCANMS 1000
+#define LOSTWRITES 3
+
+/*
+ * FEELSTEP - How much faster each step of a calibration by hand goes.
+ * FEELSTEPMS - How long each step is held, long enough for the motor to
+ *   spin up and to be felt.
+ */
+
+#define FEELSTEP 4
+#define FEELSTEPMS 500
+
+struct RezActuator {
+	RezThread			thread;
+	RezMutex			lock;
+	RezSignal			wake;
+	RezAtomic			stop;
+	RezAtomic			parked;
+	RezAtomic			present;
+	RezAtomic			calibrated;
+	RezAtomic			asked;
+	RezLatency			*latency;
+
+	/* Protected by lock */
+	int					pending;
+	int					peak;
+	RezTrace			trace;
+
+	/* Changed only by the thread, under lock */
+	RezCalibrationStore	store;
+
+	/* Thread only */
+	RezCalibration		calibration;
+	RezEnvelope			envelope;
+	RezDevice			device;
+	int					open;
+	int					stopped;
+	int					failures;
+	int					halted;
+	int					written;
+	RezTime				nextLook;
+	int					mapped;
+	int					sweep;
+	RezTime				sweepAt;
+	unsigned char		swept[ REZ_CALIBRATION_STEPS ];
+	int					feeling;
+	RezTime				feelAt;
+};
+typedef struct RezActuator RezActuator;
+
+/*
+ * RezActuatorStart starts the thread, which goes looking for a device at
+ * once, recording into latency; it returns 0 if it cannot.  It does not
+ * wait for the device.  store holds calibrations kept from before, or is
+ * NULL.
+ *
+ * RezActuatorStrike hands over a strike, stamping its trace as queued.  A
+ * peak of 0 stops the motor.  Only the thread that handles plugin
+ * messages may strike.
+ *
+ * RezActuatorPark with parked set stops the motor and parks the thread.
+ * The stop is written whatever speed was last sent, since the last write
+ * may have failed, and tried again every tick until it goes through or
+ * the device is given up.  Unparking goes back to looking for a device,
+ * if there is none, at once.
+ *
+ * RezActuatorFeel starts a calibration by hand of whatever device is
+ * there, looking for one at once if there is none, or once one is under
+ * way says the user has felt it.  Any thread may call it.
+ *
+ * RezActuatorPresent is true while the thread has a device open.
+ *
+ * RezActuatorCalibration copies out the store if the thread has made a
+ * calibration since it was last asked, and returns 0 if not.  It may still
+ * be asked once the actuator is stopped, so one finished just before is
+ * not lost.
+ *
+ * RezActuatorStop stops the motor and the thread, and closes the device.
+ */
+
+extern int RezActuatorStart( RezActuator *actuator, RezLatency *latency, const RezCalibrationStore *store );
+extern void RezActuatorStrike( RezActuator *actuator, int peak, const RezTrace *trace );
+extern void RezActuatorPark( RezActuator *actuator, int parked );
+extern void RezActuatorFeel( RezActuator *actuator );
+extern int RezActuatorCalibration( RezActuator *actuator, RezCalibrationStore *store );
+extern void RezActuatorStop( RezActuator *actuator );
+
+#define RezActuatorPresent( actuator ) ( RezAtomicLoad( &( actuator )->present ) != 0 )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZACTUATOR_H_ */
@@ -0,0 +1,143 @@
+/*
+ *  rezAnalyze.c
+ *  rezTunes
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include "rezAnalyze.h"
+
+#define REZ_PI 3.14159265358979323846
+
+/*
+ * Cancellation is only looked at this often, in frames.
+ */
+
+#define REZ_CANCEL_FRAMES 64
+
+void RezAnalyzerInit( RezAnalyzer *analyzer )
+{
+	int i, bits = 0;
+
+	while( ( 1 << bits ) < REZ_FFT_SIZE ) bits++;
+	for( i = 0; i < REZ_FFT_SIZE; i++ )
+	{
+		int b, reversed = 0;
+
+		for( b = 0; b < bits; b++ )
+			if( i & ( 1 << b ) ) reversed |= 1 << ( bits - 1 - b );
+		analyzer->reverse[ i ] = ( unsigned short ) reversed;
+		analyzer->window[ i ] = ( float ) ( 0.5 - 0.5 * cos( 2 * REZ_PI * i / REZ_FFT_SIZE ) );
+	}
+	for( i = 0; i < REZ_FFT_SIZE / 2; i++ )
+	{
+		analyzer->cosine[ i ] = ( float ) cos( 2 * REZ_PI * i / REZ_FFT_SIZE );
+		analyzer->sine[ i ] = ( float ) -sin( 2 * REZ_PI * i / REZ_FFT_SIZE );
+	}
+	RezDetectorInit( &analyzer->detector );
+}
+
+/*
+ * An iterative radix 2 transform over real and imag, in place.
+ */
+
+static void RezTransform( RezAnalyzer *analyzer )
+{
+	float *re = analyzer->real, *im = analyzer->imag;
+	int span, start, k;
+
+	for( span = 1; span < REZ_FFT_SIZE; span <<= 1 )
+	{
+		int step = REZ_FFT_SIZE / ( 2 * span );
+
+		for( start = 0; start < REZ_FFT_SIZE; start += 2 * span )
+		{
+			for( k = 0; k < span; k++ )
+			{
+				float c = analyzer->cosine[ k * step ], s = analyzer->sine[ k * step ];
+				int a = start + k, b = a + span;
+				float tr = re[ b ] * c - im[ b ] * s;
+				float ti = re[ b ] * s + im[ b ] * c;
+
+				re[ b ] = re[ a ] - tr;
+				im[ b ] = im[ a ] - ti;
+				re[ a ] += tr;
+				im[ a ] += ti;
+			}
+		}
+	}
+}
+
+/*
+ * Both channels go through one complex transform, left as the real part
+ * and right as the imaginary part, and are pulled apart again using the
+ * symmetry of a real signal's spectrum.
+ *
+ * A full scale sine under the Hann window peaks at a quarter of the
+ * transform size.  Bins are scaled so that comes out at 255, and square
+ * rooted, which spreads quiet music over about the same range of values
+ * iTunes gives its visualisers.
+ */
+
+void RezAnalyzerSpectrum( RezAnalyzer *analyzer, const float *left, const float *right )
+{
+	const float scale = 4.0f / REZ_FFT_SIZE;
+	int i;
+
+	for( i = 0; i < REZ_FFT_SIZE; i++ )
+	{
+		int j = analyzer->reverse[ i ];
+
+		analyzer->real[ j ] = left[ i ] * analyzer->window[ i ];
+		analyzer->imag[ j ] = right[ i ] * analyzer->window[ i ];
+	}
+	RezTransform( analyzer );
+
+	for( i = 0; i < REZ_SPECTRUM_ENTRIES; i++ )
+	{
+		int mirror = ( REZ_FFT_SIZE - i ) & ( REZ_FFT_SIZE - 1 );
+		float ar = analyzer->real[ i ], ai = analyzer->imag[ i ];
+		float br = analyzer->real[ mirror ], bi = analyzer->imag[ mirror ];
+		float leftRe = 0.5f * ( ar + br ), leftIm = 0.5f * ( ai - bi );
+		float rightRe = 0.5f * ( ai + bi ), rightIm = 0.5f * ( br - ar );
+		float l = 255.0f * sqrtf( sqrtf( leftRe * leftRe + leftIm * leftIm ) * scale );
+		float r = 255.0f * sqrtf( sqrtf( rightRe * rightRe + rightIm * rightIm ) * scale );
+
+		analyzer->row[ 0 ][ i ] = ( unsigned char ) ( l > 255.0f ? 255 : l );
+		analyzer->row[ 1 ][ i ] = ( unsigned char ) ( r > 255.0f ? 255 : r );
+	}
+}
+
+/*
+ * Frames are RETAINMS / RETAINSAMPLES apart, as they are live.  Each
+ * frame's transform covers the samples just before its position, which
+ * is what iTunes has played by the time it hands the row over.
+ */
+
+int RezAnalyzeAudio( RezAnalyzer *analyzer, const RezAudio *audio, RezBeat *beats, unsigned long capacity,
+					 unsigned long *count, RezAtomic *cancel )
+{
+	const unsigned long frameMS = RETAINMS / RETAINSAMPLES;
+	unsigned long frame, frames;
+
+	*count = 0;
+	RezDetectorInit( &analyzer->detector );
+	frames = ( unsigned long ) ( ( double ) audio->frames * 1000 / audio->rate / frameMS ) + 1;
+
+	for( frame = 0; frame < frames; frame++ )
+	{
+		unsigned long positionMS = frame * frameMS;
+		long end = ( long ) ( ( double ) positionMS * audio->rate / 1000 );
+
+		if( cancel != NULL && frame % REZ_CANCEL_FRAMES == 0 && RezAtomicLoad( cancel ) ) return 0;
+
+		RezAudioRead( audio, end - REZ_FFT_SIZE, REZ_FFT_SIZE, analyzer->left, analyzer->right );
+		RezAnalyzerSpectrum( analyzer, analyzer->left, analyzer->right );
+		if( RezDetectorProcess( &analyzer->detector, analyzer->row[ 0 ], analyzer->row[ 1 ] ) )
+		{
+			if( *count >= capacity || positionMS > REZ_BEAT_MAX_POSITION ) return 0;
+			beats[ ( *count )++ ] = REZ_BEAT( positionMS, analyzer->detector.motorSpeed );
+		}
+	}
+	return 1;
+}
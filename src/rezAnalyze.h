@@ -0,0 +1,59 @@
+/*
+ *  rezAnalyze.h
+ *  rezTunes
+ *
+ *  Offline beat detection.  Decoded audio is turned into spectrum rows
+ *  much like the ones iTunes hands a visualiser, one pair every detector
+ *  frame, and run through the same detector the plugin uses live.  The
+ *  result is a beat map in the beat cache's format.
+ */
+
+#ifndef REZANALYZE_H_
+#define REZANALYZE_H_
+
+#include "rezAtomic.h"
+#include "rezAudio.h"
+#include "rezBeatCache.h"
+#include "rezDetector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * REZ_FFT_SIZE - Samples per transform, twice the bins in a row.
+ */
+
+#define REZ_FFT_SIZE ( 2 * REZ_SPECTRUM_ENTRIES )
+
+struct RezAnalyzer {
+	float				window[ REZ_FFT_SIZE ];
+	float				cosine[ REZ_FFT_SIZE / 2 ];
+	float				sine[ REZ_FFT_SIZE / 2 ];
+	unsigned short		reverse[ REZ_FFT_SIZE ];
+	float				real[ REZ_FFT_SIZE ];
+	float				imag[ REZ_FFT_SIZE ];
+	float				left[ REZ_FFT_SIZE ];
+	float				right[ REZ_FFT_SIZE ];
+	unsigned char		row[ 2 ][ REZ_SPECTRUM_ENTRIES ];
+	RezDetector			detector;
+};
+typedef struct RezAnalyzer RezAnalyzer;
+
+extern void RezAnalyzerInit( RezAnalyzer *analyzer );
+extern void RezAnalyzerSpectrum( RezAnalyzer *analyzer, const float *left, const float *right );
+
+/*
+ * Analyse a whole file from the start.  Returns non-zero if it got to the
+ * end; zero if cancel was set along the way or the beats did not fit.
+ * cancel may be NULL.
+ */
+
+extern int RezAnalyzeAudio( RezAnalyzer *analyzer, const RezAudio *audio, RezBeat *beats, unsigned long capacity,
+							unsigned long *count, RezAtomic *cancel );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZANALYZE_H_ */
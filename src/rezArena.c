@@ -0,0 +1,47 @@
+/*
+ *  rezArena.c
+ *  rezTunes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rezArena.h"
+#include "rezInstrument.h"
+
+REZ_STATIC_ASSERT( cache_line_power_of_two, ( REZ_CACHE_LINE & ( REZ_CACHE_LINE - 1 ) ) == 0 );
+
+/*
+ * malloc only promises alignment for the largest plain type, so ask for a
+ * line more and start on the first whole line.
+ */
+
+int RezArenaInit( RezArena *arena, unsigned long size )
+{
+	size = REZ_ARENA_BLOCK( size );
+	REZ_ALLOCATION();
+	arena->memory = malloc( size + REZ_CACHE_LINE );
+	if( arena->memory == NULL ) return 0;
+	memset( arena->memory, 0, size + REZ_CACHE_LINE );
+	arena->base = ( unsigned char * ) arena->memory + ( REZ_CACHE_LINE - ( size_t ) arena->memory % REZ_CACHE_LINE ) % REZ_CACHE_LINE;
+	arena->size = size;
+	arena->used = 0;
+	return 1;
+}
+
+void *RezArenaTake( RezArena *arena, unsigned long size )
+{
+	void *block;
+
+	size = REZ_ARENA_BLOCK( size );
+	if( size > arena->size - arena->used ) return NULL;
+	block = arena->base + arena->used;
+	arena->used += size;
+	return block;
+}
+
+void RezArenaFree( RezArena *arena )
+{
+	free( arena->memory );
+	arena->memory = NULL;
+	arena->base = NULL;
+}
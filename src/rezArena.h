@@ -0,0 +1,59 @@
+/*
+ *  rezArena.h
+ *  rezTunes
+ *
+ *  One allocation carved into blocks, each starting on its own cache
+ *  line, so that state written by different threads never shares a line
+ *  and everything an instance owns comes and goes together.  Blocks are
+ *  only ever taken, in order, and the whole arena is freed at once.
+ *
+ *  The size is worked out up front by adding up REZ_ARENA_BLOCK for each
+ *  block that will be taken.
+ */
+
+#ifndef REZARENA_H_
+#define REZARENA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * REZ_CACHE_LINE - Bytes in a cache line, a power of two.  64 on every
+ *   processor iTunes runs on.
+ */
+
+#define REZ_CACHE_LINE 64
+
+#define REZ_ARENA_BLOCK( size ) ( ( ( unsigned long ) ( size ) + REZ_CACHE_LINE - 1 ) & ~( unsigned long ) ( REZ_CACHE_LINE - 1 ) )
+
+/*
+ * Fails to compile, with name in the error, unless condition holds.
+ */
+
+#define REZ_STATIC_ASSERT( name, condition ) typedef char RezStaticAssert_##name[ ( condition ) ? 1 : -1 ]
+
+struct RezArena {
+	void				*memory;
+	unsigned char		*base;
+	unsigned long		size;
+	unsigned long		used;
+};
+typedef struct RezArena RezArena;
+
+/*
+ * RezArenaInit allocates size bytes, zeroed, and returns 0 if it cannot.
+ * RezArenaTake hands out the next size bytes on a fresh cache line, or
+ * NULL if the arena is used up.  RezArenaFree frees all of it, so an
+ * arena that holds its own RezArena must be copied out before freeing.
+ */
+
+extern int RezArenaInit( RezArena *arena, unsigned long size );
+extern void *RezArenaTake( RezArena *arena, unsigned long size );
+extern void RezArenaFree( RezArena *arena );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZARENA_H_ */
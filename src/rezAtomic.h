@@ -0,0 +1,95 @@
+/*
+ *  rezAtomic.h
+ *  rezTunes
+ *
+ *  The few atomic operations the lock-free parts of the plugin need, on
+ *  top of whatever each platform provides.  All of them are full
+ *  barriers, which is more than is strictly needed but keeps reasoning
+ *  simple on PPC as well as x86.
+ */
+
+#ifndef REZATOMIC_H_
+#define REZATOMIC_H_
+
+#if defined( _MSC_VER )
+#include <windows.h>
+#define REZ_INLINE static __inline
+typedef volatile LONG RezAtomic;
+#elif defined( __APPLE__ )
+#include <libkern/OSAtomic.h>
+#define REZ_INLINE static __inline__
+typedef volatile int32_t RezAtomic;
+#else
+#define REZ_INLINE static __inline__
+typedef volatile int RezAtomic;
+#endif
+
+REZ_INLINE int RezAtomicCompareAndSwap( RezAtomic *target, int expected, int desired )
+{
+#if defined( _MSC_VER )
+	return InterlockedCompareExchange( target, desired, expected ) == expected;
+#elif defined( __APPLE__ )
+	return OSAtomicCompareAndSwap32Barrier( expected, desired, target );
+#else
+	return __sync_bool_compare_and_swap( target, expected, desired );
+#endif
+}
+
+REZ_INLINE int RezAtomicAdd( RezAtomic *target, int delta )
+{
+#if defined( _MSC_VER )
+	return InterlockedExchangeAdd( target, delta ) + delta;
+#elif defined( __APPLE__ )
+	return OSAtomicAdd32Barrier( delta, target );
+#else
+	return __sync_add_and_fetch( target, delta );
+#endif
+}
+
+/*
+ * The value the swap is tried against is read atomically too, so that a
+ * race detector sees no plain read of a shared value.
+ */
+
+REZ_INLINE int RezAtomicExchange( RezAtomic *target, int value )
+{
+#if defined( _MSC_VER )
+	return InterlockedExchange( target, value );
+#else
+	int old;
+
+	do
+	{
+		old = RezAtomicAdd( target, 0 );
+	} while( !RezAtomicCompareAndSwap( target, old, value ) );
+	return old;
+#endif
+}
+
+REZ_INLINE int RezAtomicLoad( RezAtomic *target )
+{
+	return RezAtomicAdd( target, 0 );
+}
+
+REZ_INLINE void RezAtomicStore( RezAtomic *target, int value )
+{
+	RezAtomicExchange( target, value );
+}
+
+/*
+ * A full barrier on its own, for readers that may not write to the memory
+ * they read, such as a read only mapping.
+ */
+
+REZ_INLINE void RezAtomicBarrier( void )
+{
+#if defined( _MSC_VER )
+	MemoryBarrier();
+#elif defined( __APPLE__ )
+	OSMemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+#endif /* REZATOMIC_H_ */
@@ -0,0 +1,203 @@
+/*
+ *  rezAudio.c
+ *  rezTunes
+ */
+
+#include <math.h>
+#include <string.h>
+#include "rezAudio.h"
+
+static unsigned long RezReadLE( const unsigned char *p, int bytes )
+{
+	unsigned long value = 0;
+
+	while( bytes-- > 0 ) value = ( value << 8 ) | p[ bytes ];
+	return value;
+}
+
+static unsigned long RezReadBE( const unsigned char *p, int bytes )
+{
+	unsigned long value = 0;
+	int i;
+
+	for( i = 0; i < bytes; i++ ) value = ( value << 8 ) | p[ i ];
+	return value;
+}
+
+/*
+ * AIFF gives its sample rate as an 80 bit extended float: a sign bit, a
+ * 15 bit exponent and a 64 bit mantissa with an explicit integer bit.
+ */
+
+static unsigned long RezReadExtended( const unsigned char *p )
+{
+	int exponent = ( int ) ( RezReadBE( p, 2 ) & 0x7fff ) - 16383 - 63;
+	double mantissa = ( double ) RezReadBE( p + 2, 4 ) * 4294967296.0 + ( double ) RezReadBE( p + 6, 4 );
+
+	return ( unsigned long ) ( ldexp( mantissa, exponent ) + 0.5 );
+}
+
+static int RezParseWave( RezAudio *audio, const unsigned char *p, unsigned long size )
+{
+	unsigned long offset = 12;
+	int format = -1, bits = 0;
+
+	while( offset + 8 <= size )
+	{
+		unsigned long length = RezReadLE( p + offset + 4, 4 );
+		const unsigned char *chunk = p + offset + 8;
+
+		if( length > size - offset - 8 ) length = size - offset - 8;
+		if( memcmp( p + offset, "fmt ", 4 ) == 0 && length >= 16 )
+		{
+			format = ( int ) RezReadLE( chunk, 2 );
+			audio->channels = ( int ) RezReadLE( chunk + 2, 2 );
+			audio->rate = RezReadLE( chunk + 4, 4 );
+			bits = ( int ) RezReadLE( chunk + 14, 2 );
+			/* WAVE_FORMAT_EXTENSIBLE keeps the real format in its GUID */
+			if( format == 0xfffe && length >= 40 ) format = ( int ) RezReadLE( chunk + 24, 2 );
+		}
+		else if( memcmp( p + offset, "data", 4 ) == 0 && format >= 0 )
+		{
+			audio->bytesPerSample = ( bits + 7 ) / 8;
+			if( format == 1 ) audio->encoding = audio->bytesPerSample == 1 ? REZ_SAMPLE_UINT8 : REZ_SAMPLE_INT_LE;
+			else if( format == 3 && audio->bytesPerSample == 4 ) audio->encoding = REZ_SAMPLE_FLOAT_LE;
+			else return 0;
+			if( audio->channels < 1 || audio->bytesPerSample < 1 || audio->bytesPerSample > 4 ) return 0;
+			audio->data = chunk;
+			audio->frames = length / ( audio->channels * audio->bytesPerSample );
+			return 1;
+		}
+		offset += 8 + length + ( length & 1 );
+	}
+	return 0;
+}
+
+static int RezParseAiff( RezAudio *audio, const unsigned char *p, unsigned long size, int compressed )
+{
+	unsigned long offset = 12;
+	int bits = 0, common = 0;
+
+	audio->encoding = REZ_SAMPLE_INT_BE;
+	while( offset + 8 <= size )
+	{
+		unsigned long length = RezReadBE( p + offset + 4, 4 );
+		const unsigned char *chunk = p + offset + 8;
+
+		if( length > size - offset - 8 ) length = size - offset - 8;
+		if( memcmp( p + offset, "COMM", 4 ) == 0 && length >= 18 )
+		{
+			audio->channels = ( int ) RezReadBE( chunk, 2 );
+			audio->frames = RezReadBE( chunk + 2, 4 );
+			bits = ( int ) RezReadBE( chunk + 6, 2 );
+			audio->rate = RezReadExtended( chunk + 8 );
+			if( compressed )
+			{
+				if( length < 22 ) return 0;
+				if( memcmp( chunk + 18, "sowt", 4 ) == 0 ) audio->encoding = REZ_SAMPLE_INT_LE;
+				else if( memcmp( chunk + 18, "NONE", 4 ) != 0 ) return 0;
+			}
+			common = 1;
+		}
+		else if( memcmp( p + offset, "SSND", 4 ) == 0 && common && length >= 8 )
+		{
+			unsigned long skip = RezReadBE( chunk, 4 ) + 8;
+			unsigned long available;
+
+			audio->bytesPerSample = ( bits + 7 ) / 8;
+			if( audio->channels < 1 || audio->bytesPerSample < 1 || audio->bytesPerSample > 4 || skip > length ) return 0;
+			audio->data = chunk + skip;
+			available = ( length - skip ) / ( audio->channels * audio->bytesPerSample );
+			if( audio->frames > available ) audio->frames = available;
+			return 1;
+		}
+		offset += 8 + length + ( length & 1 );
+	}
+	return 0;
+}
+
+int RezAudioOpen( RezAudio *audio, const char *path )
+{
+	const unsigned char *p;
+	int parsed = 0;
+
+	memset( audio, 0, sizeof( RezAudio ) );
+	if( !RezMapFile( &audio->mapping, path, 0, 0 ) ) return 0;
+
+	p = ( const unsigned char * ) audio->mapping.base;
+	if( audio->mapping.size >= 12 )
+	{
+		if( memcmp( p, "RIFF", 4 ) == 0 && memcmp( p + 8, "WAVE", 4 ) == 0 )
+			parsed = RezParseWave( audio, p, audio->mapping.size );
+		else if( memcmp( p, "FORM", 4 ) == 0 && memcmp( p + 8, "AIFF", 4 ) == 0 )
+			parsed = RezParseAiff( audio, p, audio->mapping.size, 0 );
+		else if( memcmp( p, "FORM", 4 ) == 0 && memcmp( p + 8, "AIFC", 4 ) == 0 )
+			parsed = RezParseAiff( audio, p, audio->mapping.size, 1 );
+	}
+	if( !parsed || audio->rate == 0 || audio->frames == 0 )
+	{
+		RezAudioClose( audio );
+		return 0;
+	}
+	return 1;
+}
+
+void RezAudioClose( RezAudio *audio )
+{
+	RezUnmap( &audio->mapping );
+	memset( audio, 0, sizeof( RezAudio ) );
+}
+
+/*
+ * Integer samples are read into the top of a 32 bit word, whatever their
+ * width, so that one scale brings all of them to -1..1.
+ */
+
+static float RezAudioSample( const RezAudio *audio, const unsigned char *p )
+{
+	unsigned long raw;
+
+	switch( audio->encoding )
+	{
+		case REZ_SAMPLE_UINT8:
+			return ( p[ 0 ] - 128 ) * ( 1.0f / 128 );
+
+		case REZ_SAMPLE_FLOAT_LE:
+		{
+			union { unsigned int bits; float value; } sample;
+
+			sample.bits = ( unsigned int ) RezReadLE( p, 4 );
+			return sample.value;
+		}
+
+		case REZ_SAMPLE_INT_BE:
+			raw = RezReadBE( p, audio->bytesPerSample );
+			break;
+
+		default:
+			raw = RezReadLE( p, audio->bytesPerSample );
+			break;
+	}
+	raw <<= 32 - 8 * audio->bytesPerSample;
+	return ( float ) ( int ) ( raw & 0xffffffffUL ) * ( 1.0f / 2147483648.0f );
+}
+
+void RezAudioRead( const RezAudio *audio, long first, unsigned long count, float *left, float *right )
+{
+	unsigned long frameBytes = audio->channels * audio->bytesPerSample;
+	int second = audio->channels > 1 ? audio->bytesPerSample : 0;
+	unsigned long i;
+
+	for( i = 0; i < count; i++ )
+	{
+		long frame = first + ( long ) i;
+
+		if( frame < 0 || ( unsigned long ) frame >= audio->frames )
+		{
+			left[ i ] = right[ i ] = 0;
+			continue;
+		}
+		left[ i ] = RezAudioSample( audio, audio->data + frame * frameBytes );
+		right[ i ] = RezAudioSample( audio, audio->data + frame * frameBytes + second );
+	}
+}
@@ -0,0 +1,53 @@
+/*
+ *  rezAudio.h
+ *  rezTunes
+ *
+ *  Uncompressed audio files, memory mapped and read a block of frames at
+ *  a time as floats.  RIFF WAVE (integer or float PCM, including the
+ *  extensible format) and AIFF/AIFC (big endian, or little endian 'sowt')
+ *  are understood.  Only the first two channels are ever read; a mono
+ *  file reads the same samples into both.
+ */
+
+#ifndef REZAUDIO_H_
+#define REZAUDIO_H_
+
+#include "rezMap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	REZ_SAMPLE_INT_LE = 0,
+	REZ_SAMPLE_INT_BE,
+	REZ_SAMPLE_UINT8,
+	REZ_SAMPLE_FLOAT_LE
+};
+
+struct RezAudio {
+	RezMapping			mapping;
+	const unsigned char	*data;
+	unsigned long		frames;
+	unsigned long		rate;
+	int					channels;
+	int					bytesPerSample;
+	int					encoding;
+};
+typedef struct RezAudio RezAudio;
+
+/*
+ * RezAudioOpen returns 0 for anything that is not a file in one of the
+ * formats above, leaving audio closed.  RezAudioRead fills count frames
+ * starting at first, with silence past either end of the file.
+ */
+
+extern int RezAudioOpen( RezAudio *audio, const char *path );
+extern void RezAudioClose( RezAudio *audio );
+extern void RezAudioRead( const RezAudio *audio, long first, unsigned long count, float *left, float *right );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZAUDIO_H_ */
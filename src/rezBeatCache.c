@@ -0,0 +1,281 @@
+/*
+ *  rezBeatCache.c
+ *  rezTunes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rezArena.h"
+#include "rezBeatCache.h"
+
+#if defined( _WIN32 )
+#include <direct.h>
+#define REZ_SEPARATOR "\\"
+#define RezMakeDirectory( path ) _mkdir( path )
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#define REZ_SEPARATOR "/"
+#define RezMakeDirectory( path ) mkdir( path, 0755 )
+#endif
+
+/*
+ * Maps are written and read as arrays of beats by 32 and 64 bit builds
+ * alike.
+ */
+
+REZ_STATIC_ASSERT( beat_size, sizeof( RezBeat ) == 4 );
+
+/*
+ * 64 bit FNV-1a.  Start with a hash of 0 and feed the result back in
+ * with each field that identifies a track.
+ */
+
+RezTrackKey RezTrackKeyHash( RezTrackKey hash, const void *data, unsigned long length )
+{
+	const unsigned char *bytes = ( const unsigned char * ) data;
+
+	if( hash == 0 ) hash = ( ( RezTrackKey ) 0xcbf29ce4 << 32 ) | 0x84222325;
+	while( length-- > 0 )
+	{
+		hash ^= *bytes++;
+		hash *= ( ( RezTrackKey ) 0x100 << 32 ) | 0x000001b3;
+	}
+	return hash;
+}
+
+/*
+ * ~/Library/Caches/rezTunes on the Mac, %APPDATA%\rezTunes on Windows and
+ * ~/.cache/rezTunes anywhere else.
+ */
+
+int RezBeatCacheDefaultDirectory( char *directory, unsigned long size )
+{
+#if defined( _WIN32 )
+	const char *base = getenv( "APPDATA" );
+	const char *suffix = "\\rezTunes";
+#elif defined( __APPLE__ )
+	const char *base = getenv( "HOME" );
+	const char *suffix = "/Library/Caches/rezTunes";
+#else
+	const char *base = getenv( "HOME" );
+	const char *suffix = "/.cache/rezTunes";
+#endif
+
+	if( base == NULL || strlen( base ) + strlen( suffix ) + 1 > size ) return 0;
+	strcpy( directory, base );
+	strcat( directory, suffix );
+	return 1;
+}
+
+static void RezBeatCachePath( const RezBeatCache *cache, RezTrackKey key, char *path )
+{
+	sprintf( path, "%s" REZ_SEPARATOR "%08lx%08lx.rzb", cache->directory,
+			 ( unsigned long ) ( key >> 32 ), ( unsigned long ) ( key & 0xffffffff ) );
+}
+
+/*
+ * Map the index, creating the directory and an empty index if there are
+ * none yet.  An index from another version of the format is thrown away.
+ */
+
+int RezBeatCacheOpen( RezBeatCache *cache, const char *directory )
+{
+	char path[ REZ_CACHE_PATH + 32 ];
+	unsigned long size = sizeof( RezCacheHeader ) + REZ_CACHE_TRACKS * sizeof( RezCacheEntry );
+
+	memset( cache, 0, sizeof( RezBeatCache ) );
+	if( strlen( directory ) >= REZ_CACHE_PATH ) return 0;
+	strcpy( cache->directory, directory );
+	RezMakeDirectory( directory );
+
+	sprintf( path, "%s" REZ_SEPARATOR "index.rzi", directory );
+	if( !RezMapFile( &cache->index, path, size, 1 ) ) return 0;
+
+	cache->header = ( RezCacheHeader * ) cache->index.base;
+	cache->entries = ( RezCacheEntry * ) ( cache->header + 1 );
+	RezMapLock( &cache->index );
+	if( cache->header->magic != REZ_CACHE_MAGIC || cache->header->version != REZ_CACHE_VERSION || cache->header->capacity != REZ_CACHE_TRACKS )
+	{
+		memset( cache->index.base, 0, size );
+		cache->header->magic = REZ_CACHE_MAGIC;
+		cache->header->version = REZ_CACHE_VERSION;
+		cache->header->capacity = REZ_CACHE_TRACKS;
+	}
+	RezMapUnlock( &cache->index );
+	return 1;
+}
+
+void RezBeatCacheClose( RezBeatCache *cache )
+{
+	RezBeatCacheRelease( cache );
+	RezUnmap( &cache->index );
+	cache->header = NULL;
+	cache->entries = NULL;
+}
+
+#define RezCacheEntryUsed( entry ) ( ( entry )->beats != 0 || ( entry )->profileFrames != 0 )
+
+static RezCacheEntry *RezBeatCacheFind( RezBeatCache *cache, RezTrackKey key )
+{
+	int i;
+
+	for( i = 0; i < REZ_CACHE_TRACKS; i++ )
+		if( RezCacheEntryUsed( &cache->entries[ i ] ) && cache->entries[ i ].key == key ) return &cache->entries[ i ];
+	return NULL;
+}
+
+/*
+ * Find the slot for a track, or make one by evicting the least recently
+ * used track if every slot is taken.  The index must be locked.
+ */
+
+static RezCacheEntry *RezBeatCacheClaim( RezBeatCache *cache, RezTrackKey key )
+{
+	char path[ REZ_CACHE_PATH + 32 ];
+	RezCacheEntry *entry;
+	int i;
+
+	entry = RezBeatCacheFind( cache, key );
+	if( entry != NULL ) return entry;
+
+	entry = &cache->entries[ 0 ];
+	for( i = 0; i < REZ_CACHE_TRACKS && RezCacheEntryUsed( entry ); i++ )
+		if( !RezCacheEntryUsed( &cache->entries[ i ] ) || cache->entries[ i ].lastUsed < entry->lastUsed ) entry = &cache->entries[ i ];
+	if( entry->beats != 0 )
+	{
+		RezBeatCachePath( cache, entry->key, path );
+		remove( path );
+	}
+	memset( entry, 0, sizeof( RezCacheEntry ) );
+	entry->key = key;
+	return entry;
+}
+
+/*
+ * Map the beats stored for a track.  The returned array stays valid until
+ * the next lookup or release.  Returns NULL if the track is not cached.
+ */
+
+const RezBeat *RezBeatCacheLookup( RezBeatCache *cache, RezTrackKey key, unsigned long *count )
+{
+	char path[ REZ_CACHE_PATH + 32 ];
+	RezCacheEntry *entry;
+
+	*count = 0;
+	RezBeatCacheRelease( cache );
+	if( cache->header == NULL ) return NULL;
+
+	RezMapLock( &cache->index );
+	entry = RezBeatCacheFind( cache, key );
+	if( entry != NULL )
+	{
+		RezBeatCachePath( cache, key, path );
+		if( !RezMapFile( &cache->track, path, 0, 0 ) || cache->track.size < entry->beats * sizeof( RezBeat ) )
+		{
+			RezUnmap( &cache->track );
+			entry->beats = 0;
+		}
+		else
+		{
+			entry->lastUsed = ++cache->header->clock;
+			*count = entry->beats;
+		}
+	}
+	RezMapUnlock( &cache->index );
+	if( *count == 0 ) RezUnmap( &cache->track );
+	return ( const RezBeat * ) cache->track.base;
+}
+
+void RezBeatCacheRelease( RezBeatCache *cache )
+{
+	RezUnmap( &cache->track );
+}
+
+/*
+ * Write a track's beats and enter them in the index, evicting the least
+ * recently used track if every slot is taken.  Any beats mapped by an
+ * earlier lookup are released first, as their file may be rewritten.
+ * The file is written through a mapping rather than stdio, which would
+ * allocate its buffers while the track is changing.  A file left longer
+ * by an earlier store is harmless, as only the index says how many beats
+ * there are.
+ */
+
+int RezBeatCacheStore( RezBeatCache *cache, RezTrackKey key, const RezBeat *beats, unsigned long count )
+{
+	char path[ REZ_CACHE_PATH + 32 ];
+	RezCacheEntry *entry;
+	RezMapping file;
+
+	RezBeatCacheRelease( cache );
+	if( cache->header == NULL || count == 0 ) return 0;
+
+	RezMapLock( &cache->index );
+	entry = RezBeatCacheClaim( cache, key );
+	entry->beats = 0;
+	RezBeatCachePath( cache, key, path );
+	if( !RezMapFile( &file, path, count * sizeof( RezBeat ), 1 ) )
+	{
+		remove( path );
+		RezMapUnlock( &cache->index );
+		return 0;
+	}
+	memcpy( file.base, beats, count * sizeof( RezBeat ) );
+	RezUnmap( &file );
+
+	entry->beats = count;
+	entry->lastUsed = ++cache->header->clock;
+	RezMapUnlock( &cache->index );
+	return 1;
+}
+
+/*
+ * Fetch a track's mean band energies.  Returns how many frames they were
+ * averaged over, 0 if the track has no profile.
+ */
+
+unsigned long RezBeatCacheLoadProfile( RezBeatCache *cache, RezTrackKey key, float *profile )
+{
+	RezCacheEntry *entry;
+	unsigned long frames = 0;
+	int band;
+
+	if( cache->header == NULL ) return 0;
+	RezMapLock( &cache->index );
+	entry = RezBeatCacheFind( cache, key );
+	if( entry != NULL && entry->profileFrames != 0 )
+	{
+		for( band = 0; band < FREQUENCYBANDS; band++ ) profile[ band ] = entry->profile[ band ];
+		frames = entry->profileFrames;
+	}
+	RezMapUnlock( &cache->index );
+	return frames;
+}
+
+/*
+ * Fold another play's mean band energies into a track's profile, weighted
+ * by how many frames each covers, the profile's own weight capped at
+ * REZ_CACHE_PROFILEFRAMES.
+ */
+
+int RezBeatCacheStoreProfile( RezBeatCache *cache, RezTrackKey key, const float *profile, unsigned long frames )
+{
+	RezCacheEntry *entry;
+	unsigned long total;
+	int band;
+
+	if( cache->header == NULL || frames == 0 ) return 0;
+	RezMapLock( &cache->index );
+	entry = RezBeatCacheClaim( cache, key );
+
+	if( entry->profileFrames > REZ_CACHE_PROFILEFRAMES ) entry->profileFrames = REZ_CACHE_PROFILEFRAMES;
+	total = entry->profileFrames + frames;
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+		entry->profile[ band ] = ( entry->profile[ band ] * entry->profileFrames + profile[ band ] * frames ) / total;
+	entry->profileFrames = total > REZ_CACHE_PROFILEFRAMES ? REZ_CACHE_PROFILEFRAMES : total;
+	entry->lastUsed = ++cache->header->clock;
+	RezMapUnlock( &cache->index );
+	return 1;
+}
@@ -0,0 +1,104 @@
+/*
+ *  rezBeatCache.h
+ *  rezTunes
+ *
+ *  On-disk cache of the beats detected in each track, so a track that has
+ *  been played through once can drive the motor from its first frame the
+ *  next time round.
+ *
+ *  The cache is a directory holding one memory mapped index and one beat
+ *  map per track.  The index is a fixed table of REZ_CACHE_TRACKS slots;
+ *  when it is full the least recently played track is evicted.  Each slot
+ *  also keeps the track's long run mean energy per band, which is enough
+ *  to warm the detector up after a seek even when no beat map exists.
+ *
+ *  Every instance, in this process or another, maps the same index, so
+ *  each reads and changes it only while holding a lock on its file.
+ */
+
+#ifndef REZBEATCACHE_H_
+#define REZBEATCACHE_H_
+
+#include "rezMap.h"
+#include "rezDetector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * REZ_CACHE_TRACKS - Tracks the index has room for.
+ * REZ_CACHE_PROFILEFRAMES - Most frames a track's profile is counted as
+ *   averaged over, whatever it really was, about a play and a half of a
+ *   four minute track.  Another play of such a track then carries over
+ *   a third of the weight, so the profile follows a remaster or
+ *   re-encode within a few plays.
+ */
+
+#define REZ_CACHE_TRACKS 512
+#define REZ_CACHE_PROFILEFRAMES 16384
+#define REZ_CACHE_MAGIC 0x525a4249		/* 'RZBI' */
+#define REZ_CACHE_VERSION 2
+#define REZ_CACHE_PATH 1024
+
+#if defined( _MSC_VER )
+typedef unsigned __int64 RezTrackKey;
+#else
+typedef unsigned long long RezTrackKey;
+#endif
+
+/*
+ * A beat is packed into 32 bits: the playback position in milliseconds in
+ * the top 24, good for four and a half hours, and the motor speed it set
+ * in the bottom 8.
+ */
+
+typedef unsigned int RezBeat;
+
+#define REZ_BEAT( positionMS, speed ) ( ( RezBeat ) ( ( ( positionMS ) << 8 ) | ( ( speed ) & 0xff ) ) )
+#define REZ_BEAT_POSITION( beat ) ( ( beat ) >> 8 )
+#define REZ_BEAT_SPEED( beat ) ( ( unsigned char ) ( ( beat ) & 0xff ) )
+#define REZ_BEAT_MAX_POSITION 0xffffff
+
+struct RezCacheEntry {
+	RezTrackKey			key;
+	unsigned int		lastUsed;
+	unsigned int		beats;
+	unsigned int		profileFrames;
+	float				profile[ FREQUENCYBANDS ];
+};
+typedef struct RezCacheEntry RezCacheEntry;
+
+struct RezCacheHeader {
+	unsigned int		magic;
+	unsigned int		version;
+	unsigned int		capacity;
+	unsigned int		clock;
+};
+typedef struct RezCacheHeader RezCacheHeader;
+
+struct RezBeatCache {
+	char				directory[ REZ_CACHE_PATH ];
+	RezMapping			index;
+	RezCacheHeader		*header;
+	RezCacheEntry		*entries;
+	RezMapping			track;
+};
+typedef struct RezBeatCache RezBeatCache;
+
+extern RezTrackKey RezTrackKeyHash( RezTrackKey hash, const void *data, unsigned long length );
+
+extern int RezBeatCacheDefaultDirectory( char *directory, unsigned long size );
+extern int RezBeatCacheOpen( RezBeatCache *cache, const char *directory );
+extern void RezBeatCacheClose( RezBeatCache *cache );
+extern const RezBeat *RezBeatCacheLookup( RezBeatCache *cache, RezTrackKey key, unsigned long *count );
+extern void RezBeatCacheRelease( RezBeatCache *cache );
+extern int RezBeatCacheStore( RezBeatCache *cache, RezTrackKey key, const RezBeat *beats, unsigned long count );
+extern unsigned long RezBeatCacheLoadProfile( RezBeatCache *cache, RezTrackKey key, float *profile );
+extern int RezBeatCacheStoreProfile( RezBeatCache *cache, RezTrackKey key, const float *profile, unsigned long frames );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZBEATCACHE_H_ */
@@ -0,0 +1,132 @@
+/*
+ *  rezCalibration.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezCalibration.h"
+
+void RezCalibrationReset( RezCalibration *calibration )
+{
+	int speed;
+
+	memset( calibration, 0, sizeof( RezCalibration ) );
+	for( speed = 0; speed < 256; speed++ ) calibration->table[ speed ] = ( unsigned char ) speed;
+}
+
+/*
+ * Every speed from 1 up asks for an even share of the rotor's range,
+ * from the slowest reading that turned it to the fastest, and is sent as
+ * whatever speed the readings either side of that say will get it there.
+ * A motor's response only ever rises with speed, so a reading that dips
+ * is passed over rather than let the table run backwards.
+ */
+
+int RezCalibrationBuild( RezCalibration *calibration, const char *device )
+{
+	const unsigned char *response = calibration->response;
+	int step, first, level, top = 0, last = 0;
+
+	for( step = 0; step < REZ_CALIBRATION_STEPS; step++ )
+		if( response[ step ] > top ) top = response[ step ];
+	if( top < REZ_CALIBRATION_LEAST ) return 0;
+	for( first = 0; response[ first ] <= top * REZ_CALIBRATION_MOVING; first++ ) ;
+
+	calibration->table[ 0 ] = 0;
+	step = first;
+	for( level = 1; level < 256; level++ )
+	{
+		double want = response[ first ] + ( top - response[ first ] ) * ( level - 1 ) / 254.0;
+		double speed;
+		int sent;
+
+		while( step < REZ_CALIBRATION_STEPS - 1 && response[ step + 1 ] < want ) step++;
+		if( step < REZ_CALIBRATION_STEPS - 1 && want > response[ step ] )
+			speed = RezCalibrationSpeed( step ) + ( RezCalibrationSpeed( step + 1 ) - RezCalibrationSpeed( step ) ) *
+					( want - response[ step ] ) / ( response[ step + 1 ] - response[ step ] );
+		else
+			speed = RezCalibrationSpeed( step );
+
+		sent = ( int ) ( speed + 0.5 );
+		if( sent < last ) sent = last;
+		if( sent > 255 ) sent = 255;
+		calibration->table[ level ] = ( unsigned char ) sent;
+		last = sent;
+	}
+
+	calibration->felt = 0;
+	memset( calibration->device, 0, sizeof( calibration->device ) );
+	strncpy( calibration->device, device, REZ_CALIBRATION_NAME - 1 );
+	return 1;
+}
+
+/*
+ * With nothing read back, all that is known is where the motor starts to
+ * be felt, so every speed above that is taken to be felt in proportion.
+ */
+
+void RezCalibrationFelt( RezCalibration *calibration, const char *device, int felt )
+{
+	int level;
+
+	if( felt < 1 ) felt = 1;
+	if( felt > 255 ) felt = 255;
+	calibration->table[ 0 ] = 0;
+	for( level = 1; level < 256; level++ )
+		calibration->table[ level ] = ( unsigned char ) ( felt + ( 255 - felt ) * ( level - 1 ) / 254 );
+	calibration->felt = ( unsigned char ) felt;
+	memset( calibration->response, 0, sizeof( calibration->response ) );
+	memset( calibration->device, 0, sizeof( calibration->device ) );
+	strncpy( calibration->device, device, REZ_CALIBRATION_NAME - 1 );
+}
+
+void RezCalibrationStoreReset( RezCalibrationStore *store )
+{
+	memset( store, 0, sizeof( RezCalibrationStore ) );
+	store->magic = REZ_CALIBRATION_MAGIC;
+	store->version = REZ_CALIBRATION_VERSION;
+}
+
+/*
+ * An empty unit has no device, which no device's identity matches.
+ */
+
+static int RezCalibrationUnit( const RezCalibrationStore *store, const char *device )
+{
+	int unit;
+
+	if( store->magic != REZ_CALIBRATION_MAGIC || store->version != REZ_CALIBRATION_VERSION || *device == '\0' ) return -1;
+	for( unit = 0; unit < REZ_CALIBRATION_UNITS; unit++ )
+		if( store->unit[ unit ].device[ REZ_CALIBRATION_NAME - 1 ] == '\0' &&
+			strncmp( store->unit[ unit ].device, device, REZ_CALIBRATION_NAME - 1 ) == 0 )
+			return unit;
+	return -1;
+}
+
+const RezCalibration *RezCalibrationFind( const RezCalibrationStore *store, const char *device )
+{
+	int unit = RezCalibrationUnit( store, device );
+
+	return unit < 0 ? NULL : &store->unit[ unit ];
+}
+
+/*
+ * A unit with no calibration yet goes in the first empty place, or once
+ * there is none, in place of the one made longest ago.  made counts
+ * calibrations kept, so the oldest is the one with the least.
+ */
+
+void RezCalibrationKeep( RezCalibrationStore *store, const RezCalibration *calibration )
+{
+	int unit = RezCalibrationUnit( store, calibration->device ), oldest;
+
+	if( store->magic != REZ_CALIBRATION_MAGIC || store->version != REZ_CALIBRATION_VERSION ) RezCalibrationStoreReset( store );
+	if( unit < 0 )
+	{
+		for( oldest = unit = 0; unit < REZ_CALIBRATION_UNITS && store->unit[ unit ].device[ 0 ] != '\0'; unit++ )
+			if( store->unit[ unit ].made < store->unit[ oldest ].made ) oldest = unit;
+		if( unit == REZ_CALIBRATION_UNITS ) unit = oldest;
+	}
+	store->unit[ unit ] = *calibration;
+	store->unit[ unit ].made = ++store->made;
+}
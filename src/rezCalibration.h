@@ -0,0 +1,114 @@
+/*
+ *  rezCalibration.h
+ *  rezTunes
+ *
+ *  How one vibrator answers the speeds it is sent, and the table
+ *  that undoes it.  A speed of 0 to 255 means something different to
+ *  every motor, and the lowest speeds often do not turn one at all, so a
+ *  soft beat sent as it is may never be felt.  A calibration sweeps the
+ *  device from stopped to full speed, a step at a time, and reads how
+ *  fast the rotor settles at each.  The table built from that sends the
+ *  lowest speed that turns the rotor for a speed of 1, full speed for
+ *  255, and in between whatever speed makes the rotor answer in
+ *  proportion.  0 is always 0.
+ *
+ *  Only a device that can say how fast its rotor turns can be swept; see
+ *  rezDevice.h.  Anything else is calibrated with the help of whoever is
+ *  holding it: the device is run up from stopped a little at a time until
+ *  they say they feel it, and the table sends the speed they felt for 1,
+ *  full speed for 255, and spreads the rest evenly in between.  Until
+ *  then it keeps a table that passes speeds through as they are.
+ *
+ *  Motors vary from one unit to the next, even of the same kind, so a
+ *  calibration carries the identity of the unit it was made for (see
+ *  rezDevice.h) and is only used for that one.  A store keeps one for
+ *  each unit seen, up to REZ_CALIBRATION_UNITS; once it is full the unit
+ *  calibrated longest ago gives way.  The store uses fixed size fields
+ *  only, so it can be saved whole with the host's preferences and loaded
+ *  at startup, and a unit is not swept again once it has been.
+ *
+ *  Nothing in here depends on the iTunes headers.
+ */
+
+#ifndef REZCALIBRATION_H_
+#define REZCALIBRATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REZ_CALIBRATION_MAGIC 0x525a434c		/* 'RZCL' */
+#define REZ_CALIBRATION_VERSION 2
+
+/*
+ * REZ_CALIBRATION_STEPS - Speeds tried in a sweep, evenly from 0 to 255.
+ * REZ_CALIBRATION_SETTLEMS - How long each speed is held before the rotor
+ *   is read, several of the motor's spin up time constants.
+ * REZ_CALIBRATION_MOVING - The rotor counts as turning once it is over
+ *   this fraction of the fastest it went in the sweep.
+ * REZ_CALIBRATION_LEAST - A sweep whose fastest reading is under this
+ *   found no motor, and leaves the table as it was.
+ * REZ_CALIBRATION_NAME - Longest device identity kept, with its
+ *   terminator.
+ * REZ_CALIBRATION_UNITS - Most units a store keeps.
+ */
+
+#define REZ_CALIBRATION_STEPS 16
+#define REZ_CALIBRATION_SETTLEMS 250
+#define REZ_CALIBRATION_MOVING 0.05
+#define REZ_CALIBRATION_LEAST 16
+#define REZ_CALIBRATION_NAME 64
+#define REZ_CALIBRATION_UNITS 8
+
+struct RezCalibration {
+	char				device[ REZ_CALIBRATION_NAME ];
+	unsigned int		made;
+	unsigned char		felt;
+	unsigned char		response[ REZ_CALIBRATION_STEPS ];
+	unsigned char		table[ 256 ];
+};
+typedef struct RezCalibration RezCalibration;
+
+struct RezCalibrationStore {
+	unsigned int		magic;
+	unsigned int		version;
+	unsigned int		made;
+	RezCalibration		unit[ REZ_CALIBRATION_UNITS ];
+};
+typedef struct RezCalibrationStore RezCalibrationStore;
+
+/*
+ * RezCalibrationReset leaves a table that changes nothing, made for no
+ * device.
+ *
+ * RezCalibrationSpeed is the speed sent at step of a sweep.
+ *
+ * RezCalibrationBuild makes the table for device from the rotor speeds
+ * in response, one for each step, and returns 0 if they show no motor.
+ *
+ * RezCalibrationFelt makes the table for device from felt, the lowest
+ * speed the user could feel, and keeps felt with it.
+ *
+ * RezCalibrationStoreReset empties store.
+ *
+ * RezCalibrationFind is the calibration store keeps for device, or NULL
+ * if it has none, or is not a store this version made.
+ *
+ * RezCalibrationKeep puts calibration in store, in place of any it had
+ * for the same device.
+ */
+
+extern void RezCalibrationReset( RezCalibration *calibration );
+extern int RezCalibrationBuild( RezCalibration *calibration, const char *device );
+extern void RezCalibrationFelt( RezCalibration *calibration, const char *device, int felt );
+extern void RezCalibrationStoreReset( RezCalibrationStore *store );
+extern const RezCalibration *RezCalibrationFind( const RezCalibrationStore *store, const char *device );
+extern void RezCalibrationKeep( RezCalibrationStore *store, const RezCalibration *calibration );
+
+#define RezCalibrationSpeed( step ) ( ( step ) * 255 / ( REZ_CALIBRATION_STEPS - 1 ) )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZCALIBRATION_H_ */
@@ -0,0 +1,611 @@
+/*
+ *  rezDetector.c
+ *  rezTunes
+ *
+ *  Platform neutral parts of the beat detector.
+ */
+
+#include <math.h>
+#include "rezDetector.h"
+#include "rezInstrument.h"
+
+#if REZ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Band edges grow geometrically from 2 bins up to the full 512, so that
+ * the lowest band holds the bass bins and the top band covers the upper
+ * half of the spectrum.  Every band is at least one bin wide.
+ */
+
+void RezBandLayoutInit( RezBandLayout *layout )
+{
+	int bandindex;
+
+	layout->edge[ 0 ] = 0;
+	for( bandindex = 0; bandindex < FREQUENCYBANDS; bandindex++ )
+	{
+		int end = ( int ) ( powf( ( float ) REZ_SPECTRUM_ENTRIES, ( bandindex + 1 ) / ( float ) FREQUENCYBANDS ) + 0.5f );
+
+		if( end <= layout->edge[ bandindex ] ) end = layout->edge[ bandindex ] + 1;
+		if( end > REZ_SPECTRUM_ENTRIES ) end = REZ_SPECTRUM_ENTRIES;
+		layout->edge[ bandindex + 1 ] = end;
+	}
+	layout->edge[ FREQUENCYBANDS ] = REZ_SPECTRUM_ENTRIES;
+}
+
+/*
+ * Reduce both spectrum rows to per band sums of the left channel, the
+ * right channel and their absolute difference, all in one walk over the
+ * 2 x 512 bytes.  Mid and side fall out of those three sums for free.
+ *
+ * With SSE2 each 16 byte step is three PSADBW instructions: the sum of
+ * absolute differences against zero is a horizontal byte sum, and against
+ * the other row it is exactly the side magnitude.  Mono data is handled
+ * by passing the same row twice.
+ */
+
+void RezComputeBandEnergies( const RezBandLayout *layout, const unsigned char *left, const unsigned char *right, RezBandEnergies *out )
+{
+	int bandindex;
+
+	for( bandindex = 0; bandindex < FREQUENCYBANDS; bandindex++ )
+	{
+		int start = layout->edge[ bandindex ];
+		int end = layout->edge[ bandindex + 1 ];
+		int index = start;
+		unsigned long sumL = 0, sumR = 0, sumS = 0;
+		float scale;
+
+#if REZ_HAVE_SSE2
+		if( end - start >= 16 )
+		{
+			__m128i zero = _mm_setzero_si128();
+			__m128i accL = zero, accR = zero, accS = zero;
+
+			for( ; index + 16 <= end; index += 16 )
+			{
+				__m128i l = _mm_loadu_si128( ( const __m128i * ) ( left + index ) );
+				__m128i r = _mm_loadu_si128( ( const __m128i * ) ( right + index ) );
+
+				accL = _mm_add_epi64( accL, _mm_sad_epu8( l, zero ) );
+				accR = _mm_add_epi64( accR, _mm_sad_epu8( r, zero ) );
+				accS = _mm_add_epi64( accS, _mm_sad_epu8( l, r ) );
+			}
+			sumL = _mm_cvtsi128_si32( accL ) + _mm_cvtsi128_si32( _mm_srli_si128( accL, 8 ) );
+			sumR = _mm_cvtsi128_si32( accR ) + _mm_cvtsi128_si32( _mm_srli_si128( accR, 8 ) );
+			sumS = _mm_cvtsi128_si32( accS ) + _mm_cvtsi128_si32( _mm_srli_si128( accS, 8 ) );
+		}
+#endif
+		for( ; index < end; index++ )
+		{
+			int l = left[ index ], r = right[ index ];
+
+			sumL += l;
+			sumR += r;
+			sumS += ( l > r ) ? l - r : r - l;
+		}
+
+		scale = 1.0f / ( end - start );
+		out->energy[ REZ_INPUT_LEFT ][ bandindex ] = sumL * scale;
+		out->energy[ REZ_INPUT_RIGHT ][ bandindex ] = sumR * scale;
+		out->energy[ REZ_INPUT_MID ][ bandindex ] = ( sumL + sumR ) * 0.5f * scale;
+		out->energy[ REZ_INPUT_SIDE ][ bandindex ] = sumS * 0.5f * scale;
+	}
+}
+
+/*
+ * Each entry is the log of the middle of its slice of the mantissa.
+ */
+
+void RezLogTableInit( RezLogTable *table )
+{
+	int index;
+
+	for( index = 0; index < 256; index++ )
+		table->entry[ index ] = ( float ) ( REZ_LOG_DOUBLING * log( 1.0 + ( index + 0.5 ) / 256 ) / log( 2.0 ) );
+}
+
+/*
+ * Turn count energies into their logs, in place.  The table is applied
+ * to each band's mean rather than to each bin, so the reduction keeps its
+ * PSADBW sums and the log domain costs a lookup per band on top.
+ */
+
+void RezLogEnergies( const RezLogTable *table, float *energy, int count )
+{
+	int index;
+
+	for( index = 0; index < count; index++ )
+	{
+		union { unsigned int bits; float value; } mean;
+		float level;
+
+		mean.value = energy[ index ];
+		level = ( ( int ) ( ( mean.bits >> 23 ) & 0xff ) - 127 ) * ( float ) REZ_LOG_DOUBLING + table->entry[ ( mean.bits >> 15 ) & 0xff ];
+		energy[ index ] = level > 0 ? level : 0;
+	}
+}
+
+/*
+ * Horizons are given in milliseconds and converted to frames using the
+ * interval iTunes was asked to deliver data at.  Weights need not sum to
+ * one; RezHistoryCompare normalises them.
+ */
+
+void RezHistoryInit( RezHistory *history, int frameMS, const int *horizonMS, const float *weight, int horizons )
+{
+	int h;
+
+	if( horizons > REZ_MAX_HORIZONS ) horizons = REZ_MAX_HORIZONS;
+	if( frameMS < 1 ) frameMS = 1;
+
+	history->horizons = horizons;
+	history->focus = REZ_ALL_HORIZONS;
+	for( h = 0; h < horizons; h++ )
+	{
+		int length = ( horizonMS[ h ] + frameMS / 2 ) / frameMS;
+
+		if( length < 1 ) length = 1;
+		if( length > REZ_HISTORY_FRAMES - 1 ) length = REZ_HISTORY_FRAMES - 1;
+		history->length[ h ] = length;
+		history->weight[ h ] = weight[ h ];
+	}
+	RezHistoryReset( history );
+}
+
+void RezHistoryReset( RezHistory *history )
+{
+	int h, frame, band;
+
+	for( frame = 0; frame < REZ_HISTORY_FRAMES; frame++ )
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+			history->ring[ frame ][ band ] = 0;
+	for( h = 0; h < REZ_MAX_HORIZONS; h++ )
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+			history->sum[ h ][ band ] = 0;
+	history->head = 0;
+	history->written = 0;
+}
+
+/*
+ * Warm start: make the history look as if every frame it can hold had
+ * the given band energies, so comparisons are meaningful at once instead
+ * of after the longest horizon has filled.
+ */
+
+void RezHistoryFill( RezHistory *history, const float *energy )
+{
+	int h, frame, band;
+
+	for( frame = 0; frame < REZ_HISTORY_FRAMES; frame++ )
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+			history->ring[ frame ][ band ] = energy[ band ];
+	for( h = 0; h < history->horizons; h++ )
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+			history->sum[ h ][ band ] = energy[ band ] * history->length[ h ];
+	history->head = 0;
+	history->written = REZ_HISTORY_FRAMES;
+}
+
+/*
+ * Running float sums pick up rounding error, so each time the ring wraps
+ * the sums are rebuilt from the frames themselves.  That is a few hundred
+ * adds every few seconds, rather than drift that grows without bound.
+ */
+
+static void RezHistoryResync( RezHistory *history )
+{
+	int h, back, band;
+
+	for( h = 0; h < history->horizons; h++ )
+	{
+		float *sum = history->sum[ h ];
+
+		for( band = 0; band < FREQUENCYBANDS; band++ ) sum[ band ] = 0;
+		for( back = 1; back <= history->length[ h ]; back++ )
+		{
+			const float *frame = history->ring[ ( history->head - back ) & ( REZ_HISTORY_FRAMES - 1 ) ];
+
+			for( band = 0; band < FREQUENCYBANDS; band++ ) sum[ band ] += frame[ band ];
+		}
+	}
+}
+
+/*
+ * Store one frame of band energies.  Slots that have never been written
+ * are zero, so subtracting them while the history is still filling is
+ * harmless and needs no special case.
+ */
+
+void RezHistoryPush( RezHistory *history, const float *energy )
+{
+	int h, band;
+	float *slot = history->ring[ history->head ];
+
+	for( h = 0; h < history->horizons; h++ )
+	{
+		const float *expired = history->ring[ ( history->head - history->length[ h ] ) & ( REZ_HISTORY_FRAMES - 1 ) ];
+		float *sum = history->sum[ h ];
+
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+			sum[ band ] += energy[ band ] - expired[ band ];
+	}
+	for( band = 0; band < FREQUENCYBANDS; band++ ) slot[ band ] = energy[ band ];
+
+	history->head = ( history->head + 1 ) & ( REZ_HISTORY_FRAMES - 1 );
+	history->written++;
+	if( history->head == 0 ) RezHistoryResync( history );
+}
+
+float RezHistoryAverage( const RezHistory *history, int horizon, int band )
+{
+	unsigned long count = history->length[ horizon ];
+
+	if( history->written < count ) count = history->written;
+	if( count == 0 ) return 0;
+	return history->sum[ horizon ][ band ] / count;
+}
+
+/*
+ * Compare an instant energy against every horizon and blend the results
+ * by weight.  The ratio is the weighted mean of the per-horizon ratios,
+ * so a hit that only stands out against the short window still counts
+ * for something, and average is the matching weighted mean level.
+ * Before any history exists both come out as zero.  With a focus, that
+ * horizon is the only one compared against.
+ */
+
+void RezHistoryCompare( const RezHistory *history, const float *energy, float *average, float *ratio )
+{
+	int h, band, first = 0, last = history->horizons;
+	float total = 0;
+
+	if( history->focus != REZ_ALL_HORIZONS && history->focus < history->horizons )
+	{
+		first = history->focus;
+		last = first + 1;
+	}
+	for( h = first; h < last; h++ ) total += history->weight[ h ];
+	if( total <= 0 || history->written == 0 ) total = 0;
+	else total = 1.0f / total;
+
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+	{
+		float blendedAverage = 0, blendedRatio = 0;
+
+		for( h = first; h < last; h++ )
+		{
+			float mean = RezHistoryAverage( history, h, band );
+
+			blendedAverage += history->weight[ h ] * mean;
+			blendedRatio += history->weight[ h ] * energy[ band ] / ( mean > 0.001f ? mean : 0.001f );
+		}
+		average[ band ] = blendedAverage * total;
+		ratio[ band ] = blendedRatio * total;
+	}
+}
+
+/*
+ * The log domain's RezHistoryCompare.  A weighted mean of differences is
+ * the difference from the weighted mean, so only the average is blended
+ * and each horizon's weight and count fold into one factor.
+ */
+
+void RezHistoryDifference( const RezHistory *history, const float *energy, float *average, float *difference )
+{
+	int h, band, first = 0, last = history->horizons;
+	float total = 0, known, factor[ REZ_MAX_HORIZONS ];
+
+	if( history->focus != REZ_ALL_HORIZONS && history->focus < history->horizons )
+	{
+		first = history->focus;
+		last = first + 1;
+	}
+	for( h = first; h < last; h++ ) total += history->weight[ h ];
+	if( total <= 0 || history->written == 0 ) total = 0;
+	else total = 1.0f / total;
+	known = total > 0 ? 1.0f : 0.0f;
+
+	for( h = first; h < last; h++ )
+	{
+		unsigned long count = history->length[ h ];
+
+		if( history->written < count ) count = history->written;
+		factor[ h ] = count == 0 ? 0 : history->weight[ h ] * total / count;
+	}
+
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+	{
+		float blendedAverage = 0;
+
+		for( h = first; h < last; h++ ) blendedAverage += factor[ h ] * history->sum[ h ][ band ];
+		average[ band ] = blendedAverage;
+		difference[ band ] = ( energy[ band ] - blendedAverage ) * known;
+	}
+}
+
+/*
+ * Only frames that have been written are touched, so the ones still
+ * zero stay harmless to subtract.
+ */
+
+void RezHistoryRescale( RezHistory *history, float scale, float offset )
+{
+	int back, band, frames = REZ_HISTORY_FRAMES;
+
+	if( history->written < ( unsigned long ) frames ) frames = ( int ) history->written;
+	for( back = 1; back <= frames; back++ )
+	{
+		float *frame = history->ring[ ( history->head - back ) & ( REZ_HISTORY_FRAMES - 1 ) ];
+
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+		{
+			float energy = frame[ band ] * scale + offset;
+
+			frame[ band ] = energy > 0 ? energy : 0;
+		}
+	}
+	RezHistoryResync( history );
+}
+
+/*
+ * Work out the thresholds for the detector's domain and gain.  In the
+ * log domain ratios become differences of logs, and a gain becomes an
+ * offset.
+ */
+
+static float RezLogLevel( double level )
+{
+	return ( float ) ( REZ_LOG_DOUBLING * log( level ) / log( 2.0 ) );
+}
+
+static void RezDetectorThresholds( RezDetector *detector )
+{
+	if( detector->domain == REZ_DOMAIN_LOG )
+	{
+		detector->sensitivity = RezLogLevel( LOGSENSITIVITY );
+		detector->release = RezLogLevel( RELEASE );
+		detector->minPeak = 0;
+		detector->quietLevel = RezLogLevel( QUIETLEVEL ) + RezLogLevel( detector->gain );
+		if( detector->quietLevel < 0 ) detector->quietLevel = 0;
+	}
+	else
+	{
+		detector->sensitivity = ( float ) SENSITIVITY;
+		detector->release = ( float ) RELEASE;
+		detector->minPeak = ( float ) MINPEAK;
+		detector->quietLevel = 0;
+	}
+}
+
+void RezDetectorInit( RezDetector *detector )
+{
+	static const int horizonMS[ 3 ] = { SHORTRETAINMS, RETAINMS, LONGRETAINMS };
+	static const float horizonWeight[ 3 ] = { SHORTWEIGHT, RETAINWEIGHT, LONGWEIGHT };
+	int bandindex;
+
+	for( bandindex = 0; bandindex < FREQUENCYBANDS; bandindex++ )
+	{
+		detector->bandInput[ bandindex ] = DETECTORINPUT;
+		detector->energy[ bandindex ] = 0;
+		detector->average[ bandindex ] = 0;
+		detector->threshold[ bandindex ] = 0;
+		detector->ratio[ bandindex ] = 0;
+		detector->armed[ bandindex ] = 1;
+		detector->refractory[ bandindex ] = 0;
+		detector->weight[ bandindex ] = 1.0f - ( float ) FALLOFF / 255 * bandindex / ( FREQUENCYBANDS - 1 );
+	}
+	RezDetectorCurve( detector, MINSPEED, MAXSPEED, ( float ) SPEEDGAMMA );
+	RezLogTableInit( &detector->logTable );
+	detector->domain = DETECTORDOMAIN;
+	detector->gain = 1;
+	RezDetectorThresholds( detector );
+	detector->confidence = 0;
+	detector->refractoryFrames = ( REFRACTORYMS + RETAINMS / RETAINSAMPLES / 2 ) / ( RETAINMS / RETAINSAMPLES );
+	RezBandLayoutInit( &detector->layout );
+	RezHistoryInit( &detector->history, RETAINMS / RETAINSAMPLES, horizonMS, horizonWeight, 3 );
+	detector->beats = 0;
+	detector->motorSpeed = 0;
+	detector->now = NULL;
+	detector->historyTime = 0;
+}
+
+/*
+ * The normal memory is the middle of the three RezDetectorInit keeps.
+ */
+
+void RezDetectorFocus( RezDetector *detector, int focused )
+{
+	detector->history.focus = focused ? 1 : REZ_ALL_HORIZONS;
+}
+
+void RezDetectorDomain( RezDetector *detector, int domain )
+{
+	detector->domain = domain;
+	RezHistoryReset( &detector->history );
+	RezDetectorThresholds( detector );
+}
+
+/*
+ * Volume is never quite zero here, so that the log of it is finite and
+ * the history can be scaled back up again.  The gain is kept in the
+ * linear domain too, for if the domain changes, but changes nothing.
+ */
+
+void RezDetectorGain( RezDetector *detector, float gain )
+{
+	if( gain < 0.01f ) gain = 0.01f;
+	if( detector->domain == REZ_DOMAIN_LOG )
+		RezHistoryRescale( &detector->history, 1, RezLogLevel( gain / detector->gain ) );
+	detector->gain = gain;
+	RezDetectorThresholds( detector );
+}
+
+void RezDetectorCurve( RezDetector *detector, int minSpeed, int maxSpeed, float gamma )
+{
+	int step;
+
+	for( step = 0; step < REZ_CURVE_STEPS; step++ )
+		detector->curve[ step ] = ( unsigned char ) ( minSpeed + ( maxSpeed - minSpeed ) * powf( step / ( float ) ( REZ_CURVE_STEPS - 1 ), gamma ) + 0.5f );
+}
+
+/*
+ * Add up the votes of the bands in fired, which holds 1 for a band that
+ * fired and 0 otherwise, offset by one with a 0 either side so that every
+ * band has two neighbours.  With SSE2 four bands are voted at once.
+ */
+
+static float RezDetectorVote( const RezDetector *detector, const float *fired )
+{
+	const float *ratio = detector->ratio;
+	int bandindex = 0;
+	float votes = 0;
+
+#if REZ_HAVE_SSE2
+	if( FREQUENCYBANDS >= 4 )
+	{
+		__m128 scale = _mm_set1_ps( 1.0f / detector->sensitivity );
+		__m128 cap = _mm_set1_ps( ( float ) RATIOCAP );
+		__m128 one = _mm_set1_ps( 1.0f );
+		__m128 cooccurrence = _mm_set1_ps( ( float ) COOCCURRENCE );
+		__m128 acc = _mm_setzero_ps();
+		float lanes[ 4 ];
+
+		for( ; bandindex + 4 <= FREQUENCYBANDS; bandindex += 4 )
+		{
+			__m128 strength = _mm_min_ps( _mm_mul_ps( _mm_loadu_ps( ratio + bandindex ), scale ), cap );
+			__m128 neighbours = _mm_add_ps( _mm_loadu_ps( fired + bandindex ), _mm_loadu_ps( fired + bandindex + 2 ) );
+			__m128 vote = _mm_mul_ps( _mm_mul_ps( _mm_loadu_ps( fired + bandindex + 1 ), _mm_loadu_ps( detector->weight + bandindex ) ), strength );
+
+			acc = _mm_add_ps( acc, _mm_mul_ps( vote, _mm_add_ps( one, _mm_mul_ps( cooccurrence, neighbours ) ) ) );
+		}
+		_mm_storeu_ps( lanes, acc );
+		votes = lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ];
+	}
+#endif
+	for( ; bandindex < FREQUENCYBANDS; bandindex++ )
+	{
+		float strength = ratio[ bandindex ] * ( 1.0f / detector->sensitivity );
+
+		strength = strength < ( float ) RATIOCAP ? strength : ( float ) RATIOCAP;
+		votes += fired[ bandindex + 1 ] * detector->weight[ bandindex ] * strength *
+				 ( 1.0f + ( float ) COOCCURRENCE * ( fired[ bandindex ] + fired[ bandindex + 2 ] ) );
+	}
+	return votes;
+}
+
+/*
+ * This function should be called every RETAINMS / RETAINSAMPLES milliseconds
+ * with a new dump of processed spectrum data.  The spectrum is traversed in
+ * bands, and an average sonic energy is determined for the band.  Left, right,
+ * mid and side energies all come out of the same pass; bandInput selects which
+ * of them each band's detector listens to.  In the log domain the chosen
+ * energies are then looked up in the log table.
+ *
+ * This is compared with the short, normal and long historical records to
+ * detect if the criteria for a "beat" has been found.  A band that meets them
+ * only fires if its trigger is armed and out of its refractory period; firing
+ * disarms it until it falls back under RELEASE.  In the log domain the ratios
+ * are differences, and the thresholds they are held to are the logs of the
+ * linear ones.
+ *
+ * The bands that fire then vote on how sure the detector is of an onset,
+ * each by its weight, how strongly it fired and how many of its neighbours
+ * fired with it, and the confidence sets the motor speed through the speed
+ * curve.  If no beat is found, the motor speed decays.  Returns non-zero
+ * if a beat set the motor speed.
+ */
+
+int RezDetectorProcess( RezDetector *detector, const unsigned char *left, const unsigned char *right )
+{
+	float *ratio = detector->ratio;
+	float fired[ FREQUENCYBANDS + 2 ];
+	float votes, thresholdScale, thresholdOffset;
+	RezTime historyStarted = 0;
+	int	bandindex;
+	REZ_PROBE( stage )
+
+	REZ_PROBE_START( stage );
+	RezComputeBandEnergies( &detector->layout, left, right, &detector->bands );
+
+	/*
+	 * "Instant" energy, from whichever input each band listens to.
+	 */
+	for( bandindex = 0; bandindex < FREQUENCYBANDS; bandindex++ )
+		detector->energy[ bandindex ] = detector->bands.energy[ detector->bandInput[ bandindex ] ][ bandindex ];
+	if( detector->domain == REZ_DOMAIN_LOG ) RezLogEnergies( &detector->logTable, detector->energy, FREQUENCYBANDS );
+
+	REZ_PROBE_LAP( stage, REZ_PROBE_BANDS );
+
+	/*
+	 * "Historical" energy, blended across every memory.
+	 */
+	if( detector->now != NULL ) historyStarted = detector->now();
+	if( detector->domain == REZ_DOMAIN_LOG )
+	{
+		RezHistoryDifference( &detector->history, detector->energy, detector->average, ratio );
+		thresholdScale = 1;
+		thresholdOffset = detector->sensitivity;
+	}
+	else
+	{
+		RezHistoryCompare( &detector->history, detector->energy, detector->average, ratio );
+		thresholdScale = detector->sensitivity;
+		thresholdOffset = 0;
+	}
+
+	/*
+	 * Storage of the "Instant" record in the history buffer.  Nothing
+	 * below looks at the history again, so it goes in now and the
+	 * history's time is taken in one piece.
+	 */
+	RezHistoryPush( &detector->history, detector->energy );
+	if( detector->now != NULL ) detector->historyTime = detector->now() - historyStarted;
+	REZ_PROBE_LAP( stage, REZ_PROBE_HISTORY );
+
+	/*
+	 * Comparisons.  Every band that fires is kept for the visualiser, and
+	 * votes.  Each band's trigger is stepped with comparisons taken as 0
+	 * or 1 and masks made from them, so there is no branch to mispredict
+	 * however the bands come and go.
+	 */
+	detector->beats = 0;
+	fired[ 0 ] = fired[ FREQUENCYBANDS + 1 ] = 0;
+	for( bandindex = 0; bandindex < FREQUENCYBANDS; bandindex++ )
+	{
+		float average = detector->average[ bandindex ];
+		float energy = detector->energy[ bandindex ];
+		float threshold = average * thresholdScale + thresholdOffset;
+		int refractory = detector->refractory[ bandindex ];
+		int fire;
+
+		threshold = threshold > average + detector->minPeak ? threshold : average + detector->minPeak;
+		threshold = threshold > detector->quietLevel ? threshold : detector->quietLevel;
+		detector->threshold[ bandindex ] = threshold;
+
+		fire = ( energy > average + detector->minPeak ) & ( energy > detector->quietLevel ) & ( ratio[ bandindex ] > detector->sensitivity ) &
+			   detector->armed[ bandindex ] & ( refractory == 0 );
+		detector->armed[ bandindex ] = ( detector->armed[ bandindex ] | ( ratio[ bandindex ] < detector->release ) ) & ( fire ^ 1 );
+		detector->refractory[ bandindex ] = ( -fire & detector->refractoryFrames ) | ( ( fire - 1 ) & ( refractory - ( refractory > 0 ) ) );
+		detector->beats |= ( unsigned int ) fire << bandindex;
+		fired[ bandindex + 1 ] = ( float ) fire;
+	}
+
+	votes = RezDetectorVote( detector, fired );
+	detector->confidence = votes < ( float ) CERTAINVOTES ? votes / ( float ) CERTAINVOTES : 1.0f;
+
+	/*
+	 * Decay.
+	 */
+	if( detector->beats != 0 )
+		detector->motorSpeed = detector->curve[ ( int ) ( detector->confidence * ( REZ_CURVE_STEPS - 1 ) + 0.5f ) ];
+	else
+	{
+		if( detector->motorSpeed <= DECAY ) detector->motorSpeed = 0;
+		else detector->motorSpeed -= DECAY;	
+	}
+	REZ_PROBE_STOP( stage, REZ_PROBE_DECISION );
+	return detector->beats != 0;
+}
@@ -0,0 +1,321 @@
+/*
+ *  rezDetector.h
+ *  rezTunes
+ *
+ *  Platform neutral parts of the beat detector.  Nothing in here may
+ *  depend on the iTunes or trancevibe headers, so that the same code
+ *  can be compiled anywhere a C compiler is available.
+ */
+
+#ifndef REZDETECTOR_H_
+#define REZDETECTOR_H_
+
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SSE2 is used where the target guarantees it.  Everything else, including
+ * the PPC half of the universal build, takes the scalar paths.
+ */
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define REZ_HAVE_SSE2 1
+#else
+#define REZ_HAVE_SSE2 0
+#endif
+
+/*
+ *  REZ_SPECTRUM_ENTRIES - Bins per spectrum row, as delivered by iTunes.
+ *
+ *  FREQUENCYBANDS - The spectrum is divided up into this many channels.
+ *    Band edges grow geometrically, so each band spans twice as many
+ *    bins as the one below it.
+ */
+
+#define REZ_SPECTRUM_ENTRIES 512
+#define FREQUENCYBANDS 9
+
+/*
+ * Parameters of the beat detection code.
+ *   RETAINMS - Length of the audio "memory" in milliseconds.
+ *   RETAINSAMPLES - How many samples should be taken during this time.
+ *   SHORTRETAINMS, LONGRETAINMS - A shorter memory that follows fast
+ *     hi-hats and a longer one that follows slow kick patterns.  All
+ *     three are kept at once, at no extra cost per frame beyond a sum.
+ *   SHORTWEIGHT, RETAINWEIGHT, LONGWEIGHT - How much each memory counts
+ *     when deciding on a beat.  Set one to 0 to ignore that memory.
+ *
+ *   SENSITIVITY - To make "beat", a signal must be this many times over 
+ *     the retained average in it's subband.
+ *   MINPEAK - It must also be MINPEAK greater than the local retained
+ *     average.
+ *   RELEASE - Once a band has fired it must fall back under this many
+ *     times its retained average before it can fire again, so that one
+ *     long transient makes one beat rather than a run of them.
+ *   REFRACTORYMS - And at least this long must have passed since it
+ *     fired.
+ *
+ *  DETECTORINPUT - Which band energy the detector listens to, one of the
+ *    REZ_INPUT_ values below.  MID is the classic mono fold; LEFT, RIGHT
+ *    or SIDE pick out hard-panned material.
+ *
+ *  DETECTORDOMAIN - Whether band energies are the mean magnitude of
+ *    their bins or the logarithm of that mean, one of the
+ *    REZ_DOMAIN_ values below.  In the log domain a quiet master and a
+ *    loud one make the same beats.
+ *  LOGSENSITIVITY - SENSITIVITY in the log domain.  The average there is
+ *    of logs, which sits under the plain average, so a beat must stand
+ *    further over it to be as sure.
+ *  QUIETLEVEL - MINPEAK is a fixed level over the average, so a quiet
+ *    master has to work harder to clear it than a loud one.  The log
+ *    domain does without it; there a band need only be louder than this
+ *    magnitude, at full volume, to make a beat at all.
+ *
+ *  DECAY - The speed at which the detector's own motor speed winds down
+ *    each frame.  The motor itself winds down by the envelope in
+ *    rezEnvelope.h.
+ *
+ *  Every band that fires votes for an onset, and the votes add up to a
+ *  confidence between 0 and 1 that sets the motor speed.
+ *   FALLOFF - Beats in higher bands will produce slower vibrations, how
+ *     much slower depends on this variable.  A band's vote is weighted
+ *     from 1 in the lowest band down to 1 - FALLOFF / 255 in the highest.
+ *   RATIOCAP - A vote also grows with how far over SENSITIVITY the band
+ *     was, up to this many times, so one freak band cannot decide alone.
+ *   COOCCURRENCE - Each neighbouring band that fired as well adds this
+ *     much again to a band's vote, so an onset spread across the spectrum
+ *     counts for more than a lone spike.
+ *   CERTAINVOTES - Votes that make a confidence of 1.
+ *   MINSPEED, MAXSPEED, SPEEDGAMMA - The speed curve: a confidence c
+ *     runs the motor at MINSPEED + ( MAXSPEED - MINSPEED ) * c ^ SPEEDGAMMA.
+ *     Under 1 favours speed, over 1 holds it back for the clearest onsets.
+ */
+
+#define RETAINSAMPLES 20
+#define RETAINMS 500
+#define SHORTRETAINMS 100
+#define LONGRETAINMS 2000
+#define SHORTWEIGHT 1.0
+#define RETAINWEIGHT 2.0
+#define LONGWEIGHT 1.0
+#define SENSITIVITY 1.8
+#define MINPEAK 1.5
+#define RELEASE 1.2
+#define REFRACTORYMS 100
+#define DETECTORINPUT REZ_INPUT_MID
+#define DETECTORDOMAIN REZ_DOMAIN_LINEAR
+#define LOGSENSITIVITY 2.2
+#define QUIETLEVEL 2
+#define DECAY 10
+#define FALLOFF 90
+#define RATIOCAP 2.0
+#define COOCCURRENCE 0.5
+#define CERTAINVOTES 2.0
+#define MINSPEED 128
+#define MAXSPEED 255
+#define SPEEDGAMMA 0.5
+
+/*
+ * REZ_CURVE_STEPS - Entries in a detector's speed curve, indexed by
+ *   confidence.
+ * REZ_LOG_DOUBLING - Log domain units per doubling of a band's magnitude,
+ *   chosen so that magnitudes of 0 to 255 come out as 0 to 255 as well.
+ */
+
+#define REZ_CURVE_STEPS 256
+#define REZ_LOG_DOUBLING ( 255.0 / 8 )
+
+/*
+ * Every band is reduced to several energies in the same pass over the
+ * spectrum rows.  Each of these is a separate input the detector can be
+ * routed to, per band, without touching the spectrum again.
+ *
+ *   REZ_INPUT_MID   - ( L + R ) / 2, the original mono fold.
+ *   REZ_INPUT_LEFT  - Left channel only.
+ *   REZ_INPUT_RIGHT - Right channel only.
+ *   REZ_INPUT_SIDE  - | L - R | / 2, energy that is panned away from centre.
+ */
+
+enum {
+	REZ_INPUT_MID = 0,
+	REZ_INPUT_LEFT,
+	REZ_INPUT_RIGHT,
+	REZ_INPUT_SIDE,
+	REZ_INPUTS
+};
+
+struct RezBandLayout {
+	int					edge[ FREQUENCYBANDS + 1 ];
+};
+typedef struct RezBandLayout RezBandLayout;
+
+/*
+ * The domain band energies are measured in.
+ *
+ *   REZ_DOMAIN_LINEAR - The mean magnitude of a band's bins, and a beat
+ *     is a ratio over the band's average.
+ *   REZ_DOMAIN_LOG - The logarithm of that, so a ratio over the average
+ *     is a difference from it.  A change of gain adds the same amount to
+ *     every energy, which the differences do not see.
+ *
+ * Logarithms come from a table over the top 8 bits of a float's mantissa,
+ * with the exponent giving the whole doublings, in units of
+ * REZ_LOG_DOUBLING.  Anything under a magnitude of 1 is taken as 1, so
+ * silence is 0 as it is in the linear domain.
+ */
+
+enum {
+	REZ_DOMAIN_LINEAR = 0,
+	REZ_DOMAIN_LOG
+};
+
+struct RezLogTable {
+	float				entry[ 256 ];
+};
+typedef struct RezLogTable RezLogTable;
+
+struct RezBandEnergies {
+	float				energy[ REZ_INPUTS ][ FREQUENCYBANDS ];
+};
+typedef struct RezBandEnergies RezBandEnergies;
+
+/*
+ * Band energy history, kept at several horizons at once.
+ *
+ *   REZ_MAX_HORIZONS - Most history windows a detector may keep.
+ *   REZ_HISTORY_FRAMES - Ring length in frames, a power of two that must
+ *     cover the longest horizon.  At 25ms a frame this is 3.2 seconds.
+ *
+ * All horizons share one ring of frames, each frame holding every band.
+ * Each horizon keeps a running sum that gains the newest frame and loses
+ * the one that just fell out of its window, so every extra horizon costs
+ * one add and one subtract per band per frame.
+ *
+ * Comparing against a horizon costs a divide per band, so a history can
+ * be told to compare against one horizon only, its focus, while still
+ * keeping every sum up to date for when it is told to compare against
+ * them all again.  REZ_ALL_HORIZONS as the focus means no focus.
+ * RezHistoryDifference is the log domain's comparison, a subtraction per
+ * band and no divide beyond one per horizon.
+ *
+ * RezHistoryRescale multiplies every frame kept by scale and adds offset,
+ * to follow a change of gain.  No energy is under 0 in either domain, so
+ * neither is anything it leaves.
+ */
+
+#define REZ_MAX_HORIZONS 4
+#define REZ_HISTORY_FRAMES 128
+#define REZ_ALL_HORIZONS -1
+
+struct RezHistory {
+	float				ring[ REZ_HISTORY_FRAMES ][ FREQUENCYBANDS ];
+	float				sum[ REZ_MAX_HORIZONS ][ FREQUENCYBANDS ];
+	float				weight[ REZ_MAX_HORIZONS ];
+	int					length[ REZ_MAX_HORIZONS ];
+	int					horizons;
+	int					focus;
+	int					head;
+	unsigned long		written;
+};
+typedef struct RezHistory RezHistory;
+
+/*
+ * A whole detector: the band split, the history and the decision made
+ * over them.  The plugin runs one on the rows iTunes delivers, offline
+ * analysis runs another on rows computed from decoded audio, and both
+ * come to the same decisions given the same rows.
+ *
+ * energy, average, threshold, ratio and beats describe the last frame,
+ * for the visualiser and for telemetry.  armed and refractory are each
+ * band's trigger: a band can only fire while it is armed and its
+ * refractory count of frames has run out.  confidence is the last
+ * frame's onset confidence, 0 when nothing fired, and curve the table
+ * that turns it into a speed.  motorSpeed is the speed the detector would
+ * run the motor at; whoever drives the motor is free to follow something
+ * else.
+ *
+ * RezDetectorFocus( detector, focused ) has the detector judge beats
+ * against the normal memory alone while focused is non-zero, and against
+ * all three again once it is zero.
+ *
+ * now is NULL unless whoever runs the detector wants to know what the
+ * memories cost, when it is set to a clock such as RezTimeNow and
+ * historyTime is how long the last frame spent judging against them and
+ * remembering it.  The detector itself needs no clock.
+ *
+ * RezDetectorCurve( detector, minSpeed, maxSpeed, gamma ) replaces the
+ * speed curve RezDetectorInit made from MINSPEED, MAXSPEED and
+ * SPEEDGAMMA.
+ *
+ * domain is the REZ_DOMAIN_ the detector measures in, DETECTORDOMAIN
+ * unless RezDetectorDomain( detector, domain ) has changed it, which
+ * forgets the history.  gain is the playback volume as a fraction of
+ * full volume, 1 unless RezDetectorGain( detector, gain ) has changed
+ * it.  Only the log domain uses it: there a new gain is applied to the
+ * history already kept, so nothing has to be learned again, and moves
+ * quietLevel, which never goes under 0 so silence cannot make a beat.
+ * The linear domain makes the same decisions whatever the gain, as it
+ * always has.  sensitivity, release, minPeak and quietLevel are the
+ * thresholds for the domain and gain: what ratio must be over to fire
+ * and under to re-arm, how far over its average and over what level a
+ * band's energy must be.
+ */
+
+struct RezDetector {
+	RezBandLayout		layout;
+	RezHistory			history;
+	RezBandEnergies		bands;
+	RezLogTable			logTable;
+	unsigned char		bandInput[ FREQUENCYBANDS ];
+	int					domain;
+	float				gain;
+	float				sensitivity;
+	float				release;
+	float				minPeak;
+	float				quietLevel;
+	float				energy[ FREQUENCYBANDS ];
+	float				average[ FREQUENCYBANDS ];
+	float				threshold[ FREQUENCYBANDS ];
+	float				ratio[ FREQUENCYBANDS ];
+	int					armed[ FREQUENCYBANDS ];
+	int					refractory[ FREQUENCYBANDS ];
+	int					refractoryFrames;
+	float				weight[ FREQUENCYBANDS ];
+	unsigned char		curve[ REZ_CURVE_STEPS ];
+	float				confidence;
+	unsigned int		beats;
+	unsigned char		motorSpeed;
+	RezTime				( *now )( void );
+	RezTime				historyTime;
+};
+typedef struct RezDetector RezDetector;
+
+extern void RezBandLayoutInit( RezBandLayout *layout );
+extern void RezComputeBandEnergies( const RezBandLayout *layout, const unsigned char *left, const unsigned char *right, RezBandEnergies *out );
+extern void RezLogTableInit( RezLogTable *table );
+extern void RezLogEnergies( const RezLogTable *table, float *energy, int count );
+
+extern void RezHistoryInit( RezHistory *history, int frameMS, const int *horizonMS, const float *weight, int horizons );
+extern void RezHistoryReset( RezHistory *history );
+extern void RezHistoryFill( RezHistory *history, const float *energy );
+extern void RezHistoryPush( RezHistory *history, const float *energy );
+extern float RezHistoryAverage( const RezHistory *history, int horizon, int band );
+extern void RezHistoryCompare( const RezHistory *history, const float *energy, float *average, float *ratio );
+extern void RezHistoryDifference( const RezHistory *history, const float *energy, float *average, float *difference );
+extern void RezHistoryRescale( RezHistory *history, float scale, float offset );
+
+extern void RezDetectorInit( RezDetector *detector );
+extern void RezDetectorFocus( RezDetector *detector, int focused );
+extern void RezDetectorCurve( RezDetector *detector, int minSpeed, int maxSpeed, float gamma );
+extern void RezDetectorDomain( RezDetector *detector, int domain );
+extern void RezDetectorGain( RezDetector *detector, float gain );
+extern int RezDetectorProcess( RezDetector *detector, const unsigned char *left, const unsigned char *right );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZDETECTOR_H_ */
@@ -0,0 +1,164 @@
+/*
+ *  rezDevice.c
+ *  rezTunes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <usb.h>
+#include "rezDevice.h"
+#include "rezThread.h"
+
+/*
+ * TIMEOUTMS - How long libtrancevibe may wait on a USB write.
+ */
+
+#define TIMEOUTMS 10
+
+/*
+ * libtrancevibe's handle is libusb's, which can say which unit it is.
+ * The lengths printed are held down so the identity always fits.
+ */
+
+static int RezTrancevibeOpen( RezDevice *device )
+{
+	struct usb_device *usb;
+	char serial[ REZ_DEVICE_IDENTITY ];
+
+	if( trancevibe_open( &device->tv, 0 ) < 0 ) return 0;
+	usb = usb_device( device->tv );
+	if( usb != NULL && usb->descriptor.iSerialNumber != 0 &&
+		usb_get_string_simple( device->tv, usb->descriptor.iSerialNumber, serial, sizeof( serial ) ) > 0 )
+		sprintf( device->identity, "trancevibe %.40s", serial );
+	else if( usb != NULL && usb->bus != NULL )
+		sprintf( device->identity, "trancevibe at %.20s/%.20s", usb->bus->dirname, usb->filename );
+	else
+		strcpy( device->identity, "trancevibe" );
+	return 1;
+}
+
+static int RezTrancevibeSetSpeed( RezDevice *device, int speed )
+{
+	return trancevibe_set_speed( device->tv, ( unsigned char ) speed, TIMEOUTMS ) >= 0;
+}
+
+static void RezTrancevibeClose( RezDevice *device )
+{
+	trancevibe_close( device->tv );
+}
+
+static const RezDeviceOps trancevibeOps = {
+	"trancevibe", RezTrancevibeOpen, RezTrancevibeSetSpeed, NULL, RezTrancevibeClose
+};
+
+/*
+ * The fake's jitter comes from its own generator, so one run's delays do
+ * not depend on who else calls rand.
+ */
+
+static void RezFakeDelay( RezDevice *device, int ms )
+{
+	if( device->jitterMS > 0 )
+	{
+		device->seed = device->seed * 1103515245 + 12345;
+		ms += ( int ) ( ( device->seed >> 16 ) % ( unsigned int ) ( device->jitterMS + 1 ) );
+	}
+	if( ms > 0 ) RezThreadSleep( ms );
+}
+
+static int RezFakeOpen( RezDevice *device )
+{
+	const char *trace = getenv( REZ_FAKE_TRACE );
+
+	if( device->openMS > 0 ) RezThreadSleep( device->openMS );
+	if( trace != NULL && *trace != '\0' ) device->trace = fopen( trace, "w" );
+	strcpy( device->identity, "fake" );
+	device->opened = RezTimeNow();
+	return 1;
+}
+
+/*
+ * The write's own delay is the transfer time, so the model motor takes
+ * the speed the moment the write returns.
+ */
+
+static int RezFakeSetSpeed( RezDevice *device, int speed )
+{
+	double nowMS;
+
+	if( device->unplug > 0 && device->writes >= device->unplug ) return 0;
+	RezFakeDelay( device, device->writeMS );
+	nowMS = ( RezTimeNow() - device->opened ) / 1000000.0;
+	RezMotorCommand( &device->motor, nowMS, speed );
+	RezMotorAdvance( &device->motor, nowMS );
+	if( device->trace != NULL ) fprintf( device->trace, "%.3f\t%d\t%.1f\n", nowMS, speed, device->motor.rotor );
+	device->speed = speed;
+	device->writes++;
+	return 1;
+}
+
+static int RezFakeResponse( RezDevice *device )
+{
+	return ( int ) ( RezMotorAdvance( &device->motor, ( RezTimeNow() - device->opened ) / 1000000.0 ) + 0.5 );
+}
+
+static void RezFakeClose( RezDevice *device )
+{
+	if( device->trace != NULL ) fclose( device->trace );
+	device->trace = NULL;
+}
+
+static const RezDeviceOps fakeOps = {
+	"fake", RezFakeOpen, RezFakeSetSpeed, RezFakeResponse, RezFakeClose
+};
+
+/*
+ * Read "write[,jitter[,open[,spinup[,spindown[,unplug[,stall]]]]]]" from
+ * the environment.
+ * Returns 0 if the fake was not asked for.
+ */
+
+static int RezFakeConfigure( RezDevice *device )
+{
+	const char *setting = getenv( REZ_FAKE_DEVICE );
+	int spinUpMS = REZ_MOTOR_SPINUPMS, spinDownMS = REZ_MOTOR_SPINDOWNMS, stall = 0;
+	char *next;
+
+	if( setting == NULL || *setting == '\0' ) return 0;
+	device->writeMS = ( int ) strtol( setting, &next, 10 );
+	if( *next == ',' ) device->jitterMS = ( int ) strtol( next + 1, &next, 10 );
+	if( *next == ',' ) device->openMS = ( int ) strtol( next + 1, &next, 10 );
+	if( *next == ',' ) spinUpMS = ( int ) strtol( next + 1, &next, 10 );
+	if( *next == ',' ) spinDownMS = ( int ) strtol( next + 1, &next, 10 );
+	if( *next == ',' ) device->unplug = strtoul( next + 1, &next, 10 );
+	if( *next == ',' ) stall = ( int ) strtol( next + 1, &next, 10 );
+	device->seed = 1;
+	RezMotorInit( &device->motor, 0, 0, spinUpMS, spinDownMS );
+	device->motor.stall = stall;
+	return 1;
+}
+
+int RezDeviceOpen( RezDevice *device )
+{
+	memset( device, 0, sizeof( RezDevice ) );
+	device->ops = RezFakeConfigure( device ) ? &fakeOps : &trancevibeOps;
+	if( device->ops->open( device ) ) return 1;
+	device->ops = NULL;
+	return 0;
+}
+
+int RezDeviceSetSpeed( RezDevice *device, int speed )
+{
+	return device->ops->setSpeed( device, speed );
+}
+
+int RezDeviceResponse( RezDevice *device )
+{
+	return device->ops->response != NULL ? device->ops->response( device ) : -1;
+}
+
+void RezDeviceClose( RezDevice *device )
+{
+	if( device->ops != NULL ) device->ops->close( device );
+	device->ops = NULL;
+}
@@ -0,0 +1,106 @@
+/*
+ *  rezDevice.h
+ *  rezTunes
+ *
+ *  The vibrator, behind a small table of operations so that something
+ *  other than real hardware can stand in for it.  The backends are:
+ *
+ *    trancevibe - the first unit libtrancevibe finds
+ *    fake       - no hardware at all; every operation just takes as long
+ *      as it is told to, and a model motor (see rezMotor.h) is driven by
+ *      the speeds, so the whole path to the motor can be timed and tested
+ *      on a desk with nothing plugged in
+ *
+ *  The fake is chosen by setting REZ_FAKE_DEVICE in the environment to
+ *  "write[,jitter[,open[,spinup[,spindown[,unplug[,stall]]]]]]", the
+ *  first five a number of milliseconds: how long a speed takes to write,
+ *  how much longer at random it may take, how long opening takes and the
+ *  motor's time constants.  If unplug is given, the fake acts pulled out
+ *  after that many writes, failing every write until it is opened again.
+ *  stall is the motor's stall speed, under which it does not turn.  "0"
+ *  gives a device that costs nothing.  If REZ_FAKE_TRACE names a file, a
+ *  line is written there for every speed the fake takes: the time it
+ *  landed in milliseconds since the device was opened, the speed and the
+ *  model rotor's speed at that moment.
+ *
+ *  Each open device has an identity, which tells one unit from another
+ *  where it can: for a TrancEvibrator its USB serial number if it has
+ *  one, and if not where it is plugged in, so a unit without a serial
+ *  number is only known again on the same port.  The fake is always
+ *  "fake".
+ *
+ *  Only the fake can say how fast its rotor is turning, so only the fake
+ *  can be swept (see rezCalibration.h).  A TrancEvibrator takes speeds
+ *  and gives nothing back, so it is calibrated by hand.
+ */
+
+#ifndef REZDEVICE_H_
+#define REZDEVICE_H_
+
+#include <stdio.h>
+#include "trancevibe.h"
+#include "rezMotor.h"
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REZ_FAKE_DEVICE "REZ_FAKE_DEVICE"
+#define REZ_FAKE_TRACE "REZ_FAKE_TRACE"
+
+/*
+ * REZ_DEVICE_IDENTITY - Longest identity, with its terminator.
+ */
+
+#define REZ_DEVICE_IDENTITY 64
+
+typedef struct RezDevice RezDevice;
+
+struct RezDeviceOps {
+	const char			*name;
+	int					( *open )( RezDevice *device );
+	int					( *setSpeed )( RezDevice *device, int speed );
+	int					( *response )( RezDevice *device );
+	void				( *close )( RezDevice *device );
+};
+typedef struct RezDeviceOps RezDeviceOps;
+
+struct RezDevice {
+	const RezDeviceOps	*ops;
+	trancevibe			tv;
+	char				identity[ REZ_DEVICE_IDENTITY ];
+
+	/* Fake only */
+	int					openMS;
+	int					writeMS;
+	int					jitterMS;
+	unsigned int		seed;
+	int					speed;
+	unsigned long		writes;
+	unsigned long		unplug;
+	RezTime				opened;
+	RezMotor			motor;
+	FILE				*trace;
+};
+
+/*
+ * RezDeviceOpen picks a backend and opens it, returning 0 if there is no
+ * device.  Opening may mean going through the USB bus, which is slow.  RezDeviceSetSpeed returns 0 if the device would not take the
+ * speed.  Both block for as long as the device takes, so only call them
+ * from a thread that can afford to wait.
+ *
+ * RezDeviceResponse is how fast the rotor is turning, from 0 to 255, or
+ * -1 if the device cannot tell.
+ */
+
+extern int RezDeviceOpen( RezDevice *device );
+extern int RezDeviceSetSpeed( RezDevice *device, int speed );
+extern int RezDeviceResponse( RezDevice *device );
+extern void RezDeviceClose( RezDevice *device );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZDEVICE_H_ */
@@ -0,0 +1,121 @@
+/*
+ *  rezEnvelope.c
+ *  rezTunes
+ */
+
+#include <math.h>
+#include <string.h>
+#include "rezEnvelope.h"
+
+/*
+ * STEEPNESS - How many time constants an exponential stage spans.  The
+ *   curve is stretched to arrive exactly at the end of the stage.
+ */
+
+#define STEEPNESS 4.0
+
+/*
+ * Fill in a stage's table and return how many ticks it has.  Entry t is
+ * the fraction covered t + lead ticks in: an attack arrives in its last
+ * tick, a decay starts from the top in its first.  A stage shorter than a
+ * tick has none and happens at once.
+ */
+
+static int RezEnvelopeTable( unsigned short *table, const RezEnvelopeStage *stage, int lead )
+{
+	int ticks = ( stage->ms + ENVELOPETICKMS / 2 ) / ENVELOPETICKMS, t;
+
+	if( ticks > REZ_ENVELOPE_TICKS ) ticks = REZ_ENVELOPE_TICKS;
+	for( t = 0; t < ticks; t++ )
+	{
+		double x = ( t + lead ) / ( double ) ticks, y;
+
+		if( stage->shape == REZ_SHAPE_EXPONENTIAL )
+			y = ( 1 - exp( -STEEPNESS * x ) ) / ( 1 - exp( -STEEPNESS ) );
+		else if( stage->shape == REZ_SHAPE_CUSTOM && stage->table != NULL && stage->length > 0 )
+		{
+			double at = x * ( stage->length - 1 );
+			int i = ( int ) at;
+
+			if( i >= stage->length - 1 ) y = stage->table[ stage->length - 1 ] / 255.0;
+			else y = ( stage->table[ i ] + ( at - i ) * ( stage->table[ i + 1 ] - stage->table[ i ] ) ) / 255.0;
+		}
+		else
+			y = x;
+		table[ t ] = ( unsigned short ) ( y * 256 + 0.5 );
+	}
+	return ticks;
+}
+
+void RezEnvelopeInit( RezEnvelope *envelope, const RezEnvelopeStage *attack, int holdMS, const RezEnvelopeStage *decay )
+{
+	memset( envelope, 0, sizeof( RezEnvelope ) );
+	envelope->attackTicks = RezEnvelopeTable( envelope->attack, attack, 1 );
+	envelope->holdTicks = ( holdMS + ENVELOPETICKMS / 2 ) / ENVELOPETICKMS;
+	envelope->decayTicks = RezEnvelopeTable( envelope->decay, decay, 0 );
+}
+
+void RezEnvelopeDefaults( RezEnvelope *envelope )
+{
+	RezEnvelopeStage attack, decay;
+
+	attack.shape = ATTACKSHAPE;
+	attack.ms = ATTACKMS;
+	attack.table = NULL;
+	attack.length = 0;
+	decay.shape = DECAYSHAPE;
+	decay.ms = DECAYMS;
+	decay.table = NULL;
+	decay.length = 0;
+	RezEnvelopeInit( envelope, &attack, HOLDMS, &decay );
+}
+
+void RezEnvelopeStrike( RezEnvelope *envelope, unsigned long tick, int peak )
+{
+	envelope->from = RezEnvelopeLevel( envelope, tick );
+	envelope->struck = tick;
+	envelope->peak = peak < 0 ? 0 : peak > 255 ? 255 : peak;
+}
+
+/*
+ * The tick of the strike itself is the first tick of the attack, so a
+ * beat is felt in the tick it arrives in.  Ticks are compared as a
+ * difference, which survives the count wrapping.
+ */
+
+int RezEnvelopeLevel( const RezEnvelope *envelope, unsigned long tick )
+{
+	unsigned long t = tick - envelope->struck;
+
+	if( envelope->peak == 0 ) return 0;
+	if( t < ( unsigned long ) envelope->attackTicks )
+		return envelope->from + ( envelope->peak - envelope->from ) * envelope->attack[ t ] / 256;
+	t -= envelope->attackTicks;
+	if( t < ( unsigned long ) envelope->holdTicks ) return envelope->peak;
+	t -= envelope->holdTicks;
+	if( t < ( unsigned long ) envelope->decayTicks ) return envelope->peak * ( 256 - envelope->decay[ t ] ) / 256;
+	return 0;
+}
+
+/*
+ * The first step down from the beat's speed is held only to MINSTEP, so
+ * the motor starts down on time; the rest of the way is held to
+ * DECAYSTEP.
+ */
+
+int RezEnvelopeNext( RezEnvelope *envelope, unsigned long tick, int *speed )
+{
+	int level = RezEnvelopeLevel( envelope, tick ), step = level - envelope->sent;
+	int least = step < 0 && envelope->sent != envelope->peak ? DECAYSTEP : MINSTEP;
+
+	if( step == 0 ) return 0;
+	if( level != 0 && level != envelope->peak && step < least && step > -least ) return 0;
+	envelope->sent = level;
+	*speed = level;
+	return 1;
+}
+
+int RezEnvelopeIdle( const RezEnvelope *envelope, unsigned long tick )
+{
+	return envelope->sent == 0 && RezEnvelopeLevel( envelope, tick ) == 0;
+}
@@ -0,0 +1,132 @@
+/*
+ *  rezEnvelope.h
+ *  rezTunes
+ *
+ *  The shape of the motor's response to a beat: an attack from wherever
+ *  the motor is up to the beat's speed, a hold there, then a decay to
+ *  stop.  Time is counted in ticks of ENVELOPETICKMS of real time, not in
+ *  frames, so the shape is the same however often the host calls us.
+ *
+ *  Each stage's curve is worked out once, at init, into a table with an
+ *  entry per tick, so following the envelope costs a lookup and a
+ *  multiply.  The level at any tick depends only on the last strike, so
+ *  two envelopes given the same strikes agree on it: one can drive the
+ *  motor while another shows what it is doing.
+ */
+
+#ifndef REZENVELOPE_H_
+#define REZENVELOPE_H_
+
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shapes.
+ *   LINEAR - A straight line.
+ *   EXPONENTIAL - Moves fast at first and slows as it arrives, like the
+ *     motor does by itself.
+ *   CUSTOM - A table of the caller's, 0 at the start and 255 at the end
+ *     of the stage, stretched over the stage.
+ */
+
+enum {
+	REZ_SHAPE_LINEAR = 0,
+	REZ_SHAPE_EXPONENTIAL,
+	REZ_SHAPE_CUSTOM
+};
+
+/*
+ * Parameters of the envelope.
+ *   ENVELOPETICKMS - Length of a tick, and how often a moving envelope
+ *     sends the device a speed.  A strike is sent as soon as it comes.
+ *   ATTACKMS, ATTACKSHAPE - How long and in what way the motor is brought
+ *     up to a beat's speed.
+ *   HOLDMS - How long it is held there.
+ *   DECAYMS, DECAYSHAPE - How long and in what way it then winds down.
+ *   MINSTEP - Changes of speed smaller than this are not worth the
+ *     motor's time, and are not sent, except to reach the beat's speed or
+ *     to stop.
+ *   DECAYSTEP - The same once the motor is on its way down from a beat's
+ *     speed.  The rotor winds down over a good many ticks and smooths out
+ *     coarser steps, and the default decay falls nearly MINSTEP a tick,
+ *     so it would otherwise be sent on every one.
+ *
+ *  The defaults keep the old feel, an instant jump and a straight decay
+ *  over the time 10 a frame used to take, now at any frame rate.
+ */
+
+#define ENVELOPETICKMS 10
+#define ATTACKMS 0
+#define ATTACKSHAPE REZ_SHAPE_LINEAR
+#define HOLDMS 0
+#define DECAYMS 640
+#define DECAYSHAPE REZ_SHAPE_LINEAR
+#define MINSTEP 4
+#define DECAYSTEP 16
+
+/*
+ * REZ_ENVELOPE_TICKS - Longest a stage can be, in ticks.
+ */
+
+#define REZ_ENVELOPE_TICKS 256
+
+struct RezEnvelopeStage {
+	int					shape;
+	int					ms;
+	const unsigned char	*table;
+	int					length;
+};
+typedef struct RezEnvelopeStage RezEnvelopeStage;
+
+/*
+ * attack and decay hold the fraction of the stage covered at each of its
+ * ticks, out of 256.  sent is the last speed RezEnvelopeNext gave out.
+ */
+
+struct RezEnvelope {
+	unsigned short		attack[ REZ_ENVELOPE_TICKS ];
+	unsigned short		decay[ REZ_ENVELOPE_TICKS ];
+	int					attackTicks;
+	int					holdTicks;
+	int					decayTicks;
+
+	unsigned long		struck;
+	int					from;
+	int					peak;
+	int					sent;
+};
+typedef struct RezEnvelope RezEnvelope;
+
+/*
+ * RezEnvelopeInit works out the tables for the given stages, and
+ * RezEnvelopeDefaults does so for the parameters above.  Both leave the
+ * envelope silent.
+ *
+ * RezEnvelopeStrike starts a new attack at tick, from the level there,
+ * towards peak.  A peak of 0 stops the envelope dead.
+ *
+ * RezEnvelopeLevel is the speed at tick, which must not be before the
+ * last strike.
+ *
+ * RezEnvelopeNext is for whatever drives the device, once a tick.  It
+ * returns 1 and the speed to send if there is one worth sending, or 0.
+ * RezEnvelopeIdle is true once the envelope has stopped and said so.
+ */
+
+extern void RezEnvelopeInit( RezEnvelope *envelope, const RezEnvelopeStage *attack, int holdMS, const RezEnvelopeStage *decay );
+extern void RezEnvelopeDefaults( RezEnvelope *envelope );
+extern void RezEnvelopeStrike( RezEnvelope *envelope, unsigned long tick, int peak );
+extern int RezEnvelopeLevel( const RezEnvelope *envelope, unsigned long tick );
+extern int RezEnvelopeNext( RezEnvelope *envelope, unsigned long tick, int *speed );
+extern int RezEnvelopeIdle( const RezEnvelope *envelope, unsigned long tick );
+
+#define RezEnvelopeTick( time ) ( ( unsigned long ) ( ( time ) / REZ_MS( ENVELOPETICKMS ) ) )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZENVELOPE_H_ */
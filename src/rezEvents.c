@@ -0,0 +1,187 @@
+/*
+ *  rezEvents.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezArena.h"
+#include "rezEvents.h"
+
+/*
+ * Subscribers in other languages read batches by these sizes.
+ */
+
+REZ_STATIC_ASSERT( event_header_size, sizeof( RezEventHeader ) == 24 );
+REZ_STATIC_ASSERT( event_size, sizeof( RezEvent ) == 8 );
+
+/*
+ * Each platform's socket calls come down to three answers for a send:
+ * it went, it would have had to wait, or there is nobody to take it.
+ */
+
+enum {
+	REZ_SENT = 0,
+	REZ_WOULDBLOCK,
+	REZ_NOBODY
+};
+
+#if defined( _WIN32 )
+
+#include <winsock2.h>
+
+static int RezEventsSocket( RezEvents *events )
+{
+	WSADATA data;
+	u_long nonblocking = 1;
+
+	if( WSAStartup( MAKEWORD( 2, 2 ), &data ) != 0 ) return 0;
+	events->socket = ( size_t ) socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if( ( SOCKET ) events->socket == INVALID_SOCKET || ioctlsocket( ( SOCKET ) events->socket, FIONBIO, &nonblocking ) != 0 )
+	{
+		if( ( SOCKET ) events->socket != INVALID_SOCKET ) closesocket( ( SOCKET ) events->socket );
+		WSACleanup();
+		return 0;
+	}
+	return 1;
+}
+
+static void RezEventsUnsocket( RezEvents *events )
+{
+	closesocket( ( SOCKET ) events->socket );
+	WSACleanup();
+}
+
+static int RezEventsDatagram( RezEvents *events, const void *data, int length )
+{
+	struct sockaddr_in address;
+
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( REZ_EVENTS_PORT );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if( sendto( ( SOCKET ) events->socket, ( const char * ) data, length, 0, ( struct sockaddr * ) &address, sizeof( address ) ) >= 0 )
+		return REZ_SENT;
+	return WSAGetLastError() == WSAEWOULDBLOCK ? REZ_WOULDBLOCK : REZ_NOBODY;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int RezEventsSocket( RezEvents *events )
+{
+	events->socket = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	if( events->socket < 0 ) return 0;
+	if( fcntl( events->socket, F_SETFL, fcntl( events->socket, F_GETFL, 0 ) | O_NONBLOCK ) < 0 )
+	{
+		close( events->socket );
+		return 0;
+	}
+	return 1;
+}
+
+static void RezEventsUnsocket( RezEvents *events )
+{
+	close( events->socket );
+}
+
+/*
+ * A subscriber whose queue is full makes the send fail with EAGAIN, or
+ * ENOBUFS on the Mac.  A missing or dead socket file means nobody is
+ * listening.
+ */
+
+static int RezEventsDatagram( RezEvents *events, const void *data, int length )
+{
+	struct sockaddr_un address;
+
+	memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	strncpy( address.sun_path, REZ_EVENTS_PATH, sizeof( address.sun_path ) - 1 );
+	if( sendto( events->socket, data, length, 0, ( struct sockaddr * ) &address, sizeof( address ) ) >= 0 ) return REZ_SENT;
+	if( errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == EINTR ) return REZ_WOULDBLOCK;
+	return REZ_NOBODY;
+}
+
+#endif
+
+int RezEventsOpen( RezEvents *events )
+{
+	memset( events, 0, sizeof( RezEvents ) );
+	return RezEventsSocket( events );
+}
+
+void RezEventsClose( RezEvents *events )
+{
+	RezEventsUnsocket( events );
+	memset( events, 0, sizeof( RezEvents ) );
+}
+
+void RezEventsBegin( RezEvents *events, unsigned int stamp, unsigned int positionMS )
+{
+	RezEventHeader *header = &events->frame.header;
+
+	header->magic = REZ_EVENTS_MAGIC;
+	header->version = REZ_EVENTS_VERSION;
+	header->count = 0;
+	header->stamp = stamp;
+	header->positionMS = positionMS;
+}
+
+void RezEventsAdd( RezEvents *events, int type, int band, int speed, float strength )
+{
+	RezEventBatch *batch = &events->frame;
+	RezEvent *event;
+
+	if( batch->header.count >= REZ_EVENTS_MAX ) return;
+	event = &batch->event[ batch->header.count++ ];
+	event->type = ( unsigned char ) type;
+	event->band = ( unsigned char ) band;
+	event->speed = ( unsigned char ) speed;
+	event->reserved = 0;
+	event->strength = strength;
+}
+
+/*
+ * When the queue is full the oldest waiting batch makes room for the new
+ * one.  Only as much of a batch as has events in it goes on the wire.  A
+ * batch nobody took is as good as sent; one that would have had to wait
+ * stays first in line for the next frame.
+ */
+
+void RezEventsSend( RezEvents *events )
+{
+	int sends;
+
+	if( events->frame.header.count > 0 )
+	{
+		RezEventBatch *slot;
+
+		if( events->queued == REZ_EVENTS_QUEUE )
+		{
+			events->oldest = ( events->oldest + 1 ) % REZ_EVENTS_QUEUE;
+			events->queued--;
+			events->dropped++;
+		}
+		slot = &events->queue[ ( events->oldest + events->queued ) % REZ_EVENTS_QUEUE ];
+		events->frame.header.sequence = events->sequence++;
+		memcpy( slot, &events->frame, sizeof( RezEventHeader ) + events->frame.header.count * sizeof( RezEvent ) );
+		events->queued++;
+		events->frame.header.count = 0;
+	}
+
+	for( sends = 0; sends < REZ_EVENTS_BURST && events->queued > 0; sends++ )
+	{
+		RezEventBatch *batch = &events->queue[ events->oldest ];
+
+		batch->header.dropped = events->dropped;
+		if( RezEventsDatagram( events, batch, sizeof( RezEventHeader ) + batch->header.count * sizeof( RezEvent ) ) == REZ_WOULDBLOCK )
+			break;
+		events->oldest = ( events->oldest + 1 ) % REZ_EVENTS_QUEUE;
+		events->queued--;
+	}
+}
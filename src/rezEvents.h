@@ -0,0 +1,128 @@
+/*
+ *  rezEvents.h
+ *  rezTunes
+ *
+ *  Beat and motor speed events sent as small binary datagrams to another
+ *  process on the same machine, such as a lighting or logging daemon.
+ *  Every event from one detector frame goes out in a single datagram
+ *  stamped with the frame's renderTimeStampID.
+ *
+ *  The render path owns the queue and sends from it without ever
+ *  waiting: the socket is non-blocking, each frame sends at most a few
+ *  datagrams, and when a slow subscriber lets the queue fill, the oldest
+ *  batch is thrown away to make room.  With nobody listening, batches are
+ *  dropped as they are sent.
+ *
+ *  On the Mac the subscriber binds a Unix datagram socket at
+ *  REZ_EVENTS_PATH; on Windows it binds UDP port REZ_EVENTS_PORT on the
+ *  loopback address.  Fields are in the sender's byte order, which is
+ *  the subscriber's too.
+ */
+
+#ifndef REZEVENTS_H_
+#define REZEVENTS_H_
+
+#include <stddef.h>
+#include "rezDetector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REZ_EVENTS_PATH "/tmp/rezTunes.events"
+#define REZ_EVENTS_PORT 47209
+
+#define REZ_EVENTS_MAGIC 0x525a4556		/* 'RZEV' */
+#define REZ_EVENTS_VERSION 2
+
+/*
+ * REZ_EVENTS_QUEUE - Batches that may wait for a slow subscriber.
+ * REZ_EVENTS_BURST - Most datagrams sent in one frame, which bounds the
+ *   time the render path spends catching up.
+ * REZ_EVENTS_MAX - Most events in a batch: a beat per band, an onset and
+ *   a speed.
+ */
+
+#define REZ_EVENTS_QUEUE 64
+#define REZ_EVENTS_BURST 4
+#define REZ_EVENTS_MAX ( FREQUENCYBANDS + 2 )
+
+enum {
+	REZ_EVENT_BEAT = 1,
+	REZ_EVENT_SPEED = 2,
+	REZ_EVENT_ONSET = 3
+};
+
+/*
+ * band is the band that fired, for a beat; speed is the motor speed the
+ * frame ended with; strength is how many times its recent average the
+ * band's energy was, or for an onset, the detector's confidence in it
+ * from 0 to 1.  An onset comes once in a frame where any band fired.
+ */
+
+struct RezEvent {
+	unsigned char		type;
+	unsigned char		band;
+	unsigned char		speed;
+	unsigned char		reserved;
+	float				strength;
+};
+typedef struct RezEvent RezEvent;
+
+/*
+ * sequence counts every batch ever made, sent or not, so a subscriber can
+ * see gaps; dropped is how many of them the sender has thrown away.
+ */
+
+struct RezEventHeader {
+	unsigned int		magic;
+	unsigned short		version;
+	unsigned short		count;
+	unsigned int		sequence;
+	unsigned int		dropped;
+	unsigned int		stamp;
+	unsigned int		positionMS;
+};
+typedef struct RezEventHeader RezEventHeader;
+
+struct RezEventBatch {
+	RezEventHeader		header;
+	RezEvent			event[ REZ_EVENTS_MAX ];
+};
+typedef struct RezEventBatch RezEventBatch;
+
+struct RezEvents {
+#if defined( _WIN32 )
+	size_t				socket;
+#else
+	int					socket;
+#endif
+	RezEventBatch		queue[ REZ_EVENTS_QUEUE ];
+	unsigned int		oldest;
+	unsigned int		queued;
+	unsigned int		sequence;
+	unsigned int		dropped;
+	RezEventBatch		frame;
+};
+typedef struct RezEvents RezEvents;
+
+/*
+ * RezEventsOpen makes the socket and returns 0 if it cannot.
+ *
+ * A frame's events go between RezEventsBegin and RezEventsSend, one
+ * RezEventsAdd each.  RezEventsSend queues the batch if it has anything
+ * in it, throwing away the oldest waiting batch if there is no room, and
+ * sends what it can.
+ */
+
+extern int RezEventsOpen( RezEvents *events );
+extern void RezEventsClose( RezEvents *events );
+extern void RezEventsBegin( RezEvents *events, unsigned int stamp, unsigned int positionMS );
+extern void RezEventsAdd( RezEvents *events, int type, int band, int speed, float strength );
+extern void RezEventsSend( RezEvents *events );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZEVENTS_H_ */
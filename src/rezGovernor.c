@@ -0,0 +1,105 @@
+/*
+ *  rezGovernor.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezGovernor.h"
+
+static const char *stageNames[ REZ_STAGES ] = {
+	"detail", "horizons", "telemetry"
+};
+
+void RezGovernorInit( RezGovernor *governor, RezGovernorCounts *counts, unsigned long budgetUS )
+{
+	memset( governor, 0, sizeof( RezGovernor ) );
+	memset( counts, 0, sizeof( RezGovernorCounts ) );
+	governor->counts = counts;
+	governor->budgetUS = budgetUS;
+}
+
+void RezGovernorRestart( RezGovernor *governor )
+{
+	int stage;
+
+	for( stage = 0; stage < REZ_STAGES; stage++ ) governor->stageSum[ stage ] = 0;
+	governor->stageFrames = 0;
+	governor->frames = 0;
+	governor->next = 0;
+	governor->calm = 0;
+}
+
+/*
+ * Sorting a copy of the ring is a few hundred compares every
+ * REZ_GOVERNOR_EVERY frames, and nearly sorted input is the quick case
+ * for an insertion sort.
+ */
+
+static unsigned long RezGovernorPercentile( RezGovernor *governor )
+{
+	unsigned long *sorted = governor->sorted;
+	int i, j;
+
+	for( i = 0; i < REZ_GOVERNOR_FRAMES; i++ )
+	{
+		unsigned long us = governor->frameUS[ i ];
+
+		for( j = i; j > 0 && sorted[ j - 1 ] > us; j-- ) sorted[ j ] = sorted[ j - 1 ];
+		sorted[ j ] = us;
+	}
+	return sorted[ ( REZ_GOVERNOR_FRAMES * REZ_GOVERNOR_PERCENT + 99 ) / 100 - 1 ];
+}
+
+int RezGovernorFrame( RezGovernor *governor, unsigned long frameUS, const unsigned long *stageUS )
+{
+	int stage;
+
+	governor->frameUS[ governor->next ] = frameUS;
+	governor->next = ( governor->next + 1 ) % REZ_GOVERNOR_FRAMES;
+	for( stage = 0; stage < REZ_STAGES; stage++ ) governor->stageSum[ stage ] += stageUS[ stage ];
+	governor->stageFrames++;
+	if( ++governor->frames < REZ_GOVERNOR_FRAMES ) return 0;
+	governor->frames -= REZ_GOVERNOR_EVERY;
+
+	for( stage = 0; stage < REZ_STAGES; stage++ )
+	{
+		governor->counts->stageUS[ stage ] = ( unsigned int ) ( governor->stageSum[ stage ] / governor->stageFrames );
+		governor->stageSum[ stage ] = 0;
+	}
+	governor->stageFrames = 0;
+
+	governor->percentileUS = RezGovernorPercentile( governor );
+	if( governor->percentileUS > governor->budgetUS )
+	{
+		governor->calm = 0;
+		if( governor->stagesShed == REZ_STAGES ) return 0;
+		governor->counts->shed[ governor->stagesShed ]++;
+		governor->stagesShed++;
+	}
+	else if( governor->percentileUS < governor->budgetUS * REZ_GOVERNOR_HEADROOM && governor->stagesShed > 0 )
+	{
+		if( ++governor->calm < REZ_GOVERNOR_CALM ) return 0;
+		governor->calm = 0;
+		governor->stagesShed--;
+		governor->counts->restored[ governor->stagesShed ]++;
+	}
+	else
+	{
+		governor->calm = 0;
+		return 0;
+	}
+
+	governor->counts->stagesShed = governor->stagesShed;
+	governor->frames = 0;
+	return 1;
+}
+
+void RezGovernorPrint( const RezGovernorCounts *counts, FILE *out )
+{
+	int stage;
+
+	fprintf( out, "stage\tshed\trestored\tus\n" );
+	for( stage = 0; stage < REZ_STAGES; stage++ )
+		fprintf( out, "%s\t%u\t%u\t%u%s\n", stageNames[ stage ], counts->shed[ stage ], counts->restored[ stage ],
+				 counts->stageUS[ stage ], stage < ( int ) counts->stagesShed ? "\t(shed now)" : "" );
+}
@@ -0,0 +1,119 @@
+/*
+ *  rezGovernor.h
+ *  rezTunes
+ *
+ *  Keeps a frame's work inside a time budget on a loaded machine.  The
+ *  cost of each frame, detection, drawing and telemetry together, goes
+ *  into a ring of the most recent frames.  Every so often the 95th
+ *  percentile of the ring is compared with the budget: over it, the next
+ *  optional stage is turned off; comfortably under it for a while, the
+ *  last one turned off comes back.  Stages go in a fixed order, cheapest
+ *  to lose first, and come back in the opposite order.  Driving the motor
+ *  is not a stage and is never turned off.
+ *
+ *  After every change the ring is left to fill with frames done the new
+ *  way before the next decision, so a change is judged on what it did.
+ *
+ *  Nothing in here depends on the iTunes headers.
+ */
+
+#ifndef REZGOVERNOR_H_
+#define REZGOVERNOR_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The optional stages, in the order they are shed.
+ *   REZ_STAGE_DETAIL - Easing the picture between detector frames, so it
+ *     is drawn once a frame rather than at display rate.
+ *   REZ_STAGE_HORIZONS - The short and long memories.  Beats are judged
+ *     against the normal one alone.
+ *   REZ_STAGE_TELEMETRY - The per-frame record for outside tools.
+ */
+
+enum {
+	REZ_STAGE_DETAIL = 0,
+	REZ_STAGE_HORIZONS,
+	REZ_STAGE_TELEMETRY,
+	REZ_STAGES
+};
+
+/*
+ * REZ_GOVERNOR_FRAMES - Frames the percentile is taken over.
+ * REZ_GOVERNOR_EVERY - Frames between decisions once the ring is full.
+ * REZ_GOVERNOR_PERCENT - The percentile, out of 100.
+ * REZ_GOVERNOR_HEADROOM - A stage only comes back when the percentile is
+ *   under this fraction of the budget, so that bringing it back does not
+ *   put the frame straight over again.
+ * REZ_GOVERNOR_CALM - Decisions in a row that must find that much room
+ *   before a stage comes back.
+ */
+
+#define REZ_GOVERNOR_FRAMES 64
+#define REZ_GOVERNOR_EVERY 16
+#define REZ_GOVERNOR_PERCENT 95
+#define REZ_GOVERNOR_HEADROOM 0.5
+#define REZ_GOVERNOR_CALM 4
+
+/*
+ * How often each stage has been shed and brought back, and how many are
+ * shed now.  stageUS is what each stage cost a frame, on average, over
+ * the frames the last decision was made on, so a shed can be checked
+ * against what it saved.  The layout uses fixed size fields only, so the
+ * counts can live in shared memory for outside tools to read.
+ */
+
+struct RezGovernorCounts {
+	unsigned int		shed[ REZ_STAGES ];
+	unsigned int		restored[ REZ_STAGES ];
+	unsigned int		stagesShed;
+	unsigned int		stageUS[ REZ_STAGES ];
+};
+typedef struct RezGovernorCounts RezGovernorCounts;
+
+struct RezGovernor {
+	RezGovernorCounts	*counts;
+	unsigned long		budgetUS;
+	unsigned long		frameUS[ REZ_GOVERNOR_FRAMES ];
+	unsigned long		sorted[ REZ_GOVERNOR_FRAMES ];
+	unsigned long		percentileUS;
+	unsigned long		stageSum[ REZ_STAGES ];
+	int					stageFrames;
+	int					frames;
+	int					next;
+	int					calm;
+	int					stagesShed;
+};
+typedef struct RezGovernor RezGovernor;
+
+/*
+ * RezGovernorInit starts with every stage on, against a budget of
+ * budgetUS a frame, keeping its counts in counts.
+ *
+ * RezGovernorFrame adds the cost of one frame, frameUS in all and stageUS
+ * for each stage within it, and returns non-zero if a stage was shed or
+ * brought back.  RezGovernorRestart forgets the frames
+ * seen so far, for after a pause, and keeps what is shed.
+ *
+ * RezGovernorSheds is non-zero while stage is turned off.
+ *
+ * RezGovernorPrint writes a table of the counts and costs, a line per
+ * stage.
+ */
+
+extern void RezGovernorInit( RezGovernor *governor, RezGovernorCounts *counts, unsigned long budgetUS );
+extern int RezGovernorFrame( RezGovernor *governor, unsigned long frameUS, const unsigned long *stageUS );
+extern void RezGovernorRestart( RezGovernor *governor );
+extern void RezGovernorPrint( const RezGovernorCounts *counts, FILE *out );
+
+#define RezGovernorSheds( governor, stage ) ( ( governor )->stagesShed > ( stage ) )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZGOVERNOR_H_ */
@@ -0,0 +1,291 @@
+/*
+ *  rezInstrument.c
+ *  rezTunes
+ */
+
+#include "rezInstrument.h"
+
+#if REZ_INSTRUMENT
+
+#include <stdio.h>
+#include <string.h>
+#include "rezAtomic.h"
+#include "rezTime.h"
+
+#if defined( _WIN32 )
+#include <windows.h>
+#include <intrin.h>
+#define REZ_SEPARATOR "\\"
+typedef DWORD RezThreadKey;
+#define RezKeyCreate( key ) ( ( *( key ) = TlsAlloc() ) != TLS_OUT_OF_INDEXES )
+#define RezKeyGet( key ) TlsGetValue( key )
+#define RezKeySet( key, value ) TlsSetValue( key, value )
+#else
+#include <pthread.h>
+#define REZ_SEPARATOR "/"
+typedef pthread_key_t RezThreadKey;
+#define RezKeyCreate( key ) ( pthread_key_create( key, NULL ) == 0 )
+#define RezKeyGet( key ) pthread_getspecific( key )
+#define RezKeySet( key, value ) pthread_setspecific( key, value )
+#endif
+
+/*
+ * REZ_INSTRUMENT_THREADS - Most threads that can record.  Probes on any
+ *   thread past this are dropped.
+ * REZ_BUCKETS - One histogram bucket per power of two ticks.
+ */
+
+#define REZ_INSTRUMENT_THREADS 16
+#define REZ_BUCKETS 64
+
+struct RezHistogram {
+	unsigned long		count;
+	RezTicks			total;
+	RezTicks			least;
+	RezTicks			most;
+	unsigned long		allocations;
+	unsigned long		bucket[ REZ_BUCKETS ];
+};
+typedef struct RezHistogram RezHistogram;
+
+struct RezInstrumentThread {
+	int					handling;
+	RezHistogram		probe[ REZ_PROBES ];
+};
+typedef struct RezInstrumentThread RezInstrumentThread;
+
+static RezInstrumentThread threads[ REZ_INSTRUMENT_THREADS ];
+static RezAtomic threadsClaimed;
+static RezThreadKey threadKey;
+static RezAtomic keyState;
+static char unclaimed;
+static RezAtomic calibrated;
+static RezTicks calibrationTicks;
+static RezTime calibrationTime;
+
+static const char *probeNames[ REZ_PROBES ] = {
+	"render", "idle", "update", "window", "track", "play", "pause", "init", "message",
+	"bands", "history", "decision", "draw", "actuate", "discover"
+};
+
+/*
+ * The time stamp counter where there is one, which costs a few cycles to
+ * read.  Ticks are turned into time only when dumping, by comparing the
+ * ticks and the clock since the first probe.
+ */
+
+RezTicks RezTicksNow( void )
+{
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+	return __rdtsc();
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+	unsigned int low, high;
+
+	__asm__ __volatile__( "rdtsc" : "=a" ( low ), "=d" ( high ) );
+	return ( ( RezTicks ) high << 32 ) | low;
+#else
+	return RezTimeNow();
+#endif
+}
+
+/*
+ * Index of the highest set bit, which picks the bucket.
+ */
+
+static int RezLog2( RezTicks value )
+{
+#if defined( __GNUC__ )
+	return 63 - __builtin_clzll( value );
+#elif defined( _M_X64 )
+	unsigned long index;
+
+	_BitScanReverse64( &index, value );
+	return ( int ) index;
+#else
+	int bits = 0;
+
+	if( value >> 32 ) bits += 32, value >>= 32;
+	if( value >> 16 ) bits += 16, value >>= 16;
+	if( value >> 8 ) bits += 8, value >>= 8;
+	if( value >> 4 ) bits += 4, value >>= 4;
+	if( value >> 2 ) bits += 2, value >>= 2;
+	if( value >> 1 ) bits += 1;
+	return bits;
+#endif
+}
+
+/*
+ * Each thread keeps a pointer to its histograms in thread local storage.
+ * The key is made by the first thread to claim a set, while any others
+ * wait for it; its state is 0 before then, 1 while it is being made, 2
+ * once it is made and 3 if it could not be.
+ */
+
+static int RezInstrumentKey( int make )
+{
+	int state = RezAtomicLoad( &keyState );
+
+	if( state == 0 && make && RezAtomicCompareAndSwap( &keyState, 0, 1 ) )
+		RezAtomicStore( &keyState, RezKeyCreate( &threadKey ) ? 2 : 3 );
+	while( ( state = RezAtomicLoad( &keyState ) ) == 1 ) ;
+	return state == 2;
+}
+
+/*
+ * Find this thread's histograms, claiming a free set the first time if
+ * claim is set.  A thread that finds every set taken is marked, so it
+ * never tries again.  Finding without claiming neither allocates nor
+ * takes a lock, so it can be done from inside malloc.
+ */
+
+static RezInstrumentThread *RezInstrumentFind( int claim )
+{
+	void *found;
+	int i;
+
+	if( !RezInstrumentKey( claim ) ) return NULL;
+	found = RezKeyGet( threadKey );
+	if( found != NULL || !claim ) return found == &unclaimed ? NULL : ( RezInstrumentThread * ) found;
+
+	if( RezAtomicCompareAndSwap( &calibrated, 0, 1 ) )
+	{
+		calibrationTime = RezTimeNow();
+		calibrationTicks = RezTicksNow();
+	}
+	i = RezAtomicAdd( &threadsClaimed, 1 ) - 1;
+	if( i >= REZ_INSTRUMENT_THREADS )
+	{
+		RezKeySet( threadKey, &unclaimed );
+		return NULL;
+	}
+	threads[ i ].handling = REZ_PROBE_NONE;
+	RezKeySet( threadKey, &threads[ i ] );
+	return &threads[ i ];
+}
+
+#define RezInstrumentSelf() RezInstrumentFind( 1 )
+
+void RezInstrumentRecord( int probe, RezTicks elapsed )
+{
+	RezInstrumentThread *thread = RezInstrumentSelf();
+	RezHistogram *histogram;
+	int bucket = 0;
+
+	if( thread == NULL ) return;
+	histogram = &thread->probe[ probe ];
+	if( elapsed > 1 ) bucket = RezLog2( elapsed );
+	histogram->bucket[ bucket ]++;
+	if( histogram->count == 0 || elapsed < histogram->least ) histogram->least = elapsed;
+	if( elapsed > histogram->most ) histogram->most = elapsed;
+	histogram->total += elapsed;
+	histogram->count++;
+}
+
+RezTicks RezInstrumentLap( int probe, RezTicks start )
+{
+	RezTicks now = RezTicksNow();
+
+	RezInstrumentRecord( probe, now - start );
+	return now;
+}
+
+int RezInstrumentHandle( int probe )
+{
+	RezInstrumentThread *thread = RezInstrumentSelf();
+	int previous;
+
+	if( thread == NULL ) return REZ_PROBE_NONE;
+	previous = thread->handling;
+	thread->handling = probe;
+	return previous;
+}
+
+int RezInstrumentHandling( void )
+{
+	RezInstrumentThread *thread = RezInstrumentFind( 0 );
+
+	return thread == NULL ? REZ_PROBE_NONE : thread->handling;
+}
+
+const char *RezInstrumentName( int probe )
+{
+	return probe >= 0 && probe < REZ_PROBES ? probeNames[ probe ] : "none";
+}
+
+/*
+ * Allocations made outside any message, on the worker threads for
+ * instance, are not counted.
+ */
+
+void RezInstrumentAllocation( void )
+{
+	RezInstrumentThread *thread = RezInstrumentFind( 0 );
+
+	if( thread != NULL && thread->handling != REZ_PROBE_NONE ) thread->probe[ thread->handling ].allocations++;
+}
+
+/*
+ * Percentiles are read off the histogram as the top of the bucket they
+ * fall in, so they are within a factor of two and never under.
+ */
+
+static double RezPercentile( const RezHistogram *histogram, double fraction )
+{
+	unsigned long wanted = ( unsigned long ) ( histogram->count * fraction ), seen = 0;
+	int bucket;
+
+	for( bucket = 0; bucket < REZ_BUCKETS; bucket++ )
+	{
+		seen += histogram->bucket[ bucket ];
+		if( seen > wanted ) break;
+	}
+	if( bucket >= REZ_BUCKETS ) bucket = REZ_BUCKETS - 1;
+	return ( double ) ( ( RezTicks ) 2 << bucket );
+}
+
+/*
+ * Write every histogram with anything in it, in microseconds, and the
+ * allocations counted against it, to timings.txt in directory, or to
+ * stderr if directory is NULL or the file cannot be written.  Only call
+ * this once the other recording threads have stopped.
+ */
+
+void RezInstrumentDump( const char *directory )
+{
+	char path[ 1024 ];
+	FILE *out = NULL;
+	double usPerTick = 0.001;
+	int claimed = RezAtomicLoad( &threadsClaimed ), t, p;
+
+	if( directory != NULL && strlen( directory ) + 16 < sizeof( path ) )
+	{
+		sprintf( path, "%s" REZ_SEPARATOR "timings.txt", directory );
+		out = fopen( path, "w" );
+	}
+	if( out == NULL ) out = stderr;
+	if( claimed > REZ_INSTRUMENT_THREADS ) claimed = REZ_INSTRUMENT_THREADS;
+	if( RezAtomicLoad( &calibrated ) )
+	{
+		RezTicks ticks = RezTicksNow() - calibrationTicks;
+
+		if( ticks > 0 ) usPerTick = ( RezTimeNow() - calibrationTime ) / 1000.0 / ( double ) ticks;
+	}
+
+	fprintf( out, "thread\tprobe\tcount\tallocs\tmean\tmin\tp50\tp99\tmax\t(us)\n" );
+	for( t = 0; t < claimed; t++ )
+	{
+		for( p = 0; p < REZ_PROBES; p++ )
+		{
+			const RezHistogram *histogram = &threads[ t ].probe[ p ];
+
+			if( histogram->count == 0 ) continue;
+			fprintf( out, "%d\t%s\t%lu\t%lu\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\n", t, probeNames[ p ], histogram->count, histogram->allocations,
+					 ( double ) histogram->total / histogram->count * usPerTick, ( double ) histogram->least * usPerTick,
+					 RezPercentile( histogram, 0.5 ) * usPerTick, RezPercentile( histogram, 0.99 ) * usPerTick,
+					 ( double ) histogram->most * usPerTick );
+		}
+	}
+	if( out != stderr ) fclose( out );
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ *  rezInstrument.h
+ *  rezTunes
+ *
+ *  Timing probes for the message handler and the stages under it, kept
+ *  as log2 histograms per thread so that recording never takes a lock or
+ *  an atomic.  Build with REZ_INSTRUMENT defined to 1 to turn them on;
+ *  otherwise every probe compiles to nothing at all.
+ *
+ *  A probe is declared with REZ_PROBE( name ), with no semicolon after
+ *  it, among the other declarations.  REZ_PROBE_START( name ) notes the
+ *  time and REZ_PROBE_STOP( name, probe ) adds the time since then to
+ *  the histogram for probe, one of the REZ_PROBE_ values below.
+ *  REZ_PROBE_LAP( name, probe ) does the same and starts timing again
+ *  from the same reading, for back to back stages.
+ *  REZ_INSTRUMENT_DUMP( directory ) writes them all out as a table.
+ *
+ *  Heap allocations are counted against the message being handled when
+ *  they are made.  REZ_HANDLER( name ) is declared like a probe, and
+ *  REZ_HANDLER_START( name, probe ) says which message this thread is
+ *  handling until REZ_HANDLER_STOP( name ) puts back whatever it was
+ *  handling before.  REZ_ALLOCATION() counts one; every call the plugin
+ *  makes to malloc has one next to it.  RezInstrumentHandling() returns
+ *  the message this thread is handling, or REZ_PROBE_NONE, and neither
+ *  allocates nor takes a lock, so it can be called from inside malloc.
+ *  RezInstrumentName( probe ) is the probe's name in the table.
+ */
+
+#ifndef REZINSTRUMENT_H_
+#define REZINSTRUMENT_H_
+
+#ifndef REZ_INSTRUMENT
+#define REZ_INSTRUMENT 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One probe per message type that does real work, then the stages of
+ * detection, drawing and driving the motor, and the actuator thread's
+ * looks for a device.
+ */
+
+enum {
+	REZ_PROBE_RENDER = 0,
+	REZ_PROBE_IDLE,
+	REZ_PROBE_UPDATE,
+	REZ_PROBE_WINDOW,
+	REZ_PROBE_TRACK,
+	REZ_PROBE_PLAY,
+	REZ_PROBE_PAUSE,
+	REZ_PROBE_INIT,
+	REZ_PROBE_MESSAGE,
+	REZ_PROBE_BANDS,
+	REZ_PROBE_HISTORY,
+	REZ_PROBE_DECISION,
+	REZ_PROBE_DRAW,
+	REZ_PROBE_ACTUATE,
+	REZ_PROBE_DISCOVER,
+	REZ_PROBES
+};
+
+#define REZ_PROBE_NONE -1
+
+#if REZ_INSTRUMENT
+
+#if defined( _MSC_VER )
+typedef unsigned __int64 RezTicks;
+#else
+typedef unsigned long long RezTicks;
+#endif
+
+extern RezTicks RezTicksNow( void );
+extern void RezInstrumentRecord( int probe, RezTicks elapsed );
+extern RezTicks RezInstrumentLap( int probe, RezTicks start );
+extern void RezInstrumentDump( const char *directory );
+extern int RezInstrumentHandle( int probe );
+extern int RezInstrumentHandling( void );
+extern const char *RezInstrumentName( int probe );
+extern void RezInstrumentAllocation( void );
+
+#define REZ_PROBE( name ) RezTicks name;
+#define REZ_PROBE_START( name ) ( name = RezTicksNow() )
+#define REZ_PROBE_STOP( name, probe ) RezInstrumentRecord( ( probe ), RezTicksNow() - name )
+#define REZ_PROBE_LAP( name, probe ) ( name = RezInstrumentLap( ( probe ), name ) )
+#define REZ_INSTRUMENT_DUMP( directory ) RezInstrumentDump( directory )
+#define REZ_HANDLER( name ) int name;
+#define REZ_HANDLER_START( name, probe ) ( name = RezInstrumentHandle( probe ) )
+#define REZ_HANDLER_STOP( name ) ( ( void ) RezInstrumentHandle( name ) )
+#define REZ_ALLOCATION() RezInstrumentAllocation()
+
+#else
+
+#define REZ_PROBE( name )
+#define REZ_PROBE_START( name ) ( ( void ) 0 )
+#define REZ_PROBE_STOP( name, probe ) ( ( void ) 0 )
+#define REZ_PROBE_LAP( name, probe ) ( ( void ) 0 )
+#define REZ_INSTRUMENT_DUMP( directory ) ( ( void ) 0 )
+#define REZ_HANDLER( name )
+#define REZ_HANDLER_START( name, probe ) ( ( void ) 0 )
+#define REZ_HANDLER_STOP( name ) ( ( void ) 0 )
+#define REZ_ALLOCATION() ( ( void ) 0 )
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZINSTRUMENT_H_ */
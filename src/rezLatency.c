@@ -0,0 +1,105 @@
+/*
+ *  rezLatency.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezLatency.h"
+
+#if defined( _WIN32 )
+#define REZ_SEPARATOR "\\"
+#else
+#define REZ_SEPARATOR "/"
+#endif
+
+static const char *stageNames[ REZ_LATENCY_STAGES ] = {
+	"delivery", "detect", "decide", "queue", "write", "total"
+};
+
+void RezLatencyClear( RezLatency *latency )
+{
+	memset( latency, 0, sizeof( RezLatency ) );
+}
+
+void RezLatencyRecord( RezLatency *latency, int stage, RezTime elapsed )
+{
+	RezLatencyHistogram *histogram = &latency->stage[ stage ];
+	RezTime us = elapsed / 1000;
+	unsigned int clamped = us > 0xffffffffUL ? 0xffffffffUL : ( unsigned int ) us;
+	int bucket = 0;
+
+	while( bucket < REZ_LATENCY_BUCKETS - 1 && ( clamped >> ( bucket + 1 ) ) != 0 ) bucket++;
+	histogram->bucket[ bucket ]++;
+	if( clamped > histogram->mostUS ) histogram->mostUS = clamped;
+	histogram->totalUS += us;
+	histogram->count++;
+}
+
+/*
+ * A trace whose times are out of order, from a clock read on another
+ * core going backwards, counts as no time at all rather than most of the
+ * clock's range.
+ */
+
+static RezTime RezLatencyBetween( RezTime from, RezTime to )
+{
+	return to > from ? to - from : 0;
+}
+
+void RezLatencyTrace( RezLatency *latency, const RezTrace *trace )
+{
+	RezLatencyRecord( latency, REZ_LATENCY_QUEUE, RezLatencyBetween( trace->queued, trace->started ) );
+	RezLatencyRecord( latency, REZ_LATENCY_WRITE, RezLatencyBetween( trace->started, trace->completed ) );
+	RezLatencyRecord( latency, REZ_LATENCY_TOTAL, RezLatencyBetween( trace->arrived, trace->completed ) );
+}
+
+/*
+ * Read off as the top of the bucket the percentile falls in, so within a
+ * factor of two and never under, though never past the worst seen.
+ */
+
+unsigned int RezLatencyPercentile( const RezLatencyHistogram *histogram, double fraction )
+{
+	unsigned int wanted = ( unsigned int ) ( histogram->count * fraction ), seen = 0, top;
+	int bucket;
+
+	for( bucket = 0; bucket < REZ_LATENCY_BUCKETS - 1; bucket++ )
+	{
+		seen += histogram->bucket[ bucket ];
+		if( seen > wanted ) break;
+	}
+	top = ( 2u << bucket ) - 1;
+	return top < histogram->mostUS ? top : histogram->mostUS;
+}
+
+void RezLatencyPrint( const RezLatency *latency, FILE *out )
+{
+	int s;
+
+	fprintf( out, "stage\tcount\tmean\tp50\tp99\tmax\t(us)\n" );
+	for( s = 0; s < REZ_LATENCY_STAGES; s++ )
+	{
+		const RezLatencyHistogram *histogram = &latency->stage[ s ];
+
+		if( histogram->count == 0 ) continue;
+		fprintf( out, "%s\t%u\t%.0f\t%u\t%u\t%u\n", stageNames[ s ], histogram->count,
+				 ( double ) histogram->totalUS / histogram->count, RezLatencyPercentile( histogram, 0.5 ),
+				 RezLatencyPercentile( histogram, 0.99 ), histogram->mostUS );
+	}
+	fprintf( out, "superseded\t%u\nfailed\t%u\n", latency->superseded, latency->failed );
+}
+
+void RezLatencyDump( const RezLatency *latency, const char *directory )
+{
+	char path[ 1024 ];
+	FILE *out = NULL;
+
+	if( directory != NULL && strlen( directory ) + 16 < sizeof( path ) )
+	{
+		sprintf( path, "%s" REZ_SEPARATOR "latency.txt", directory );
+		out = fopen( path, "w" );
+	}
+	if( out == NULL ) out = stderr;
+	RezLatencyPrint( latency, out );
+	if( out != stderr ) fclose( out );
+}
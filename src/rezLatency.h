@@ -0,0 +1,112 @@
+/*
+ *  rezLatency.h
+ *  rezTunes
+ *
+ *  Where the time goes between iTunes handing over a frame of audio and
+ *  the motor being told what to do about it.  Every message carries a
+ *  trace of monotonic times through each stage, and each stage's share is
+ *  kept as a log2 histogram in microseconds.
+ *
+ *  The stages are:
+ *    delivery - how much later than its best case lately a render message
+ *      arrived, judged against the playback position it carries
+ *    detect   - arrival to the end of the band and history work
+ *    decide   - detection to the motor speed being chosen
+ *    queue    - the speed being handed to the actuator thread to that
+ *      thread starting the USB write
+ *    write    - the USB write itself
+ *    total    - arrival to the write completing
+ *
+ *  The first three are only ever recorded by the thread handling plugin
+ *  messages and the rest only by the actuator thread, so neither ever
+ *  waits for the other.  The layout uses fixed size fields only, so the
+ *  histograms can live in shared memory for outside tools to read.
+ */
+
+#ifndef REZLATENCY_H_
+#define REZLATENCY_H_
+
+#include <stdio.h>
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	REZ_LATENCY_DELIVERY = 0,
+	REZ_LATENCY_DETECT,
+	REZ_LATENCY_DECIDE,
+	REZ_LATENCY_QUEUE,
+	REZ_LATENCY_WRITE,
+	REZ_LATENCY_TOTAL,
+	REZ_LATENCY_STAGES
+};
+
+/*
+ * REZ_LATENCY_BUCKETS - One bucket per power of two microseconds, which
+ *   reaches past an hour.
+ */
+
+#define REZ_LATENCY_BUCKETS 32
+
+/*
+ * The times a speed passed through on its way to the motor.  Messages
+ * other than render messages have no stamp and are detected and decided
+ * the moment they arrive.
+ */
+
+struct RezTrace {
+	unsigned int		stamp;
+	unsigned int		reserved;
+	RezTime				arrived;
+	RezTime				detected;
+	RezTime				decided;
+	RezTime				queued;
+	RezTime				started;
+	RezTime				completed;
+};
+typedef struct RezTrace RezTrace;
+
+struct RezLatencyHistogram {
+	RezTime				totalUS;
+	unsigned int		count;
+	unsigned int		mostUS;
+	unsigned int		bucket[ REZ_LATENCY_BUCKETS ];
+};
+typedef struct RezLatencyHistogram RezLatencyHistogram;
+
+/*
+ * superseded counts speeds that were replaced by a newer one before the
+ * actuator thread got to them, and failed counts writes the device
+ * refused.
+ */
+
+struct RezLatency {
+	RezLatencyHistogram	stage[ REZ_LATENCY_STAGES ];
+	unsigned int		superseded;
+	unsigned int		failed;
+};
+typedef struct RezLatency RezLatency;
+
+/*
+ * RezLatencyRecord adds one measurement to a stage.  RezLatencyTrace adds
+ * the queue, write and total stages of a finished trace.
+ *
+ * RezLatencyPrint writes a table of every stage with anything in it.
+ * RezLatencyDump writes the same to latency.txt in directory, or to
+ * stderr if directory is NULL or the file cannot be written.
+ */
+
+extern void RezLatencyClear( RezLatency *latency );
+extern void RezLatencyRecord( RezLatency *latency, int stage, RezTime elapsed );
+extern void RezLatencyTrace( RezLatency *latency, const RezTrace *trace );
+extern unsigned int RezLatencyPercentile( const RezLatencyHistogram *histogram, double fraction );
+extern void RezLatencyPrint( const RezLatency *latency, FILE *out );
+extern void RezLatencyDump( const RezLatency *latency, const char *directory );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZLATENCY_H_ */
@@ -0,0 +1,178 @@
+/*
+ *  rezLookahead.c
+ *  rezTunes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rezInstrument.h"
+#include "rezLookahead.h"
+
+/*
+ * Take the next job off the queue, or wait for one.  Returns zero when
+ * the worker should stop.
+ */
+
+static int RezLookaheadNext( RezLookahead *lookahead )
+{
+	for( ;; )
+	{
+		if( RezAtomicLoad( &lookahead->stop ) ) return 0;
+
+		RezMutexLock( &lookahead->lock );
+		if( lookahead->queued > 0 )
+		{
+			lookahead->job = lookahead->queue[ 0 ];
+			lookahead->queued--;
+			memmove( &lookahead->queue[ 0 ], &lookahead->queue[ 1 ], lookahead->queued * sizeof( RezLookaheadJob ) );
+			lookahead->busy = 1;
+			lookahead->busyKey = lookahead->job.key;
+			RezAtomicStore( &lookahead->cancel, 0 );
+			RezMutexUnlock( &lookahead->lock );
+			return 1;
+		}
+		RezMutexUnlock( &lookahead->lock );
+		RezSignalWait( &lookahead->wake, -1 );
+	}
+}
+
+/*
+ * A map is only ever handed over whole, by swapping the worker's buffer
+ * with the finished one.  If the last one was never collected it is out
+ * of date by now, and is analysed over next time.
+ */
+
+static void RezLookaheadMain( void *argument )
+{
+	RezLookahead *lookahead = ( RezLookahead * ) argument;
+
+	while( RezLookaheadNext( lookahead ) )
+	{
+		RezAudio audio;
+		unsigned long count = 0;
+		int complete = 0;
+
+		if( RezAudioOpen( &audio, lookahead->job.path ) )
+		{
+			complete = RezAnalyzeAudio( &lookahead->analyzer, &audio, lookahead->beats, lookahead->capacity, &count, &lookahead->cancel );
+			RezAudioClose( &audio );
+		}
+
+		RezMutexLock( &lookahead->lock );
+		lookahead->busy = 0;
+		if( complete )
+		{
+			RezBeat *finished = lookahead->beats;
+
+			lookahead->beats = lookahead->result;
+			lookahead->hasResult = 1;
+			lookahead->resultKey = lookahead->job.key;
+			lookahead->result = finished;
+			lookahead->resultCount = count;
+		}
+		RezMutexUnlock( &lookahead->lock );
+	}
+}
+
+int RezLookaheadStart( RezLookahead *lookahead, unsigned long capacity )
+{
+	memset( lookahead, 0, sizeof( RezLookahead ) );
+	lookahead->capacity = capacity;
+	REZ_ALLOCATION();
+	lookahead->buffers = ( RezBeat * ) malloc( 3 * capacity * sizeof( RezBeat ) );
+	if( lookahead->buffers == NULL ) return 0;
+	lookahead->beats = lookahead->buffers;
+	lookahead->result = lookahead->buffers + capacity;
+	lookahead->collected = lookahead->buffers + 2 * capacity;
+	RezAnalyzerInit( &lookahead->analyzer );
+	if( !RezSignalInit( &lookahead->wake ) )
+	{
+		free( lookahead->buffers );
+		return 0;
+	}
+	RezMutexInit( &lookahead->lock );
+	if( !RezThreadStart( &lookahead->thread, RezLookaheadMain, lookahead, REZ_PRIORITY_LOW ) )
+	{
+		RezMutexDestroy( &lookahead->lock );
+		RezSignalDestroy( &lookahead->wake );
+		free( lookahead->buffers );
+		return 0;
+	}
+	return 1;
+}
+
+void RezLookaheadStop( RezLookahead *lookahead )
+{
+	RezAtomicStore( &lookahead->stop, 1 );
+	RezAtomicStore( &lookahead->cancel, 1 );
+	RezSignalRaise( &lookahead->wake );
+	RezThreadJoin( &lookahead->thread );
+
+	RezMutexDestroy( &lookahead->lock );
+	RezSignalDestroy( &lookahead->wake );
+	free( lookahead->buffers );
+	lookahead->buffers = NULL;
+	lookahead->hasResult = 0;
+}
+
+void RezLookaheadQueue( RezLookahead *lookahead, RezTrackKey key, const char *path, int urgent )
+{
+	RezLookaheadJob *job;
+	int i, oldest;
+
+	if( strlen( path ) >= REZ_CACHE_PATH ) return;
+
+	RezMutexLock( &lookahead->lock );
+	if( lookahead->busy && lookahead->busyKey == key )
+	{
+		RezMutexUnlock( &lookahead->lock );
+		return;
+	}
+	for( i = 0; i < lookahead->queued && lookahead->queue[ i ].key != key; i++ ) ;
+	if( i == REZ_LOOKAHEAD_QUEUE )
+	{
+		for( i = 0, oldest = 1; oldest < lookahead->queued; oldest++ )
+			if( lookahead->queue[ oldest ].queuedAt < lookahead->queue[ i ].queuedAt ) i = oldest;
+	}
+	if( i < lookahead->queued )
+	{
+		lookahead->queued--;
+		memmove( &lookahead->queue[ i ], &lookahead->queue[ i + 1 ], ( lookahead->queued - i ) * sizeof( RezLookaheadJob ) );
+	}
+	if( urgent )
+	{
+		memmove( &lookahead->queue[ 1 ], &lookahead->queue[ 0 ], lookahead->queued * sizeof( RezLookaheadJob ) );
+		job = &lookahead->queue[ 0 ];
+		if( lookahead->busy ) RezAtomicStore( &lookahead->cancel, 1 );
+	}
+	else
+		job = &lookahead->queue[ lookahead->queued ];
+	job->key = key;
+	job->queuedAt = lookahead->queuedCount++;
+	strcpy( job->path, path );
+	lookahead->queued++;
+	RezMutexUnlock( &lookahead->lock );
+
+	RezSignalRaise( &lookahead->wake );
+}
+
+int RezLookaheadCollect( RezLookahead *lookahead, RezTrackKey *key, RezBeat **beats, unsigned long *count )
+{
+	int collected = 0;
+
+	RezMutexLock( &lookahead->lock );
+	if( lookahead->hasResult )
+	{
+		RezBeat *finished = lookahead->result;
+
+		lookahead->result = lookahead->collected;
+		lookahead->collected = finished;
+		*key = lookahead->resultKey;
+		*beats = finished;
+		*count = lookahead->resultCount;
+		lookahead->hasResult = 0;
+		collected = 1;
+	}
+	RezMutexUnlock( &lookahead->lock );
+	return collected;
+}
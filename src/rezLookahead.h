@@ -0,0 +1,87 @@
+/*
+ *  rezLookahead.h
+ *  rezTunes
+ *
+ *  Background analysis of tracks ahead of playback.  One low priority
+ *  worker thread decodes a track's file and runs the offline detector
+ *  over all of it, typically in a second or two per minute of music, and
+ *  leaves the beat map for the plugin to pick up and store.  Nothing here
+ *  touches the beat cache, so the cache only ever has one thread in it.
+ */
+
+#ifndef REZLOOKAHEAD_H_
+#define REZLOOKAHEAD_H_
+
+#include "rezAnalyze.h"
+#include "rezThread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * REZ_LOOKAHEAD_QUEUE - Tracks that may be waiting for analysis at once.
+ *   The track that has waited longest is dropped to make room for a new
+ *   one, wherever it is in the queue.
+ */
+
+#define REZ_LOOKAHEAD_QUEUE 2
+
+struct RezLookaheadJob {
+	RezTrackKey			key;
+	unsigned long		queuedAt;
+	char				path[ REZ_CACHE_PATH ];
+};
+typedef struct RezLookaheadJob RezLookaheadJob;
+
+struct RezLookahead {
+	RezThread			thread;
+	RezMutex			lock;
+	RezSignal			wake;
+	RezAtomic			stop;
+	RezAtomic			cancel;
+
+	/* Protected by lock */
+	RezLookaheadJob		queue[ REZ_LOOKAHEAD_QUEUE ];
+	int					queued;
+	unsigned long		queuedCount;
+	int					busy;
+	RezTrackKey			busyKey;
+	int					hasResult;
+	RezTrackKey			resultKey;
+	RezBeat				*result;
+	unsigned long		resultCount;
+	RezBeat				*collected;
+
+	/* Worker only */
+	RezLookaheadJob		job;
+	RezAnalyzer			analyzer;
+	RezBeat				*beats;
+	unsigned long		capacity;
+
+	RezBeat				*buffers;
+};
+typedef struct RezLookahead RezLookahead;
+
+/*
+ * capacity is the most beats a track may have.  Room for three maps is
+ * allocated up front, one being analysed, one finished and one collected,
+ * so handing them over never allocates.  RezLookaheadQueue puts a track
+ * at the back of the queue, or with urgent set at the front, abandoning
+ * the track being analysed unless it is the same one.
+ *
+ * RezLookaheadCollect hands over a finished beat map, if there is one.
+ * It does not wait for analysis in progress.  The beats stay the
+ * caller's to read until it next collects.
+ */
+
+extern int RezLookaheadStart( RezLookahead *lookahead, unsigned long capacity );
+extern void RezLookaheadStop( RezLookahead *lookahead );
+extern void RezLookaheadQueue( RezLookahead *lookahead, RezTrackKey key, const char *path, int urgent );
+extern int RezLookaheadCollect( RezLookahead *lookahead, RezTrackKey *key, RezBeat **beats, unsigned long *count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZLOOKAHEAD_H_ */
@@ -0,0 +1,130 @@
+/*
+ *  rezMap.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezMap.h"
+
+#if defined( _WIN32 )
+
+#include <windows.h>
+
+int RezMapFile( RezMapping *mapping, const char *path, unsigned long size, int writable )
+{
+	memset( mapping, 0, sizeof( RezMapping ) );
+	mapping->file = CreateFileA( path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+								 writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( mapping->file == INVALID_HANDLE_VALUE ) goto fail;
+
+	if( writable )
+	{
+		if( GetFileSize( mapping->file, NULL ) < size )
+		{
+			if( SetFilePointer( mapping->file, size, NULL, FILE_BEGIN ) == INVALID_SET_FILE_POINTER ) goto fail;
+			if( !SetEndOfFile( mapping->file ) ) goto fail;
+		}
+	}
+	size = GetFileSize( mapping->file, NULL );
+	if( size == 0 || size == INVALID_FILE_SIZE ) goto fail;
+
+	mapping->map = CreateFileMappingA( mapping->file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL );
+	if( mapping->map == NULL ) goto fail;
+	mapping->base = MapViewOfFile( mapping->map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0 );
+	if( mapping->base == NULL ) goto fail;
+	mapping->size = size;
+	return 1;
+
+fail:
+	RezUnmap( mapping );
+	return 0;
+}
+
+void RezUnmap( RezMapping *mapping )
+{
+	if( mapping->base != NULL ) UnmapViewOfFile( mapping->base );
+	if( mapping->map != NULL ) CloseHandle( mapping->map );
+	if( mapping->file != NULL && mapping->file != INVALID_HANDLE_VALUE ) CloseHandle( mapping->file );
+	memset( mapping, 0, sizeof( RezMapping ) );
+}
+
+void RezMapLock( RezMapping *mapping )
+{
+	OVERLAPPED whole;
+
+	memset( &whole, 0, sizeof( whole ) );
+	LockFileEx( mapping->file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole );
+}
+
+void RezMapUnlock( RezMapping *mapping )
+{
+	OVERLAPPED whole;
+
+	memset( &whole, 0, sizeof( whole ) );
+	UnlockFileEx( mapping->file, 0, MAXDWORD, MAXDWORD, &whole );
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int RezMapFile( RezMapping *mapping, const char *path, unsigned long size, int writable )
+{
+	struct stat info;
+	void *base;
+
+	memset( mapping, 0, sizeof( RezMapping ) );
+	mapping->fd = open( path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644 );
+	if( mapping->fd < 0 ) return 0;
+
+	if( fstat( mapping->fd, &info ) < 0 ) goto fail;
+	if( writable && ( unsigned long ) info.st_size < size )
+	{
+		if( ftruncate( mapping->fd, size ) < 0 ) goto fail;
+		info.st_size = size;
+	}
+	if( info.st_size == 0 ) goto fail;
+
+	base = mmap( NULL, info.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, mapping->fd, 0 );
+	if( base == MAP_FAILED ) goto fail;
+	mapping->base = base;
+	mapping->size = info.st_size;
+	return 1;
+
+fail:
+	close( mapping->fd );
+	memset( mapping, 0, sizeof( RezMapping ) );
+	return 0;
+}
+
+void RezUnmap( RezMapping *mapping )
+{
+	if( mapping->base != NULL )
+	{
+		munmap( mapping->base, mapping->size );
+		close( mapping->fd );
+	}
+	memset( mapping, 0, sizeof( RezMapping ) );
+}
+
+/*
+ * flock locks belong to the open file, so instances in one process that
+ * each opened the index keep each other out as separate processes do.
+ */
+
+void RezMapLock( RezMapping *mapping )
+{
+	while( flock( mapping->fd, LOCK_EX ) < 0 && errno == EINTR ) ;
+}
+
+void RezMapUnlock( RezMapping *mapping )
+{
+	flock( mapping->fd, LOCK_UN );
+}
+
+#endif
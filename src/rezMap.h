@@ -0,0 +1,50 @@
+/*
+ *  rezMap.h
+ *  rezTunes
+ *
+ *  Memory mapped files, on top of mmap or CreateFileMapping.
+ */
+
+#ifndef REZMAP_H_
+#define REZMAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct RezMapping {
+	void				*base;
+	unsigned long		size;
+#if defined( _WIN32 )
+	void				*file;
+	void				*map;
+#else
+	int					fd;
+#endif
+};
+typedef struct RezMapping RezMapping;
+
+/*
+ * With writable set the file is created if need be and grown to size.
+ * Otherwise size is ignored and the whole existing file is mapped read
+ * only.  Returns 0 on failure, leaving the mapping empty.
+ */
+
+extern int RezMapFile( RezMapping *mapping, const char *path, unsigned long size, int writable );
+extern void RezUnmap( RezMapping *mapping );
+
+/*
+ * RezMapLock waits for and takes an exclusive lock on a mapped file, for
+ * when several processes or instances change the same one, and
+ * RezMapUnlock gives it up.  The lock is advisory: only other callers of
+ * RezMapLock are kept out.
+ */
+
+extern void RezMapLock( RezMapping *mapping );
+extern void RezMapUnlock( RezMapping *mapping );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZMAP_H_ */
@@ -0,0 +1,90 @@
+/*
+ *  rezMotor.c
+ *  rezTunes
+ */
+
+#include <math.h>
+#include <string.h>
+#include "rezMotor.h"
+
+void RezMotorInit( RezMotor *motor, double latencyMS, double jitterMS, double spinUpMS, double spinDownMS )
+{
+	memset( motor, 0, sizeof( RezMotor ) );
+	motor->latencyMS = latencyMS;
+	motor->jitterMS = jitterMS;
+	motor->spinUpMS = spinUpMS > 0 ? spinUpMS : 1;
+	motor->spinDownMS = spinDownMS > 0 ? spinDownMS : 1;
+	motor->seed = 1;
+}
+
+/*
+ * Between commands landing the target is fixed, so the rotor closes on it
+ * exponentially from wherever it was, from one side the whole way.
+ */
+
+static void RezMotorRun( RezMotor *motor, double timeMS )
+{
+	double elapsed = timeMS - motor->timeMS, tau;
+
+	if( elapsed <= 0 ) return;
+	tau = motor->target > motor->rotor ? motor->spinUpMS : motor->spinDownMS;
+	motor->rotor = motor->target + ( motor->rotor - motor->target ) * exp( -elapsed / tau );
+	motor->timeMS = timeMS;
+}
+
+/*
+ * What the rotor heads for once a speed lands.
+ */
+
+static int RezMotorTarget( const RezMotor *motor, int speed )
+{
+	return speed < motor->stall ? 0 : speed;
+}
+
+/*
+ * The jitter comes from the motor's own generator, so a run is the same
+ * every time and does not depend on who else calls rand.
+ */
+
+double RezMotorCommand( RezMotor *motor, double timeMS, int speed )
+{
+	RezMotorTransfer *transfer;
+	double landMS = timeMS + motor->latencyMS;
+
+	if( motor->jitterMS > 0 )
+	{
+		motor->seed = motor->seed * 1103515245 + 12345;
+		landMS += motor->jitterMS * ( ( motor->seed >> 16 ) & 0x7fff ) / 32767.0;
+	}
+	if( landMS < motor->lastLandMS ) landMS = motor->lastLandMS;
+	motor->lastLandMS = landMS;
+
+	if( motor->inFlight == REZ_MOTOR_PENDING )
+	{
+		transfer = &motor->pending[ motor->oldest ];
+		RezMotorRun( motor, transfer->landMS );
+		motor->target = RezMotorTarget( motor, transfer->speed );
+		motor->oldest = ( motor->oldest + 1 ) % REZ_MOTOR_PENDING;
+		motor->inFlight--;
+	}
+	transfer = &motor->pending[ ( motor->oldest + motor->inFlight ) % REZ_MOTOR_PENDING ];
+	transfer->landMS = landMS;
+	transfer->speed = speed < 0 ? 0 : speed > 255 ? 255 : speed;
+	motor->inFlight++;
+	return landMS;
+}
+
+double RezMotorAdvance( RezMotor *motor, double timeMS )
+{
+	while( motor->inFlight > 0 && motor->pending[ motor->oldest ].landMS <= timeMS )
+	{
+		RezMotorTransfer *transfer = &motor->pending[ motor->oldest ];
+
+		RezMotorRun( motor, transfer->landMS );
+		motor->target = RezMotorTarget( motor, transfer->speed );
+		motor->oldest = ( motor->oldest + 1 ) % REZ_MOTOR_PENDING;
+		motor->inFlight--;
+	}
+	RezMotorRun( motor, timeMS );
+	return motor->rotor;
+}
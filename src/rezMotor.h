@@ -0,0 +1,86 @@
+/*
+ *  rezMotor.h
+ *  rezTunes
+ *
+ *  A model of the vibrator's motor, for judging how well what we send it
+ *  turns into what is felt without one on the desk.  The rotor follows
+ *  its target speed as a first order lag, with one time constant spinning
+ *  up and a slower one spinning down.  A command only takes effect after
+ *  its USB transfer, which takes a fixed latency plus up to a jitter more
+ *  milliseconds, and transfers complete in the order they were sent.
+ *  Speeds under the stall speed are too weak to turn the rotor, and it
+ *  winds down as if it had been told to stop.
+ *
+ *  The model keeps its own time in milliseconds and never looks at a
+ *  clock, so it runs as fast as it is driven: offline, many thousands of
+ *  times faster than real time.
+ */
+
+#ifndef REZMOTOR_H_
+#define REZMOTOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Defaults, roughly those of a TrancEvibrator on a full speed port.
+ *   REZ_MOTOR_LATENCYMS, REZ_MOTOR_JITTERMS - USB transfer time.
+ *   REZ_MOTOR_SPINUPMS, REZ_MOTOR_SPINDOWNMS - Time constants: the
+ *     rotor covers about two thirds of the way to a new speed in this
+ *     long, rising and falling.
+ *   REZ_MOTOR_PENDING - Commands that may be in flight at once.  Past
+ *     this the oldest is taken to have landed already.
+ */
+
+#define REZ_MOTOR_LATENCYMS 4
+#define REZ_MOTOR_JITTERMS 2
+#define REZ_MOTOR_SPINUPMS 40
+#define REZ_MOTOR_SPINDOWNMS 120
+#define REZ_MOTOR_PENDING 64
+
+struct RezMotorTransfer {
+	double				landMS;
+	int					speed;
+};
+typedef struct RezMotorTransfer RezMotorTransfer;
+
+struct RezMotor {
+	double				latencyMS;
+	double				jitterMS;
+	double				spinUpMS;
+	double				spinDownMS;
+	int					stall;
+	unsigned int		seed;
+
+	double				timeMS;
+	double				rotor;
+	int					target;
+	double				lastLandMS;
+	RezMotorTransfer	pending[ REZ_MOTOR_PENDING ];
+	int					oldest;
+	int					inFlight;
+};
+typedef struct RezMotor RezMotor;
+
+/*
+ * RezMotorInit starts the motor stopped at time zero, with a stall speed
+ * of 0 that every speed turns.  Set stall afterwards for a motor that
+ * needs more.
+ *
+ * RezMotorCommand sends a speed at timeMS, which must not be before the
+ * last time the motor was driven to, and returns when it will land.
+ *
+ * RezMotorAdvance runs the model on to timeMS, landing every command due
+ * by then, and returns the rotor speed there, from 0 to 255.
+ */
+
+extern void RezMotorInit( RezMotor *motor, double latencyMS, double jitterMS, double spinUpMS, double spinDownMS );
+extern double RezMotorCommand( RezMotor *motor, double timeMS, int speed );
+extern double RezMotorAdvance( RezMotor *motor, double timeMS );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZMOTOR_H_ */
@@ -0,0 +1,122 @@
+/*
+ *  rezQueue.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezArena.h"
+#include "rezQueue.h"
+
+REZ_STATIC_ASSERT( queue_messages_power_of_two, ( REZ_QUEUE_MESSAGES & ( REZ_QUEUE_MESSAGES - 1 ) ) == 0 );
+REZ_STATIC_ASSERT( queue_reserve_leaves_room, REZ_QUEUE_RESERVED < REZ_QUEUE_MESSAGES && REZ_QUEUE_RESERVEDBUFFERS < REZ_QUEUE_BUFFERS );
+
+int RezQueueInit( RezQueue *queue, void *pool, unsigned long bufferSize )
+{
+	int i;
+
+	memset( queue, 0, sizeof( RezQueue ) );
+	queue->bufferSize = REZ_QUEUE_BUFFER( bufferSize );
+	queue->buffers = ( unsigned char * ) pool;
+	if( !RezSignalInit( &queue->wake ) ) return 0;
+	for( i = 0; i < REZ_QUEUE_MESSAGES; i++ ) queue->cell[ i ].sequence = i;
+	return 1;
+}
+
+void RezQueueDestroy( RezQueue *queue )
+{
+	RezMessage message;
+
+	while( RezQueueTake( queue, &message ) ) ;
+	RezSignalDestroy( &queue->wake );
+	queue->buffers = NULL;
+}
+
+/*
+ * The reserved buffers are the last ones, which ordinary claims never
+ * reach.
+ */
+
+int RezQueueClaim( RezQueue *queue, int urgent )
+{
+	int buffer, buffers = urgent ? REZ_QUEUE_BUFFERS : REZ_QUEUE_BUFFERS - REZ_QUEUE_RESERVEDBUFFERS;
+
+	for( buffer = 0; buffer < buffers; buffer++ )
+		if( RezAtomicCompareAndSwap( &queue->busy[ buffer ], 0, 1 ) ) return buffer;
+	return REZ_QUEUE_NONE;
+}
+
+void RezQueueRelease( RezQueue *queue, int buffer )
+{
+	if( buffer != REZ_QUEUE_NONE ) RezAtomicStore( &queue->busy[ buffer ], 0 );
+}
+
+/*
+ * A cell is free for the poster that holds position when its sequence is
+ * position, and full for the owner when it is position + 1.  Counts are
+ * compared as differences, which survives them wrapping.  An ordinary
+ * post also needs the cell REZ_QUEUE_RESERVED further on to be free, so
+ * at least that many are left behind it.
+ */
+
+static int RezQueueCellFree( RezQueue *queue, int position )
+{
+	RezQueueCell *cell = &queue->cell[ position & ( REZ_QUEUE_MESSAGES - 1 ) ];
+
+	return ( int ) ( ( unsigned int ) RezAtomicLoad( &cell->sequence ) - ( unsigned int ) position ) >= 0;
+}
+
+int RezQueuePost( RezQueue *queue, const RezMessage *message, int urgent )
+{
+	RezQueueCell *cell;
+	int position = RezAtomicLoad( &queue->tail ), difference;
+
+	for( ;; )
+	{
+		cell = &queue->cell[ position & ( REZ_QUEUE_MESSAGES - 1 ) ];
+		difference = ( int ) ( ( unsigned int ) RezAtomicLoad( &cell->sequence ) - ( unsigned int ) position );
+		if( difference == 0 && !urgent && !RezQueueCellFree( queue, ( int ) ( ( unsigned int ) position + REZ_QUEUE_RESERVED ) ) )
+			difference = -1;
+		if( difference == 0 )
+		{
+			if( RezAtomicCompareAndSwap( &queue->tail, position, ( int ) ( ( unsigned int ) position + 1 ) ) ) break;
+			position = RezAtomicLoad( &queue->tail );
+		}
+		else if( difference < 0 )
+		{
+			RezAtomicAdd( &queue->dropped, 1 );
+			return 0;
+		}
+		else
+			position = RezAtomicLoad( &queue->tail );
+	}
+
+	cell->message = *message;
+	RezAtomicStore( &cell->sequence, ( int ) ( ( unsigned int ) position + 1 ) );
+	if( RezAtomicExchange( &queue->sleeping, 0 ) ) RezSignalRaise( &queue->wake );
+	return 1;
+}
+
+int RezQueueTake( RezQueue *queue, RezMessage *message )
+{
+	RezQueueCell *cell = &queue->cell[ queue->head & ( REZ_QUEUE_MESSAGES - 1 ) ];
+
+	if( ( unsigned int ) RezAtomicLoad( &cell->sequence ) != queue->head + 1 ) return 0;
+	*message = cell->message;
+	RezAtomicStore( &cell->sequence, ( int ) ( queue->head + REZ_QUEUE_MESSAGES ) );
+	queue->head++;
+	return 1;
+}
+
+/*
+ * The owner says it is going to sleep before it looks one last time, so
+ * a post either lands before the look or sees it asleep and raises.
+ */
+
+void RezQueueWait( RezQueue *queue, int timeoutMS )
+{
+	RezQueueCell *cell = &queue->cell[ queue->head & ( REZ_QUEUE_MESSAGES - 1 ) ];
+
+	RezAtomicStore( &queue->sleeping, 1 );
+	if( ( unsigned int ) RezAtomicLoad( &cell->sequence ) != queue->head + 1 ) RezSignalWait( &queue->wake, timeoutMS );
+	RezAtomicStore( &queue->sleeping, 0 );
+}
@@ -0,0 +1,129 @@
+/*
+ *  rezQueue.h
+ *  rezTunes
+ *
+ *  Lock-free queue of messages from any number of threads to one owner
+ *  thread, which takes them in the order they were posted.  Posting never
+ *  waits: a full queue refuses the message.  The last few places, and the
+ *  last few buffers, are kept for urgent messages, so a flood of ordinary
+ *  ones cannot crowd them out.  The owner sleeps while the queue is
+ *  empty, and a post only raises its signal if it is asleep.
+ *
+ *  Anything too big for a message goes in one of a fixed pool of
+ *  buffers, in memory the caller provides, which the poster claims, fills and hands over
+ *  with the message, and the owner gives back once it is done with it.
+ *
+ *  The queue is a ring of cells each with its own sequence number, so
+ *  posters only contend on the one counter they take cells from, and a
+ *  cell is only read once the poster has finished writing it.
+ */
+
+#ifndef REZQUEUE_H_
+#define REZQUEUE_H_
+
+#include "rezAtomic.h"
+#include "rezThread.h"
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * REZ_QUEUE_MESSAGES - Messages that can wait at once.  A power of two.
+ * REZ_QUEUE_BUFFERS - Buffers in the pool.
+ * REZ_QUEUE_RESERVED - Of the messages, how many only urgent ones may
+ *   take.
+ * REZ_QUEUE_RESERVEDBUFFERS - Likewise for buffers.
+ * REZ_QUEUE_NONE - The buffer of a message that has none.
+ */
+
+#define REZ_QUEUE_MESSAGES 64
+#define REZ_QUEUE_BUFFERS 8
+#define REZ_QUEUE_RESERVED 16
+#define REZ_QUEUE_RESERVEDBUFFERS 2
+#define REZ_QUEUE_NONE -1
+
+/*
+ * Buffers start on a multiple of REZ_QUEUE_ALIGN, so whatever goes in
+ * them is aligned.  REZ_QUEUE_POOL is the memory a pool of buffers of
+ * size bytes takes.
+ */
+
+#define REZ_QUEUE_ALIGN 16
+#define REZ_QUEUE_BUFFER( size ) ( ( ( unsigned long ) ( size ) + REZ_QUEUE_ALIGN - 1 ) / REZ_QUEUE_ALIGN * REZ_QUEUE_ALIGN )
+#define REZ_QUEUE_POOL( size ) ( REZ_QUEUE_BUFFER( size ) * REZ_QUEUE_BUFFERS )
+
+/*
+ * type and the values are the poster's to use as it likes; arrived is
+ * when the message reached the poster, for tracing.
+ */
+
+struct RezMessage {
+	unsigned long		type;
+	int					buffer;
+	unsigned long		stamp;
+	unsigned long		positionMS;
+	long				value;
+	RezTime				arrived;
+};
+typedef struct RezMessage RezMessage;
+
+struct RezQueueCell {
+	RezAtomic			sequence;
+	RezMessage			message;
+};
+typedef struct RezQueueCell RezQueueCell;
+
+struct RezQueue {
+	RezQueueCell		cell[ REZ_QUEUE_MESSAGES ];
+	RezAtomic			tail;
+	RezAtomic			dropped;
+	RezAtomic			sleeping;
+	RezSignal			wake;
+	RezAtomic			busy[ REZ_QUEUE_BUFFERS ];
+	unsigned char		*buffers;
+	unsigned long		bufferSize;
+
+	/* Owner only */
+	unsigned int		head;
+};
+typedef struct RezQueue RezQueue;
+
+/*
+ * RezQueueInit makes an empty queue with a pool of buffers of bufferSize
+ * bytes each in pool, which must be REZ_QUEUE_POOL( bufferSize ) bytes,
+ * aligned to REZ_QUEUE_ALIGN, and last as long as the queue.  It returns
+ * 0 if it cannot.  RezQueueDestroy undoes it; nothing may be posting.
+ *
+ * RezQueueClaim takes a free buffer from the pool, or returns
+ * REZ_QUEUE_NONE if they are all in use, or all but the reserved ones
+ * unless urgent is set.  RezQueueBuffer is where it is.  RezQueueRelease
+ * gives it back.
+ *
+ * RezQueuePost adds a message, from any thread, and returns 0 if the
+ * queue is full, counting it in dropped.  Unless urgent is set, the queue
+ * counts as full while no more than REZ_QUEUE_RESERVED places are left.
+ * The message's buffer, if it has one, is then the owner's.
+ *
+ * The rest are for the owner only.  RezQueueTake takes the oldest
+ * message, returning 0 if there is none.  RezQueueWait sleeps until a
+ * message is posted or timeoutMS passes, or for good with a negative one,
+ * and returns at once if one is already waiting.
+ */
+
+extern int RezQueueInit( RezQueue *queue, void *pool, unsigned long bufferSize );
+extern void RezQueueDestroy( RezQueue *queue );
+extern int RezQueueClaim( RezQueue *queue, int urgent );
+extern void RezQueueRelease( RezQueue *queue, int buffer );
+extern int RezQueuePost( RezQueue *queue, const RezMessage *message, int urgent );
+extern int RezQueueTake( RezQueue *queue, RezMessage *message );
+extern void RezQueueWait( RezQueue *queue, int timeoutMS );
+
+#define RezQueueBuffer( queue, buffer ) ( ( void * ) ( ( queue )->buffers + ( unsigned long ) ( buffer ) * ( queue )->bufferSize ) )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZQUEUE_H_ */
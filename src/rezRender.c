@@ -0,0 +1,482 @@
+/*
+ *  rezRender.c
+ *  rezTunes
+ *
+ *  Software renderer with dirty tracking.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rezInstrument.h"
+#include "rezRender.h"
+
+#if REZ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Diagnostic visualiser layout, as fractions of the window.
+ *
+ *   REZ_HISTORY_COLUMNS - Frames shown in the history strip, 5 seconds.
+ *   REZ_MARKER - Thickness of the average and threshold markers in pixels.
+ */
+
+#define REZ_HISTORY_COLUMNS 200
+#define REZ_MARKER 2
+
+#define REZ_BACKGROUND		REZ_RGB( 16, 16, 16 )
+#define REZ_BAR				REZ_RGB( 60, 140, 220 )
+#define REZ_AVERAGE			REZ_RGB( 240, 240, 240 )
+#define REZ_THRESHOLD		REZ_RGB( 240, 80, 60 )
+#define REZ_BEAT			REZ_RGB( 255, 220, 0 )
+#define REZ_LAMP_OFF		REZ_RGB( 40, 40, 40 )
+#define REZ_CURSOR			REZ_RGB( 90, 90, 90 )
+#define REZ_MOTOR			REZ_RGB( 200, 200, 200 )
+#define REZ_MOTOR_NOVIBE	REZ_RGB( 220, 40, 40 )
+
+struct RezLayout {
+	int					barsRight;
+	int					barsBottom;
+	int					lampBottom;
+	int					slotWidth;
+	int					historyRowHeight;
+	int					columnWidth;
+};
+typedef struct RezLayout RezLayout;
+
+void RezFramebufferInit( RezFramebuffer *fb )
+{
+	memset( fb, 0, sizeof( RezFramebuffer ) );
+}
+
+/*
+ * Storage only ever grows, so resizing the window back and forth does not
+ * churn the allocator.  Any resize leaves the whole buffer dirty and forces
+ * the next frame to be drawn.  Returns 0 if memory could not be had.
+ */
+
+int RezFramebufferResize( RezFramebuffer *fb, int width, int height )
+{
+	int needed;
+
+	if( width < 0 ) width = 0;
+	if( height < 0 ) height = 0;
+	needed = width * height;
+
+	if( needed > fb->capacity )
+	{
+		RezPixel *pixels = ( RezPixel * ) malloc( needed * sizeof( RezPixel ) );
+
+		REZ_ALLOCATION();
+		if( pixels == NULL ) return 0;
+		free( fb->pixels );
+		fb->pixels = pixels;
+		fb->capacity = needed;
+	}
+
+	fb->width = width;
+	fb->height = height;
+	fb->stride = width;
+	fb->hasLastState = 0;
+	RezFramebufferInvalidate( fb );
+	return 1;
+}
+
+void RezFramebufferRelease( RezFramebuffer *fb )
+{
+	free( fb->pixels );
+	RezFramebufferInit( fb );
+}
+
+/*
+ * The window contents were lost, so everything must be copied again.
+ * The framebuffer itself is still good and need not be redrawn.
+ */
+
+void RezFramebufferInvalidate( RezFramebuffer *fb )
+{
+	fb->dirtyCount = 0;
+	if( fb->width > 0 && fb->height > 0 )
+	{
+		fb->dirty[ 0 ].left = fb->dirty[ 0 ].top = 0;
+		fb->dirty[ 0 ].right = fb->width;
+		fb->dirty[ 0 ].bottom = fb->height;
+		fb->dirtyCount = 1;
+	}
+}
+
+static void RezRectUnion( RezRect *into, const RezRect *r )
+{
+	if( r->left < into->left ) into->left = r->left;
+	if( r->top < into->top ) into->top = r->top;
+	if( r->right > into->right ) into->right = r->right;
+	if( r->bottom > into->bottom ) into->bottom = r->bottom;
+}
+
+static long RezRectArea( const RezRect *r )
+{
+	return ( long ) ( r->right - r->left ) * ( r->bottom - r->top );
+}
+
+/*
+ * Rectangles that touch or overlap one already recorded are folded into
+ * it.  Otherwise they are kept separately, so a handful of small changes
+ * far apart do not turn into a blit of everything between them.
+ */
+
+void RezFramebufferMarkDirty( RezFramebuffer *fb, const RezRect *rect )
+{
+	RezRect r = *rect;
+	long bestGrowth = -1;
+	int i, best = 0;
+
+	if( r.left < 0 ) r.left = 0;
+	if( r.top < 0 ) r.top = 0;
+	if( r.right > fb->width ) r.right = fb->width;
+	if( r.bottom > fb->height ) r.bottom = fb->height;
+	if( r.left >= r.right || r.top >= r.bottom ) return;
+
+	for( i = 0; i < fb->dirtyCount; i++ )
+	{
+		RezRect *d = &fb->dirty[ i ];
+
+		if( r.left <= d->right && r.right >= d->left && r.top <= d->bottom && r.bottom >= d->top )
+		{
+			RezRectUnion( d, &r );
+			return;
+		}
+	}
+	if( fb->dirtyCount < REZ_MAX_DIRTY )
+	{
+		fb->dirty[ fb->dirtyCount++ ] = r;
+		return;
+	}
+
+	for( i = 0; i < fb->dirtyCount; i++ )
+	{
+		RezRect merged = fb->dirty[ i ];
+		long growth;
+
+		RezRectUnion( &merged, &r );
+		growth = RezRectArea( &merged ) - RezRectArea( &fb->dirty[ i ] );
+		if( bestGrowth < 0 || growth < bestGrowth )
+		{
+			bestGrowth = growth;
+			best = i;
+		}
+	}
+	RezRectUnion( &fb->dirty[ best ], &r );
+}
+
+/*
+ * Fill a run of pixels.  With SSE2 the run is brought up to 16 byte
+ * alignment and then written sixteen pixels per iteration with aligned
+ * stores; the ragged ends are done one pixel at a time.
+ */
+
+void RezFillSpan( RezPixel *dst, int count, RezPixel colour )
+{
+#if REZ_HAVE_SSE2
+	__m128i c = _mm_set1_epi32( ( int ) colour );
+
+	while( count > 0 && ( ( ( unsigned long ) dst ) & 15 ) )
+	{
+		*dst++ = colour;
+		count--;
+	}
+	for( ; count >= 16; count -= 16, dst += 16 )
+	{
+		_mm_store_si128( ( __m128i * ) dst, c );
+		_mm_store_si128( ( __m128i * ) ( dst + 4 ), c );
+		_mm_store_si128( ( __m128i * ) ( dst + 8 ), c );
+		_mm_store_si128( ( __m128i * ) ( dst + 12 ), c );
+	}
+	for( ; count >= 4; count -= 4, dst += 4 )
+		_mm_store_si128( ( __m128i * ) dst, c );
+#endif
+	while( count-- > 0 ) *dst++ = colour;
+}
+
+void RezFramebufferFillRect( RezFramebuffer *fb, const RezRect *rect, RezPixel colour )
+{
+	RezRect r = *rect;
+	int y;
+
+	if( r.left < 0 ) r.left = 0;
+	if( r.top < 0 ) r.top = 0;
+	if( r.right > fb->width ) r.right = fb->width;
+	if( r.bottom > fb->height ) r.bottom = fb->height;
+	if( r.left >= r.right || r.top >= r.bottom ) return;
+
+	for( y = r.top; y < r.bottom; y++ )
+		RezFillSpan( fb->pixels + y * fb->stride + r.left, r.right - r.left, colour );
+	RezFramebufferMarkDirty( fb, &r );
+}
+
+/*
+ * Hand whatever is dirty to the blit backend.  Returns the number of
+ * rectangles copied.
+ */
+
+int RezFramebufferPresent( RezFramebuffer *fb, RezBlitProc blit, void *context )
+{
+	int i, count = fb->dirtyCount;
+
+	if( fb->pixels == NULL ) return 0;
+	for( i = 0; i < count; i++ ) blit( context, fb, &fb->dirty[ i ] );
+	fb->dirtyCount = 0;
+	return count;
+}
+
+/*
+ * Dump the framebuffer as a binary PPM, for screenshots of headless runs.
+ */
+
+int RezFramebufferWritePPM( const RezFramebuffer *fb, const char *path )
+{
+	FILE *file;
+	int x, y;
+
+	file = fopen( path, "wb" );
+	if( file == NULL ) return 0;
+
+	fprintf( file, "P6\n%d %d\n255\n", fb->width, fb->height );
+	for( y = 0; y < fb->height; y++ )
+	{
+		const RezPixel *row = fb->pixels + y * fb->stride;
+
+		for( x = 0; x < fb->width; x++ )
+		{
+			unsigned char rgb[ 3 ];
+
+			rgb[ 0 ] = ( unsigned char ) ( row[ x ] >> 16 );
+			rgb[ 1 ] = ( unsigned char ) ( row[ x ] >> 8 );
+			rgb[ 2 ] = ( unsigned char ) row[ x ];
+			fwrite( rgb, 1, 3, file );
+		}
+	}
+	return fclose( file ) == 0;
+}
+
+/*
+ * The window is split into three parts.  Across the top left are one bar
+ * per band, showing instant energy with markers for the historical average
+ * and the beat threshold, and a lamp above each that lights when the band
+ * fires.  Below them is a history strip, one row per band, swept left to
+ * right like an oscilloscope so that each frame only touches one column.
+ * Down the right hand side is the motor speed, grey with a vibrator
+ * attached and red without, with a marker at the onset confidence.
+ */
+
+static void RezComputeLayout( const RezFramebuffer *fb, RezLayout *layout )
+{
+	int meterWidth = fb->width / 16;
+
+	if( meterWidth < 4 ) meterWidth = 4;
+	layout->barsRight = fb->width - meterWidth;
+	if( layout->barsRight < 0 ) layout->barsRight = 0;
+	layout->barsBottom = fb->height * 2 / 3;
+	layout->lampBottom = layout->barsBottom / 16;
+	layout->slotWidth = layout->barsRight / FREQUENCYBANDS;
+	layout->historyRowHeight = ( fb->height - layout->barsBottom ) / FREQUENCYBANDS;
+	layout->columnWidth = layout->barsRight / REZ_HISTORY_COLUMNS;
+	if( layout->columnWidth < 1 ) layout->columnWidth = 1;
+}
+
+static int RezLevelToY( const RezLayout *layout, float level )
+{
+	int span = layout->barsBottom - layout->lampBottom;
+	int y;
+
+	if( level < 0 ) level = 0;
+	if( level > 255 ) level = 255;
+	y = layout->barsBottom - ( int ) ( level * span / 256.0f );
+	return y < layout->lampBottom ? layout->lampBottom : y;
+}
+
+/*
+ * Redraw a bar, touching only the rows between the lowest and highest of
+ * the old and new bar tops and markers.  A negative marker is not drawn.
+ * With full set the whole column is repainted.
+ */
+
+static void RezDrawBar( RezFramebuffer *fb, const RezLayout *layout, int left, int right, const int *before, const int *after, RezPixel colour, int full )
+{
+	int top = layout->lampBottom, bottom = layout->barsBottom;
+	int i, y;
+
+	if( right <= left ) return;
+	if( !full )
+	{
+		if( before[ 0 ] == after[ 0 ] && before[ 1 ] == after[ 1 ] && before[ 2 ] == after[ 2 ] ) return;
+		top = bottom;
+		bottom = 0;
+		for( i = 0; i < 3; i++ )
+		{
+			if( before[ i ] >= 0 && before[ i ] < top ) top = before[ i ];
+			if( after[ i ] >= 0 && after[ i ] < top ) top = after[ i ];
+			if( before[ i ] >= 0 && before[ i ] + REZ_MARKER > bottom ) bottom = before[ i ] + REZ_MARKER;
+			if( after[ i ] >= 0 && after[ i ] + REZ_MARKER > bottom ) bottom = after[ i ] + REZ_MARKER;
+		}
+		if( bottom > layout->barsBottom ) bottom = layout->barsBottom;
+	}
+
+	for( y = top; y < bottom; y++ )
+	{
+		RezPixel fill = ( y >= after[ 0 ] ) ? colour : REZ_BACKGROUND;
+
+		if( after[ 2 ] >= 0 && y >= after[ 2 ] && y < after[ 2 ] + REZ_MARKER ) fill = REZ_THRESHOLD;
+		if( after[ 1 ] >= 0 && y >= after[ 1 ] && y < after[ 1 ] + REZ_MARKER ) fill = REZ_AVERAGE;
+		RezFillSpan( fb->pixels + y * fb->stride + left, right - left, fill );
+	}
+	if( top < bottom )
+	{
+		RezRect dirty;
+
+		dirty.left = left;
+		dirty.right = right;
+		dirty.top = top;
+		dirty.bottom = bottom;
+		RezFramebufferMarkDirty( fb, &dirty );
+	}
+}
+
+static void RezBarPositions( const RezLayout *layout, const RezVisualState *state, int band, int *positions )
+{
+	positions[ 0 ] = RezLevelToY( layout, state->energy[ band ] );
+	positions[ 1 ] = RezLevelToY( layout, state->average[ band ] );
+	positions[ 2 ] = RezLevelToY( layout, state->threshold[ band ] );
+}
+
+/*
+ * Place a state part way between two detector frames, for drawing more
+ * often than the detector runs.  Levels move smoothly; beats and the
+ * history column belong to the newer frame.
+ */
+
+void RezVisualStateBlend( RezVisualState *out, const RezVisualState *from, const RezVisualState *to, float alpha )
+{
+	int band;
+
+	if( alpha < 0 ) alpha = 0;
+	if( alpha > 1 ) alpha = 1;
+
+	*out = *to;
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+	{
+		out->energy[ band ] = from->energy[ band ] + ( to->energy[ band ] - from->energy[ band ] ) * alpha;
+		out->average[ band ] = from->average[ band ] + ( to->average[ band ] - from->average[ band ] ) * alpha;
+		out->threshold[ band ] = from->threshold[ band ] + ( to->threshold[ band ] - from->threshold[ band ] ) * alpha;
+	}
+	out->confidence = from->confidence + ( to->confidence - from->confidence ) * alpha;
+	out->motorSpeed = ( unsigned char ) ( from->motorSpeed + ( to->motorSpeed - from->motorSpeed ) * alpha + 0.5f );
+	out->phase = ( unsigned char ) ( alpha * 255 );
+}
+
+/*
+ * Draw a frame incrementally against the last one drawn, so that the cost
+ * follows how much changed rather than the size of the window.  Band data
+ * only changes with the frame number or interpolation phase, so those and
+ * the motor are all that need comparing.  Returns 0 without touching a
+ * pixel if nothing changed.
+ */
+
+int RezRenderFrame( RezFramebuffer *fb, const RezVisualState *state )
+{
+	const RezVisualState *last = &fb->lastState;
+	RezLayout layout;
+	RezRect rect;
+	int full = !fb->hasLastState;
+	int band;
+
+	if( fb->pixels == NULL || fb->width == 0 || fb->height == 0 ) return 0;
+	if( !full && last->frame == state->frame && last->phase == state->phase &&
+		last->motorSpeed == state->motorSpeed && last->hasVibe == state->hasVibe ) return 0;
+
+	RezComputeLayout( fb, &layout );
+	if( full )
+	{
+		rect.left = rect.top = 0;
+		rect.right = fb->width;
+		rect.bottom = fb->height;
+		RezFramebufferFillRect( fb, &rect, REZ_BACKGROUND );
+	}
+
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+	{
+		int left = band * layout.slotWidth + layout.slotWidth / 8;
+		int right = ( band + 1 ) * layout.slotWidth - layout.slotWidth / 8;
+		int before[ 3 ], after[ 3 ];
+		unsigned int bit = 1u << band;
+
+		RezBarPositions( &layout, last, band, before );
+		RezBarPositions( &layout, state, band, after );
+		RezDrawBar( fb, &layout, left, right, before, after, REZ_BAR, full );
+
+		if( full || ( last->beats & bit ) != ( state->beats & bit ) )
+		{
+			rect.left = left;
+			rect.right = right;
+			rect.top = layout.lampBottom / 4;
+			rect.bottom = layout.lampBottom - layout.lampBottom / 4;
+			RezFramebufferFillRect( fb, &rect, ( state->beats & bit ) ? REZ_BEAT : REZ_LAMP_OFF );
+		}
+	}
+
+	/*
+	 * Motor speed, drawn as a bar with the confidence as its one marker.
+	 */
+	{
+		int before[ 3 ], after[ 3 ];
+
+		before[ 0 ] = RezLevelToY( &layout, last->motorSpeed );
+		after[ 0 ] = RezLevelToY( &layout, state->motorSpeed );
+		before[ 2 ] = RezLevelToY( &layout, last->confidence * 255 );
+		after[ 2 ] = RezLevelToY( &layout, state->confidence * 255 );
+		before[ 1 ] = after[ 1 ] = -1;
+		RezDrawBar( fb, &layout, layout.barsRight + ( fb->width - layout.barsRight ) / 4, fb->width - ( fb->width - layout.barsRight ) / 4,
+					before, after, state->hasVibe ? REZ_MOTOR : REZ_MOTOR_NOVIBE, full || last->hasVibe != state->hasVibe );
+	}
+
+	/*
+	 * History sweep.  The current column gets one cell per band, brightness
+	 * following energy and beats in yellow, and the column after it is
+	 * wiped to show where the sweep is.
+	 */
+	if( full || last->frame != state->frame )
+	{
+		int column = ( int ) ( state->frame % REZ_HISTORY_COLUMNS );
+
+		rect.left = column * layout.columnWidth;
+		rect.right = rect.left + layout.columnWidth;
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+		{
+			int level = ( int ) state->energy[ band ];
+
+			if( level > 255 ) level = 255;
+			if( level < 0 ) level = 0;
+			rect.top = layout.barsBottom + ( FREQUENCYBANDS - 1 - band ) * layout.historyRowHeight;
+			rect.bottom = rect.top + layout.historyRowHeight;
+			RezFramebufferFillRect( fb, &rect, ( state->beats & ( 1u << band ) ) ? REZ_BEAT : REZ_RGB( level, level, level ) );
+		}
+		rect.left = ( ( column + 1 ) % REZ_HISTORY_COLUMNS ) * layout.columnWidth;
+		rect.right = rect.left + layout.columnWidth;
+		rect.top = layout.barsBottom;
+		rect.bottom = layout.barsBottom + FREQUENCYBANDS * layout.historyRowHeight;
+		RezFramebufferFillRect( fb, &rect, REZ_CURSOR );
+	}
+
+	fb->lastState = *state;
+	fb->hasLastState = 1;
+	return 1;
+}
+
+void RezHeadlessBlit( void *context, const RezFramebuffer *fb, const RezRect *dirty )
+{
+	RezHeadless *headless = ( RezHeadless * ) context;
+
+	( void ) fb;
+	headless->blits++;
+	headless->pixels += ( unsigned long ) ( dirty->right - dirty->left ) * ( dirty->bottom - dirty->top );
+}
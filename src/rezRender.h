@@ -0,0 +1,130 @@
+/*
+ *  rezRender.h
+ *  rezTunes
+ *
+ *  Software renderer.  Frames are drawn into a persistent framebuffer
+ *  owned by the plugin, and only the parts that changed are handed to a
+ *  platform blit backend.  Like rezDetector, nothing in here depends on
+ *  the iTunes headers.
+ */
+
+#ifndef REZRENDER_H_
+#define REZRENDER_H_
+
+#include "rezDetector.h"
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pixels are 32 bit host-endian xRGB, which is what both a 32bpp Windows
+ * DIB and a kCGImageAlphaNoneSkipFirst Quartz image expect.
+ */
+
+typedef unsigned int RezPixel;
+
+#define REZ_RGB( r, g, b ) ( ( RezPixel ) ( ( ( r ) << 16 ) | ( ( g ) << 8 ) | ( b ) ) )
+
+/*
+ * Rectangles are half open, [ left, right ) x [ top, bottom ), with the
+ * origin at the top left of the framebuffer.
+ */
+
+struct RezRect {
+	int					left;
+	int					top;
+	int					right;
+	int					bottom;
+};
+typedef struct RezRect RezRect;
+
+/*
+ * Everything a frame is drawn from.  If this has not changed since the
+ * last frame, nothing is drawn and nothing is blitted.
+ *
+ *   energy, average, threshold - Per band levels on the 0-255 scale of the
+ *     spectrum data.  threshold is the level energy had to clear to fire.
+ *   confidence - The detector's onset confidence, 0-1.
+ *   beats - Bit n is set if band n fired this frame.
+ *   frame - Detector frame number.  Each new frame adds a history column.
+ *   time - When the detector produced the frame.
+ *   phase - How far the drawing is between the previous detector frame and
+ *     this one, 0-255, when the state was interpolated for display.
+ */
+
+struct RezVisualState {
+	float				energy[ FREQUENCYBANDS ];
+	float				average[ FREQUENCYBANDS ];
+	float				threshold[ FREQUENCYBANDS ];
+	float				confidence;
+	unsigned int		beats;
+	unsigned long		frame;
+	RezTime				time;
+	unsigned char		motorSpeed;
+	unsigned char		hasVibe;
+	unsigned char		phase;
+};
+typedef struct RezVisualState RezVisualState;
+
+/*
+ * REZ_MAX_DIRTY - Separate dirty rectangles kept per frame.  Past this,
+ *   new rectangles are merged into whichever existing one grows least.
+ */
+
+#define REZ_MAX_DIRTY 32
+
+struct RezFramebuffer {
+	RezPixel			*pixels;
+	int					width;
+	int					height;
+	int					stride;			/* In pixels */
+	int					capacity;		/* In pixels */
+
+	RezRect				dirty[ REZ_MAX_DIRTY ];
+	int					dirtyCount;
+
+	RezVisualState		lastState;
+	int					hasLastState;
+};
+typedef struct RezFramebuffer RezFramebuffer;
+
+/*
+ * A blit backend copies one dirty rectangle of the framebuffer to the
+ * screen.  It is called once per rectangle.
+ */
+
+typedef void ( *RezBlitProc )( void *context, const RezFramebuffer *fb, const RezRect *dirty );
+
+/*
+ * The headless backend draws nowhere.  It only counts what it would
+ * have copied, so the renderer can be run and timed without a window.
+ */
+
+struct RezHeadless {
+	unsigned long		blits;
+	unsigned long		pixels;
+};
+typedef struct RezHeadless RezHeadless;
+
+extern void RezFramebufferInit( RezFramebuffer *fb );
+extern int RezFramebufferResize( RezFramebuffer *fb, int width, int height );
+extern void RezFramebufferRelease( RezFramebuffer *fb );
+extern void RezFramebufferInvalidate( RezFramebuffer *fb );
+extern void RezFramebufferMarkDirty( RezFramebuffer *fb, const RezRect *rect );
+extern void RezFillSpan( RezPixel *dst, int count, RezPixel colour );
+extern void RezFramebufferFillRect( RezFramebuffer *fb, const RezRect *rect, RezPixel colour );
+extern int RezFramebufferPresent( RezFramebuffer *fb, RezBlitProc blit, void *context );
+extern int RezFramebufferWritePPM( const RezFramebuffer *fb, const char *path );
+
+extern void RezVisualStateBlend( RezVisualState *out, const RezVisualState *from, const RezVisualState *to, float alpha );
+extern int RezRenderFrame( RezFramebuffer *fb, const RezVisualState *state );
+
+extern void RezHeadlessBlit( void *context, const RezFramebuffer *fb, const RezRect *dirty );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZRENDER_H_ */
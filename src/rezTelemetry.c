@@ -0,0 +1,272 @@
+/*
+ *  rezTelemetry.c
+ *  rezTunes
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "rezArena.h"
+#include "rezTelemetry.h"
+
+#define REZ_TELEMETRY_SIZE ( sizeof( RezTelemetryHeader ) + REZ_TELEMETRY_RECORDS * sizeof( RezTelemetryRecord ) + sizeof( RezLatency ) )
+
+/*
+ * 32 and 64 bit readers only agree on the layout if nothing in it depends
+ * on how the compiler aligns a 64 bit field.
+ */
+
+REZ_STATIC_ASSERT( telemetry_header_size, sizeof( RezTelemetryHeader ) == 72 );
+REZ_STATIC_ASSERT( telemetry_time_aligned, offsetof( RezTelemetryRecord, time ) % 8 == 0 );
+REZ_STATIC_ASSERT( telemetry_record_size, sizeof( RezTelemetryRecord ) % 8 == 0 );
+
+#if defined( _WIN32 )
+
+#include <windows.h>
+
+#define RezTelemetryProcess() ( ( unsigned int ) GetCurrentProcessId() )
+
+static int RezTelemetryMap( RezTelemetry *telemetry, int writer )
+{
+	memset( telemetry, 0, sizeof( RezTelemetry ) );
+	if( writer )
+		telemetry->map = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, REZ_TELEMETRY_SIZE, REZ_TELEMETRY_NAME );
+	else
+		telemetry->map = OpenFileMappingA( FILE_MAP_READ, FALSE, REZ_TELEMETRY_NAME );
+	if( telemetry->map == NULL ) return 0;
+
+	/*
+	 * A segment can only have one writer.  Another instance already has
+	 * it, so this one goes without.
+	 */
+	if( writer && GetLastError() == ERROR_ALREADY_EXISTS )
+	{
+		CloseHandle( telemetry->map );
+		telemetry->map = NULL;
+		return 0;
+	}
+
+	telemetry->header = ( RezTelemetryHeader * ) MapViewOfFile( telemetry->map, writer ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, REZ_TELEMETRY_SIZE );
+	if( telemetry->header == NULL )
+	{
+		CloseHandle( telemetry->map );
+		telemetry->map = NULL;
+		return 0;
+	}
+	telemetry->size = REZ_TELEMETRY_SIZE;
+	telemetry->writer = writer;
+	return 1;
+}
+
+void RezTelemetryClose( RezTelemetry *telemetry )
+{
+	if( telemetry->header != NULL ) UnmapViewOfFile( telemetry->header );
+	if( telemetry->map != NULL ) CloseHandle( telemetry->map );
+	memset( telemetry, 0, sizeof( RezTelemetry ) );
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RezTelemetryProcess() ( ( unsigned int ) getpid() )
+
+/*
+ * Unlike a Windows mapping, a segment outlives a writer that crashes
+ * before it can unlink it.  It is only taken to be left over if the
+ * process it names has gone; one still being made names nobody yet and
+ * is left alone.
+ */
+
+static int RezTelemetryStale( void )
+{
+	struct stat info;
+	void *base;
+	unsigned int owner;
+	int fd;
+
+	fd = shm_open( REZ_TELEMETRY_NAME, O_RDONLY, 0 );
+	if( fd < 0 ) return 0;
+	if( fstat( fd, &info ) < 0 || ( unsigned long ) info.st_size < sizeof( RezTelemetryHeader ) )
+	{
+		close( fd );
+		return 0;
+	}
+	base = mmap( NULL, sizeof( RezTelemetryHeader ), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED ) return 0;
+	owner = ( ( const RezTelemetryHeader * ) base )->owner;
+	munmap( base, sizeof( RezTelemetryHeader ) );
+	return owner != 0 && kill( ( pid_t ) owner, 0 ) < 0 && errno == ESRCH;
+}
+
+/*
+ * A segment can only have one writer, as on Windows.  A reader still
+ * attached to a segment whose writer has closed it sees it stop rather
+ * than turn to garbage, since the next writer makes a new one.
+ */
+
+static int RezTelemetryMap( RezTelemetry *telemetry, int writer )
+{
+	struct stat info;
+	void *base;
+	int fd;
+
+	memset( telemetry, 0, sizeof( RezTelemetry ) );
+	if( writer )
+	{
+		fd = shm_open( REZ_TELEMETRY_NAME, O_RDWR | O_CREAT | O_EXCL, 0644 );
+		if( fd < 0 && errno == EEXIST && RezTelemetryStale() )
+		{
+			shm_unlink( REZ_TELEMETRY_NAME );
+			fd = shm_open( REZ_TELEMETRY_NAME, O_RDWR | O_CREAT | O_EXCL, 0644 );
+		}
+		if( fd < 0 ) return 0;
+		if( ftruncate( fd, REZ_TELEMETRY_SIZE ) < 0 )
+		{
+			close( fd );
+			shm_unlink( REZ_TELEMETRY_NAME );
+			return 0;
+		}
+	}
+	else
+	{
+		fd = shm_open( REZ_TELEMETRY_NAME, O_RDONLY, 0 );
+		if( fd < 0 ) return 0;
+		if( fstat( fd, &info ) < 0 || ( unsigned long ) info.st_size < REZ_TELEMETRY_SIZE )
+		{
+			close( fd );
+			return 0;
+		}
+	}
+
+	base = mmap( NULL, REZ_TELEMETRY_SIZE, writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED )
+	{
+		if( writer ) shm_unlink( REZ_TELEMETRY_NAME );
+		return 0;
+	}
+	telemetry->header = ( RezTelemetryHeader * ) base;
+	telemetry->size = REZ_TELEMETRY_SIZE;
+	telemetry->writer = writer;
+	return 1;
+}
+
+void RezTelemetryClose( RezTelemetry *telemetry )
+{
+	if( telemetry->header != NULL )
+	{
+		munmap( ( void * ) telemetry->header, telemetry->size );
+		if( telemetry->writer ) shm_unlink( REZ_TELEMETRY_NAME );
+	}
+	memset( telemetry, 0, sizeof( RezTelemetry ) );
+}
+
+#endif
+
+/*
+ * The magic goes in last, so a reader never takes a half made header for
+ * a finished one.
+ */
+
+int RezTelemetryCreate( RezTelemetry *telemetry )
+{
+	RezTelemetryHeader *header;
+
+	if( !RezTelemetryMap( telemetry, 1 ) ) return 0;
+	header = telemetry->header;
+	memset( header, 0, REZ_TELEMETRY_SIZE );
+	header->version = REZ_TELEMETRY_VERSION;
+	header->records = REZ_TELEMETRY_RECORDS;
+	header->recordSize = sizeof( RezTelemetryRecord );
+	header->bands = FREQUENCYBANDS;
+	header->owner = RezTelemetryProcess();
+	telemetry->records = ( RezTelemetryRecord * ) ( header + 1 );
+	telemetry->latency = ( RezLatency * ) ( telemetry->records + REZ_TELEMETRY_RECORDS );
+	RezAtomicBarrier();
+	header->magic = REZ_TELEMETRY_MAGIC;
+	return 1;
+}
+
+int RezTelemetryAttach( RezTelemetry *telemetry )
+{
+	const RezTelemetryHeader *header;
+
+	if( !RezTelemetryMap( telemetry, 0 ) ) return 0;
+	header = telemetry->header;
+	RezAtomicBarrier();
+	if( header->magic != REZ_TELEMETRY_MAGIC || header->version != REZ_TELEMETRY_VERSION ||
+		header->records != REZ_TELEMETRY_RECORDS || header->recordSize != sizeof( RezTelemetryRecord ) ||
+		header->bands != FREQUENCYBANDS )
+	{
+		RezTelemetryClose( telemetry );
+		return 0;
+	}
+	telemetry->records = ( RezTelemetryRecord * ) ( telemetry->header + 1 );
+	telemetry->latency = ( RezLatency * ) ( telemetry->records + REZ_TELEMETRY_RECORDS );
+	return 1;
+}
+
+RezTelemetryRecord *RezTelemetryBegin( RezTelemetry *telemetry )
+{
+	unsigned int index = ( unsigned int ) telemetry->header->written;
+	RezTelemetryRecord *record = &telemetry->records[ index % REZ_TELEMETRY_RECORDS ];
+
+	RezAtomicAdd( &record->sequence, 1 );
+	record->index = index;
+	return record;
+}
+
+void RezTelemetryCommit( RezTelemetry *telemetry )
+{
+	unsigned int index = ( unsigned int ) telemetry->header->written;
+
+	RezAtomicAdd( &telemetry->records[ index % REZ_TELEMETRY_RECORDS ].sequence, 1 );
+	RezAtomicAdd( &telemetry->header->written, 1 );
+}
+
+/*
+ * A record whose count is odd, or changes while it is copied, or that
+ * turns out to be a later lap's record, was overwritten before it could
+ * be read.  It is gone, so it is counted as skipped.  The writer only
+ * ever rewrites a record a whole ring after it was committed, so the
+ * newest record can always be read.
+ */
+
+int RezTelemetryRead( RezTelemetry *telemetry, unsigned int *next, RezTelemetryRecord *record, unsigned long *skipped )
+{
+	for( ;; )
+	{
+		unsigned int written = ( unsigned int ) telemetry->header->written;
+		const RezTelemetryRecord *slot;
+		int before, after;
+
+		RezAtomicBarrier();
+		if( written == *next ) return 0;
+		if( written - *next > REZ_TELEMETRY_RECORDS )
+		{
+			if( skipped != NULL ) *skipped += written - REZ_TELEMETRY_RECORDS - *next;
+			*next = written - REZ_TELEMETRY_RECORDS;
+		}
+
+		slot = &telemetry->records[ *next % REZ_TELEMETRY_RECORDS ];
+		before = slot->sequence;
+		RezAtomicBarrier();
+		memcpy( record, slot, sizeof( RezTelemetryRecord ) );
+		RezAtomicBarrier();
+		after = slot->sequence;
+
+		if( !( before & 1 ) && before == after && record->index == *next )
+		{
+			( *next )++;
+			return 1;
+		}
+		if( skipped != NULL ) ( *skipped )++;
+		( *next )++;
+	}
+}
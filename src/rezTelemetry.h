@@ -0,0 +1,144 @@
+/*
+ *  rezTelemetry.h
+ *  rezTunes
+ *
+ *  A ring of per-frame detector records in named shared memory, so the
+ *  detector can be watched live from another process.  There is one
+ *  writer, the render path, which never waits and never allocates: each
+ *  record is guarded by its own sequence count, odd while it is being
+ *  written.  Readers copy a record and keep it only if the count was the
+ *  same even number before and after.  A reader that falls a whole ring
+ *  behind skips ahead to the oldest record still there.
+ *
+ *  The latency histograms follow the records, kept up to date in place
+ *  by the threads that measure them.  How often the governor has shed
+ *  each optional stage is kept in the header the same way.
+ *
+ *  The layout uses fixed size fields only, so 32 and 64 bit processes
+ *  agree on it.
+ */
+
+#ifndef REZTELEMETRY_H_
+#define REZTELEMETRY_H_
+
+#include "rezAtomic.h"
+#include "rezDetector.h"
+#include "rezGovernor.h"
+#include "rezLatency.h"
+#include "rezTime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined( _WIN32 )
+#define REZ_TELEMETRY_NAME "Local\\rezTunesTelemetry"
+#else
+#define REZ_TELEMETRY_NAME "/rezTunes.telemetry"
+#endif
+
+#define REZ_TELEMETRY_MAGIC 0x525a544d		/* 'RZTM' */
+#define REZ_TELEMETRY_VERSION 5
+#define REZ_TELEMETRY_RECORDS 1024
+
+/*
+ * flags
+ */
+
+enum {
+	REZ_TELEMETRY_PLAYING = 1,
+	REZ_TELEMETRY_REPLAYING = 2,
+	REZ_TELEMETRY_VIBE = 4
+};
+
+/*
+ * stamp is the frame's renderTimeStampID.  confidence is the detector's
+ * onset confidence.  detectUS and decideUS are how long its detect and
+ * decide stages took, and stageUS what each optional stage cost the
+ * frame: drawing done since the last one, the memories within detection,
+ * and the last record written, as this one cannot time itself.  All stop
+ * at 65535.
+ */
+
+struct RezTelemetryRecord {
+	RezAtomic			sequence;
+	unsigned int		index;
+	RezTime				time;
+	unsigned int		frame;
+	unsigned int		stamp;
+	unsigned int		positionMS;
+	unsigned int		beats;
+	unsigned char		motorSpeed;
+	unsigned char		detectorSpeed;
+	unsigned char		flags;
+	unsigned char		reserved;
+	float				energy[ FREQUENCYBANDS ];
+	float				average[ FREQUENCYBANDS ];
+	float				threshold[ FREQUENCYBANDS ];
+	float				ratio[ FREQUENCYBANDS ];
+	float				confidence;
+	unsigned short		detectUS;
+	unsigned short		decideUS;
+	unsigned short		stageUS[ REZ_STAGES ];
+	unsigned short		spare;
+};
+typedef struct RezTelemetryRecord RezTelemetryRecord;
+
+/*
+ * written counts every record ever committed; the newest one is in slot
+ * ( written - 1 ) % REZ_TELEMETRY_RECORDS.  owner is the writer's process
+ * id.
+ */
+
+struct RezTelemetryHeader {
+	unsigned int		magic;
+	unsigned int		version;
+	unsigned int		records;
+	unsigned int		recordSize;
+	unsigned int		bands;
+	RezAtomic			written;
+	RezGovernorCounts	governor;
+	unsigned int		owner;
+	unsigned int		reserved;
+};
+typedef struct RezTelemetryHeader RezTelemetryHeader;
+
+struct RezTelemetry {
+	RezTelemetryHeader	*header;
+	RezTelemetryRecord	*records;
+	RezLatency			*latency;
+	unsigned long		size;
+	int					writer;
+#if defined( _WIN32 )
+	void				*map;
+#endif
+};
+typedef struct RezTelemetry RezTelemetry;
+
+/*
+ * RezTelemetryCreate makes the segment for the writer; RezTelemetryAttach
+ * finds the writer's segment for a reader.  Both return 0 on failure.
+ * There is only one segment, so while one writer has it RezTelemetryCreate
+ * fails for any other, which then goes without.
+ *
+ * The writer fills in the record RezTelemetryBegin returns, everything
+ * but sequence and index, then calls RezTelemetryCommit.
+ *
+ * RezTelemetryRead copies out the record numbered *next, if it has been
+ * written, and moves *next on.  It returns 1 for a record, 0 if there is
+ * nothing new yet.  skipped, if not NULL, has the number of records that
+ * were overwritten before they could be read added to it.
+ */
+
+extern int RezTelemetryCreate( RezTelemetry *telemetry );
+extern int RezTelemetryAttach( RezTelemetry *telemetry );
+extern void RezTelemetryClose( RezTelemetry *telemetry );
+extern RezTelemetryRecord *RezTelemetryBegin( RezTelemetry *telemetry );
+extern void RezTelemetryCommit( RezTelemetry *telemetry );
+extern int RezTelemetryRead( RezTelemetry *telemetry, unsigned int *next, RezTelemetryRecord *record, unsigned long *skipped );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZTELEMETRY_H_ */
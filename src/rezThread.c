@@ -0,0 +1,257 @@
+/*
+ *  rezThread.c
+ *  rezTunes
+ */
+
+#include <stdlib.h>
+#include "rezInstrument.h"
+#include "rezThread.h"
+
+/*
+ * Neither platform's thread entry point has the signature of the other's,
+ * so threads start in a trampoline that unpacks the real one.
+ */
+
+struct RezThreadStartup {
+	RezThreadProc		proc;
+	void				*argument;
+};
+typedef struct RezThreadStartup RezThreadStartup;
+
+#if defined( _WIN32 )
+
+static DWORD WINAPI RezThreadMain( LPVOID context )
+{
+	RezThreadStartup startup = *( RezThreadStartup * ) context;
+
+	free( context );
+	startup.proc( startup.argument );
+	return 0;
+}
+
+int RezThreadStart( RezThread *thread, RezThreadProc proc, void *argument, int priority )
+{
+	RezThreadStartup *startup = ( RezThreadStartup * ) malloc( sizeof( RezThreadStartup ) );
+
+	REZ_ALLOCATION();
+	if( startup == NULL ) return 0;
+	startup->proc = proc;
+	startup->argument = argument;
+	*thread = CreateThread( NULL, 0, RezThreadMain, startup, 0, NULL );
+	if( *thread == NULL )
+	{
+		free( startup );
+		return 0;
+	}
+	if( priority < 0 ) SetThreadPriority( *thread, THREAD_PRIORITY_LOWEST );
+	else if( priority > 0 ) SetThreadPriority( *thread, THREAD_PRIORITY_TIME_CRITICAL );
+	return 1;
+}
+
+void RezThreadJoin( RezThread *thread )
+{
+	WaitForSingleObject( *thread, INFINITE );
+	CloseHandle( *thread );
+	*thread = NULL;
+}
+
+void RezThreadSleep( int ms )
+{
+	Sleep( ms );
+}
+
+void RezMutexInit( RezMutex *mutex )
+{
+	InitializeCriticalSection( mutex );
+}
+
+void RezMutexDestroy( RezMutex *mutex )
+{
+	DeleteCriticalSection( mutex );
+}
+
+void RezMutexLock( RezMutex *mutex )
+{
+	EnterCriticalSection( mutex );
+}
+
+void RezMutexUnlock( RezMutex *mutex )
+{
+	LeaveCriticalSection( mutex );
+}
+
+int RezSignalInit( RezSignal *signal )
+{
+	*signal = CreateEvent( NULL, FALSE, FALSE, NULL );
+	return *signal != NULL;
+}
+
+void RezSignalDestroy( RezSignal *signal )
+{
+	if( *signal != NULL ) CloseHandle( *signal );
+	*signal = NULL;
+}
+
+void RezSignalRaise( RezSignal *signal )
+{
+	SetEvent( *signal );
+}
+
+int RezSignalWait( RezSignal *signal, int timeoutMS )
+{
+	return WaitForSingleObject( *signal, timeoutMS < 0 ? INFINITE : ( DWORD ) timeoutMS ) == WAIT_OBJECT_0;
+}
+
+#else
+
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
+
+static void *RezThreadMain( void *context )
+{
+	RezThreadStartup startup = *( RezThreadStartup * ) context;
+
+	free( context );
+	startup.proc( startup.argument );
+	return NULL;
+}
+
+/*
+ * Priorities are asked for through the scheduling policy: the lowest
+ * priority of the normal policy, or round robin for high priority.  An
+ * unprivileged process may be refused the latter, in which case the
+ * thread is started with the defaults instead.
+ */
+
+int RezThreadStart( RezThread *thread, RezThreadProc proc, void *argument, int priority )
+{
+	RezThreadStartup *startup = ( RezThreadStartup * ) malloc( sizeof( RezThreadStartup ) );
+	pthread_attr_t attributes;
+	int created = -1;
+
+	REZ_ALLOCATION();
+	if( startup == NULL ) return 0;
+	startup->proc = proc;
+	startup->argument = argument;
+
+	if( priority != 0 && pthread_attr_init( &attributes ) == 0 )
+	{
+		struct sched_param param;
+		int policy = priority > 0 ? SCHED_RR : SCHED_OTHER;
+
+		param.sched_priority = priority > 0 ? sched_get_priority_max( policy ) : sched_get_priority_min( policy );
+		if( pthread_attr_setinheritsched( &attributes, PTHREAD_EXPLICIT_SCHED ) == 0 &&
+			pthread_attr_setschedpolicy( &attributes, policy ) == 0 &&
+			pthread_attr_setschedparam( &attributes, &param ) == 0 )
+			created = pthread_create( thread, &attributes, RezThreadMain, startup );
+		pthread_attr_destroy( &attributes );
+	}
+	if( created != 0 ) created = pthread_create( thread, NULL, RezThreadMain, startup );
+	if( created != 0 )
+	{
+		free( startup );
+		return 0;
+	}
+	return 1;
+}
+
+void RezThreadJoin( RezThread *thread )
+{
+	pthread_join( *thread, NULL );
+}
+
+void RezThreadSleep( int ms )
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = ( long ) ( ms % 1000 ) * 1000000;
+	while( nanosleep( &ts, &ts ) < 0 && errno == EINTR )
+		;
+}
+
+void RezMutexInit( RezMutex *mutex )
+{
+	pthread_mutex_init( mutex, NULL );
+}
+
+void RezMutexDestroy( RezMutex *mutex )
+{
+	pthread_mutex_destroy( mutex );
+}
+
+void RezMutexLock( RezMutex *mutex )
+{
+	pthread_mutex_lock( mutex );
+}
+
+void RezMutexUnlock( RezMutex *mutex )
+{
+	pthread_mutex_unlock( mutex );
+}
+
+int RezSignalInit( RezSignal *signal )
+{
+	signal->raised = 0;
+	if( pthread_mutex_init( &signal->lock, NULL ) != 0 ) return 0;
+	if( pthread_cond_init( &signal->cond, NULL ) != 0 )
+	{
+		pthread_mutex_destroy( &signal->lock );
+		return 0;
+	}
+	return 1;
+}
+
+void RezSignalDestroy( RezSignal *signal )
+{
+	pthread_cond_destroy( &signal->cond );
+	pthread_mutex_destroy( &signal->lock );
+}
+
+void RezSignalRaise( RezSignal *signal )
+{
+	pthread_mutex_lock( &signal->lock );
+	signal->raised = 1;
+	pthread_cond_signal( &signal->cond );
+	pthread_mutex_unlock( &signal->lock );
+}
+
+/*
+ * Timed waits are against the wall clock, which is all Mac OS X offers.
+ * A clock change can only make the wait end early or late, not hang.
+ */
+
+int RezSignalWait( RezSignal *signal, int timeoutMS )
+{
+	struct timespec deadline;
+	int raised;
+
+	if( timeoutMS >= 0 )
+	{
+		struct timeval now;
+
+		gettimeofday( &now, NULL );
+		deadline.tv_sec = now.tv_sec + timeoutMS / 1000;
+		deadline.tv_nsec = now.tv_usec * 1000 + ( long ) ( timeoutMS % 1000 ) * 1000000;
+		if( deadline.tv_nsec >= 1000000000 )
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock( &signal->lock );
+	while( !signal->raised )
+	{
+		if( timeoutMS < 0 ) pthread_cond_wait( &signal->cond, &signal->lock );
+		else if( pthread_cond_timedwait( &signal->cond, &signal->lock, &deadline ) == ETIMEDOUT ) break;
+	}
+	raised = signal->raised;
+	signal->raised = 0;
+	pthread_mutex_unlock( &signal->lock );
+	return raised;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ *  rezThread.h
+ *  rezTunes
+ *
+ *  Just enough threading for the background workers: start and join a
+ *  thread, a mutex, and a signal one thread can wait on until another
+ *  raises it.  pthreads everywhere but Windows, where the signal is an
+ *  auto-reset event since XP has no condition variables.
+ */
+
+#ifndef REZTHREAD_H_
+#define REZTHREAD_H_
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined( _WIN32 )
+typedef HANDLE RezThread;
+typedef CRITICAL_SECTION RezMutex;
+typedef HANDLE RezSignal;
+#else
+typedef pthread_t RezThread;
+typedef pthread_mutex_t RezMutex;
+struct RezSignal {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	int					raised;
+};
+typedef struct RezSignal RezSignal;
+#endif
+
+typedef void ( *RezThreadProc )( void *argument );
+
+/*
+ * REZ_PRIORITY_LOW asks for a thread that only runs when nothing else
+ * wants the CPU, for work that can always wait.  REZ_PRIORITY_HIGH is for
+ * threads whose lateness can be felt, like the one driving the motor.
+ */
+
+enum {
+	REZ_PRIORITY_LOW = -1,
+	REZ_PRIORITY_NORMAL = 0,
+	REZ_PRIORITY_HIGH = 1
+};
+
+extern int RezThreadStart( RezThread *thread, RezThreadProc proc, void *argument, int priority );
+extern void RezThreadJoin( RezThread *thread );
+extern void RezThreadSleep( int ms );
+
+extern void RezMutexInit( RezMutex *mutex );
+extern void RezMutexDestroy( RezMutex *mutex );
+extern void RezMutexLock( RezMutex *mutex );
+extern void RezMutexUnlock( RezMutex *mutex );
+
+/*
+ * A raised signal stays raised until one wait consumes it, so a raise
+ * that happens before the wait is never lost.  Waits give up after
+ * timeoutMS, or never with a negative timeout, and return non-zero only
+ * if the signal was raised.
+ */
+
+extern int RezSignalInit( RezSignal *signal );
+extern void RezSignalDestroy( RezSignal *signal );
+extern void RezSignalRaise( RezSignal *signal );
+extern int RezSignalWait( RezSignal *signal, int timeoutMS );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZTHREAD_H_ */
@@ -0,0 +1,51 @@
+/*
+ *  rezTime.c
+ *  rezTunes
+ */
+
+#include "rezTime.h"
+
+#if defined( _MSC_VER )
+
+#include <windows.h>
+
+RezTime RezTimeNow( void )
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER now;
+
+	if( frequency.QuadPart == 0 ) QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &now );
+	return ( RezTime ) ( now.QuadPart / frequency.QuadPart ) * 1000000000 +
+		   ( RezTime ) ( now.QuadPart % frequency.QuadPart ) * 1000000000 / frequency.QuadPart;
+}
+
+#elif defined( __APPLE__ )
+
+#include <mach/mach_time.h>
+
+RezTime RezTimeNow( void )
+{
+	static mach_timebase_info_data_t timebase;
+
+	if( timebase.denom == 0 ) mach_timebase_info( &timebase );
+	/*
+	 * PPC timebases have a large numerator, so scale in double rather
+	 * than risk overflowing 64 bits.
+	 */
+	return ( RezTime ) ( ( double ) mach_absolute_time() * timebase.numer / timebase.denom );
+}
+
+#else
+
+#include <time.h>
+
+RezTime RezTimeNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( RezTime ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ *  rezTime.h
+ *  rezTunes
+ *
+ *  Monotonic clock in nanoseconds, from whichever source each platform
+ *  does best: mach_absolute_time, QueryPerformanceCounter or
+ *  clock_gettime.
+ */
+
+#ifndef REZTIME_H_
+#define REZTIME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined( _MSC_VER )
+typedef unsigned __int64 RezTime;
+#else
+typedef unsigned long long RezTime;
+#endif
+
+#define REZ_MS( ms ) ( ( RezTime ) ( ms ) * 1000000 )
+
+extern RezTime RezTimeNow( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZTIME_H_ */
@@ -0,0 +1,46 @@
+/*
+ *  rezTriple.c
+ *  rezTunes
+ */
+
+#include <string.h>
+#include "rezTriple.h"
+
+void RezTripleInit( RezTripleBuffer *triple )
+{
+	memset( triple->slot, 0, sizeof( triple->slot ) );
+	triple->back = 0;
+	triple->shared = 1;
+	triple->front = 2;
+}
+
+RezVisualState *RezTripleWriteSlot( RezTripleBuffer *triple )
+{
+	return &triple->slot[ triple->back ];
+}
+
+/*
+ * Swap the freshly written back slot into the middle and take whatever
+ * was there to write the next state into.
+ */
+
+void RezTriplePublish( RezTripleBuffer *triple )
+{
+	triple->back = RezAtomicExchange( &triple->shared, triple->back | REZ_TRIPLE_FRESH ) & 3;
+}
+
+/*
+ * Return the newest published state.  If nothing was published since the
+ * last call the same slot comes back again with fresh cleared.
+ */
+
+const RezVisualState *RezTripleAcquire( RezTripleBuffer *triple, int *fresh )
+{
+	*fresh = 0;
+	if( RezAtomicLoad( &triple->shared ) & REZ_TRIPLE_FRESH )
+	{
+		triple->front = RezAtomicExchange( &triple->shared, triple->front ) & 3;
+		*fresh = 1;
+	}
+	return &triple->slot[ triple->front ];
+}
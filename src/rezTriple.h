@@ -0,0 +1,47 @@
+/*
+ *  rezTriple.h
+ *  rezTunes
+ *
+ *  Lock-free triple buffer carrying detector state to the drawing code.
+ *  The detector always has a slot to write into and the drawing code
+ *  always has a complete state to read, and neither ever waits for the
+ *  other.  States published faster than they are read are overwritten,
+ *  only ever the newest one is drawn.
+ */
+
+#ifndef REZTRIPLE_H_
+#define REZTRIPLE_H_
+
+#include "rezAtomic.h"
+#include "rezRender.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * shared holds the index of the slot in the middle, with REZ_TRIPLE_FRESH
+ * set if it was published since the reader last took it.  back belongs to
+ * the writer and front to the reader.
+ */
+
+#define REZ_TRIPLE_FRESH 4
+
+struct RezTripleBuffer {
+	RezVisualState		slot[ 3 ];
+	RezAtomic			shared;
+	int					back;
+	int					front;
+};
+typedef struct RezTripleBuffer RezTripleBuffer;
+
+extern void RezTripleInit( RezTripleBuffer *triple );
+extern RezVisualState *RezTripleWriteSlot( RezTripleBuffer *triple );
+extern void RezTriplePublish( RezTripleBuffer *triple );
+extern const RezVisualState *RezTripleAcquire( RezTripleBuffer *triple, int *fresh );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REZTRIPLE_H_ */
@@ -18,9 +18,22 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
 #include "iTunesVisualAPI.h"
-#include "trancevibe.h"
+#include "rezActuator.h"
+#include "rezDetector.h"
+#include "rezGovernor.h"
+#include "rezRender.h"
+#include "rezTriple.h"
+#include "rezTime.h"
+#include "rezBeatCache.h"
+#include "rezLookahead.h"
+#include "rezInstrument.h"
+#include "rezTelemetry.h"
+#include "rezEvents.h"
+#include "rezQueue.h"
+#include "rezArena.h"
 
 #if TARGET_OS_WIN32
 #define	MAIN iTunesPluginMain
@@ -47,41 +60,131 @@
 #define VENDORID 0x0b49
 
 /*
- * Parameters of the beat detection code.
- *   RETAINMS - Length of the audio "memory" in milliseconds.
- *   RETAINSAMPLES - How many samples should be taken during this time.
+ * The name the vibrators' calibrations are kept under in iTunes' plugin
+ * preferences, as a Pascal string.  There is one for each unit, all kept
+ * together under this one name.
+ */
+
+#define CALIBRATIONNAME "\013calibration"
+
+/*
+ * Parameters of the beat detection code itself are in rezDetector.h.
  *
- *   SENSITIVITY - To make "beat", a signal must be this many times over 
- *     the retained average in it's subband.
- *   MINPEAK - It must also be MINPEAK greater than the local retained
- *     average.
+ *  MOTORLEADMS - The motor takes a while to spin up.  When the beats of a
+ *    track are known ahead of time, from the cache or from looking ahead
+ *    in its file, each one is sent to the motor this much early.
  *
- *  FREQUENCYBANDS - The spectrum is divided up into this many channels.
+ *  CACHESTARTMS, CACHEENDMS - Beats detected in a track are cached for
+ *    the next time it plays, but only if they were recorded without a seek
+ *    from within CACHESTARTMS of its start to within CACHEENDMS of its end.
+ *  RECORDBEATS - Most beats that can be recorded for one track.
+ *  SEEKMS - A jump in playback position bigger than this is a seek.
+ *  PROFILEFRAMES - Frames a track must play for before its mean band
+ *    energies are saved.  After a seek or track change the history is
+ *    warmed up from those means rather than starting empty.
  *
- *  DECAY - The speed at which the motor winds down.
+ *  DISPLAYHZ - How often the window is redrawn, independent of how often
+ *    iTunes delivers data.  Drawing runs one detector frame behind and
+ *    interpolates towards the newest one.
  *
- *  FALLOFF - Beats in higher bands will produce slower vibrations, how
- *    much slower depends on this variable.
+ *  OWNERWAKEMS - Longest the owner thread sleeps without a message before
+ *    looking for finished look-ahead maps, while playing and shown.  At
+ *    rest it sleeps until a message comes.
+ *
+ *  FRAMEBUDGETMS - Time a frame's detection, drawing and telemetry should
+ *    take between them, well inside the interval iTunes delivers frames
+ *    at.  When most frames take longer, optional stages are shed until
+ *    they fit; see rezGovernor.h.
+ *
+ *  FULLVOLUME - The volume a play message reports with the slider all the
+ *    way up, as far as anyone knows: the SDK does not say, and this is
+ *    the range iTunes gives its volume everywhere else.  Any louder volume
+ *    reported is taken as full from then on, so a guess that is too low
+ *    can only make the detector read a quiet volume as louder than it
+ *    is, never make it fire on less.  The detector is told the volume as
+ *    a fraction of full, which only the log domain uses.
+ *
+ *  INSTANCES - Most instances that can be alive at once.
  */
 
-#define RETAINSAMPLES 20
-#define RETAINMS 500
-#define SENSITIVITY 1.8
-#define MINPEAK 1.5
-#define FREQUENCYBANDS 9
-#define DECAY 10
-#define FALLOFF 90
+#define CACHESTARTMS 1000
+#define CACHEENDMS 5000
+#define RECORDBEATS 65536
+#define SEEKMS 1000
+#define PROFILEFRAMES 400
+#define MOTORLEADMS 60
+#define DISPLAYHZ 60
+#define OWNERWAKEMS 250
+#define FRAMEBUDGETMS 10
+#define FULLVOLUME 100
+#define DELIVERYFRAMES 1024
+#define INSTANCES 16
+
+/*
+ * An instance's state is one arena (see rezArena.h), in blocks that each
+ * start on their own cache line:
+ *
+ *   VisualPluginHot - everything the owner thread touches on every
+ *     frame, so a frame's work stays in as few lines as possible.
+ *   RezActuator - shared with the actuator thread.
+ *   RezQueue - shared by whichever threads the host calls us on.
+ *   VisualPluginData - the rest: the window and drawing, which are the
+ *     host's, and what the owner touches only now and then.  The host
+ *     may call from more than one thread, so the window and drawing are
+ *     only touched under screenLock, and the calibrations, and saving
+ *     them, under saveLock.
+ *
+ * followed by the record of beats and the queue's buffers.  There are no
+ * globals, so any number of instances can run side by side.
+ */
+
+struct VisualPluginHot {
+	RezDetector			detector;
+	RezVisualState		visual;
+	RezTrace			trace;
+	RezEnvelope			envelope;
+	RezGovernor			governor;
+	unsigned long		stageUS[ REZ_STAGES ];
+	RezLatency			*latency;
+	UInt32				renderTimeStampID;
+	SInt32				volume;
+	SInt32				fullVolume;
+	Boolean				playing;
+	Boolean				showing;
+	Boolean				active;
+	Boolean				resuming;
+	Boolean				hasVibe;
+	Boolean				hasActuator;
+	UInt8				motorSpeed;
+	UInt8				eventSpeed;
+	Boolean				striking;
+	UInt8				strikePeak;
+	Boolean				hasDeliveryBase;
+	double				deliveryBaseMS;
 
-struct list_element {
-	float value;
-	struct list_element* next;
+	Boolean				hasTrack;
+	Boolean				recordValid;
+	Boolean				hasPosition;
+	UInt32				positionMS;
+	UInt32				firstPositionMS;
+	const RezBeat		*replayBeats;
+	unsigned long		replayCount;
+	unsigned long		replayCursor;
+	RezBeat				*recordBeats;
+	unsigned long		recordCount;
+	double				profileSum[ FREQUENCYBANDS ];
+	unsigned long		profileFrames;
 };
-typedef struct list_element list_element;
+typedef struct VisualPluginHot VisualPluginHot;
 
 struct VisualPluginData {
+	VisualPluginHot		*hot;
+	RezActuator			*actuator;
+	RezQueue			*queue;
+	RezArena			arena;
+
 	void				*appCookie;
 	ITAppProcPtr		appProc;
-	ITFileSpec			pluginFileSpec;
 
 #if TARGET_OS_MAC
 	CGrafPtr			destPort;
@@ -90,31 +193,88 @@ struct VisualPluginData {
 #endif
 
 	Rect				destRect;
-
 	OptionBits			destOptions;
-	UInt32				destBitDepth;
-	RenderVisualData	renderData;
-	UInt32				renderTimeStampID;
-	ITTrackInfo			trackInfo;
-	ITStreamInfo		streamInfo;
-	Boolean				playing;
-	Boolean				padding[ 3 ];
-
-	/*
-	 * Things will break if the struct is not
-	 * at least this big.  I'm not sure as to why.
-	 */
+#if TARGET_OS_MAC
+	CGColorSpaceRef		destColourSpace;
+	CGContextRef		destBitmap;
+#else
+	HDC					destDC;
+	BITMAPINFO			destBitmapInfo;
+#endif
+	RezMutex			screenLock;
+	RezFramebuffer		framebuffer;
+	RezTripleBuffer		published;
+	RezVisualState		shownFrom;
+	RezVisualState		shownTo;
+	RezVisualState		shown;
+	RezTime				lastDraw;
 	Boolean				running;
-	Boolean				hasVibe;
-	UInt8				motorSpeed;
-	SInt32				volume;
-	list_element*       energyHistory[ FREQUENCYBANDS ];
-	int                 energyCount[ FREQUENCYBANDS ];
-	float               energyAggregate[ FREQUENCYBANDS ];
-	trancevibe          tv;
+	Boolean				settled;
+	RezAtomic			resting;
+	RezAtomic			drawUS;
+	RezAtomic			stagesShed;
+	RezAtomic			wantShowing;
+	RezAtomic			wantPlaying;
+	RezAtomic			wantVolume;
+	RezAtomic			seeks;
+	RezAtomic			lostTrack;
+	int					seeksApplied;
+
+	RezBeatCache		beatCache;
+	Boolean				hasBeatCache;
+	RezTrackKey			trackKey;
+	UInt32				trackLengthMS;
+	Boolean				hasProfile;
+	float				trackProfile[ FREQUENCYBANDS ];
+	RezLookahead		lookahead;
+	Boolean				hasLookahead;
+	RezTelemetry		telemetry;
+	Boolean				hasTelemetry;
+	RezEvents			events;
+	Boolean				hasEvents;
+	RezLatency			localLatency;
+	RezGovernorCounts	localGovernor;
+	RezMutex			saveLock;
+	RezCalibrationStore	calibrations;
+	Boolean				unsaved;
+	RezThread			owner;
+	Boolean				hasOwner;
 };
 typedef struct VisualPluginData VisualPluginData;
 
+/*
+ * The detector leads the hot block, so a frame starts on a fresh line,
+ * and the buffers a message carries must hold the biggest thing posted.
+ */
+
+#define MESSAGEBUFFER ( sizeof( RenderVisualData ) > sizeof( ITTrackInfo ) ? sizeof( RenderVisualData ) : sizeof( ITTrackInfo ) )
+
+REZ_STATIC_ASSERT( detector_leads_hot_block, offsetof( VisualPluginHot, detector ) == 0 );
+REZ_STATIC_ASSERT( buffer_holds_render_data, REZ_QUEUE_BUFFER( MESSAGEBUFFER ) >= sizeof( RenderVisualData ) );
+REZ_STATIC_ASSERT( buffer_holds_track_info, REZ_QUEUE_BUFFER( MESSAGEBUFFER ) >= sizeof( ITTrackInfo ) );
+REZ_STATIC_ASSERT( buffer_alignment_fits_line, REZ_CACHE_LINE % REZ_QUEUE_ALIGN == 0 );
+
+/*
+ * The host is given a handle to an instance, not its address, so that a
+ * message coming after cleanup, on a thread that had not heard of it,
+ * finds nothing rather than freed memory.  This table is all that
+ * outlives an instance.  A handle is the instance's slot in the table
+ * plus a generation, so a slot used again does not answer to an old
+ * handle.  A slot's handle is 0 while it is free and -1 while its
+ * instance is being made or cleaned up; users counts the calls in the
+ * handler using it.
+ */
+
+struct InstanceSlot {
+	RezAtomic			handle;
+	RezAtomic			users;
+	VisualPluginData	*vPD;
+};
+typedef struct InstanceSlot InstanceSlot;
+
+static InstanceSlot instances[ INSTANCES ];
+static RezAtomic generation;
+
 
 /*
  * Function Prototypes.
@@ -122,46 +282,265 @@ typedef struct VisualPluginData VisualPluginData;
 extern OSStatus iTunesPluginMainMachO( OSType message, PluginMessageInfo *messageInfo, void *refCon );
 static OSStatus VisualPluginHandler( OSType message, VisualPluginMessageInfo *messageInfo, void *refCon );
 static OSStatus RegisterVisualPlugin( PluginMessageInfo *messageInfo );
+static VisualPluginData *CreateInstance( void );
+static void DestroyInstance( VisualPluginData *vPD );
+static int OpenInstance( VisualPluginData *vPD );
+static VisualPluginData *EnterInstance( int handle );
+static void LeaveInstance( int handle );
+static void RetireInstance( int handle );
+static void FreeInstance( int handle );
+static void Post( VisualPluginData *vPD, const RezMessage *posted, Boolean essential );
+static void PostTrack( VisualPluginData *vPD, RezMessage *posted, const ITTrackInfo *trackInfo );
+static void OwnerMain( void *argument );
+static void Apply( VisualPluginData *vPD, const RezMessage *message );
+static void CatchUp( VisualPluginData *vPD );
+static void SetVolume( VisualPluginData *vPD, SInt32 volume );
 
 static void MemClear( LogicalAddress dest, SInt32 length );
 
-static void ProcessRenderData( VisualPluginData *vPD, const RenderVisualData *renderData );
+static Boolean ProcessRenderData( VisualPluginData *vPD, const RenderVisualData *renderData );
+static void StartTrack( VisualPluginData *vPD, const ITTrackInfo *trackInfo );
+static void FinishTrack( VisualPluginData *vPD );
+static void WarmStart( VisualPluginData *vPD, Boolean sameTrack );
+static void LookAhead( VisualPluginData *vPD, const ITTrackInfo *trackInfo );
+static void CollectLookahead( VisualPluginData *vPD );
+static void SeekReplay( VisualPluginData *vPD, UInt32 positionMS );
+static Boolean FollowTrack( VisualPluginData *vPD, UInt32 positionMS, Boolean beat );
+static void PublishState( VisualPluginData *vPD );
+static void RecordTelemetry( VisualPluginData *vPD );
+static void SendEvents( VisualPluginData *vPD );
+static void StartTrace( VisualPluginData *vPD, RezTime arrived );
+static void RecordLatency( VisualPluginData *vPD, UInt32 positionMS );
+static void Govern( VisualPluginData *vPD, RezTime started );
 static void UpdateScreen( VisualPluginData *vPD );
+static void BlitScreen( void *context, const RezFramebuffer *fb, const RezRect *dirty );
+static void ReleaseScreen( VisualPluginData *vPD );
 static OSStatus ChangeVisualPort(VisualPluginData *visualPluginData,GRAPHICS_DEVICE destPort,const Rect *destRect);
 
+static void SetActive( VisualPluginData *vPD, Boolean active );
 static void SetupDevice( VisualPluginData *vPD );
-static void SetSpeed( VisualPluginData *vPD );
+static void SaveCalibration( VisualPluginData *vPD );
+static void Strike( VisualPluginData *vPD, UInt8 peak );
 static void CleanupDevice( VisualPluginData *vPD );
+#if REZ_INSTRUMENT
+static int MessageProbe( OSType message );
+#endif
 
 
 // ChangeVisualPort
 //
+// Points drawing at a new port and/or rectangle.  The framebuffer is sized
+// to match and the whole of it marked dirty; on Windows the DC is fetched
+// here once rather than on every frame, and on the Mac the bitmap context
+// that wraps the framebuffer is made here once.
+//
 static OSStatus ChangeVisualPort(VisualPluginData *visualPluginData,GRAPHICS_DEVICE destPort,const Rect *destRect)
 {
 	OSStatus		status;
 	
 	status = noErr;
-			
+
+#if TARGET_OS_WIN32
+	if (visualPluginData->destDC != nil && visualPluginData->destPort != destPort)
+		ReleaseScreen(visualPluginData);
+	if (visualPluginData->destDC == nil && destPort != nil)
+		visualPluginData->destDC = GetDC(destPort);
+#endif
 	visualPluginData->destPort = destPort;
+	visualPluginData->settled = false;
 	if (destRect != nil)
 		visualPluginData->destRect = *destRect;
 
+#if TARGET_OS_MAC
+	ReleaseScreen(visualPluginData);
+#endif
+	if (!RezFramebufferResize(&visualPluginData->framebuffer,
+							  visualPluginData->destRect.right - visualPluginData->destRect.left,
+							  visualPluginData->destRect.bottom - visualPluginData->destRect.top))
+		status = memFullErr;
+#if TARGET_OS_MAC
+	else if (visualPluginData->framebuffer.width > 0 && visualPluginData->framebuffer.height > 0)
+	{
+		const RezFramebuffer *fb = &visualPluginData->framebuffer;
+
+		visualPluginData->destBitmap = CGBitmapContextCreate( fb->pixels, fb->width, fb->height, 8, fb->stride * sizeof( RezPixel ),
+															  visualPluginData->destColourSpace, kCGImageAlphaNoneSkipFirst | kCGBitmapByteOrder32Host );
+	}
+#endif
+
 	return status;
 }
 
+// ReleaseScreen
+//
+// Lets go of what ChangeVisualPort made.  On the Mac this must come before
+// the framebuffer it wraps is released.
+//
+static void ReleaseScreen(VisualPluginData *visualPluginData)
+{
+#if TARGET_OS_WIN32
+	if (visualPluginData->destDC != nil)
+		ReleaseDC(visualPluginData->destPort, visualPluginData->destDC);
+	visualPluginData->destDC = nil;
+#else
+	if (visualPluginData->destBitmap != nil)
+		CGContextRelease(visualPluginData->destBitmap);
+	visualPluginData->destBitmap = nil;
+#endif
+}
+
+/*
+ * Carve a new instance out of one zeroed arena, in the order described
+ * above VisualPluginHot, with its queue ready to post to.
+ */
+static VisualPluginData *CreateInstance( void )
+{
+	VisualPluginData *vPD;
+	RezArena arena;
+	void *pool;
+
+	if( !RezArenaInit( &arena, REZ_ARENA_BLOCK( sizeof( VisualPluginHot ) ) + REZ_ARENA_BLOCK( sizeof( RezActuator ) ) +
+							   REZ_ARENA_BLOCK( sizeof( RezQueue ) ) + REZ_ARENA_BLOCK( sizeof( VisualPluginData ) ) +
+							   REZ_ARENA_BLOCK( RECORDBEATS * sizeof( RezBeat ) ) + REZ_ARENA_BLOCK( REZ_QUEUE_POOL( MESSAGEBUFFER ) ) ) )
+		return nil;
+
+	{
+		VisualPluginHot *hot = ( VisualPluginHot * ) RezArenaTake( &arena, sizeof( VisualPluginHot ) );
+		RezActuator *actuator = ( RezActuator * ) RezArenaTake( &arena, sizeof( RezActuator ) );
+		RezQueue *queue = ( RezQueue * ) RezArenaTake( &arena, sizeof( RezQueue ) );
+
+		vPD = ( VisualPluginData * ) RezArenaTake( &arena, sizeof( VisualPluginData ) );
+		vPD->hot = hot;
+		vPD->actuator = actuator;
+		vPD->queue = queue;
+	}
+	vPD->hot->recordBeats = ( RezBeat * ) RezArenaTake( &arena, RECORDBEATS * sizeof( RezBeat ) );
+	pool = RezArenaTake( &arena, REZ_QUEUE_POOL( MESSAGEBUFFER ) );
+	vPD->arena = arena;
+	if( !RezQueueInit( vPD->queue, pool, MESSAGEBUFFER ) )
+	{
+		RezArenaFree( &arena );
+		return nil;
+	}
+	return vPD;
+}
+
 /*
- * Central messaging and dispatch function.
+ * The arena's own record lives inside it, so take a copy to free it by.
+ */
+static void DestroyInstance( VisualPluginData *vPD )
+{
+	RezArena arena = vPD->arena;
+
+	RezArenaFree( &arena );
+}
+
+/*
+ * Give an instance a slot and return its handle, or 0 if there is no
+ * slot free.  The handle answers once it is stored in the slot, when the
+ * instance is ready.
+ */
+static int OpenInstance( VisualPluginData *vPD )
+{
+	int slot, handle;
+
+	for( slot = 0; slot < INSTANCES; slot++ )
+	{
+		if( !RezAtomicCompareAndSwap( &instances[ slot ].handle, 0, -1 ) ) continue;
+		instances[ slot ].vPD = vPD;
+		handle = ( int ) ( ( ( unsigned int ) RezAtomicAdd( &generation, 1 ) & 0x3ffffff ) + 1 ) * INSTANCES + slot;
+		return handle;
+	}
+	return 0;
+}
+
+/*
+ * The instance a handle names, counted as in use until LeaveInstance, or
+ * nil if it has been cleaned up or was never made.
+ */
+static VisualPluginData *EnterInstance( int handle )
+{
+	InstanceSlot *slot;
+
+	if( handle < INSTANCES ) return nil;
+	slot = &instances[ handle % INSTANCES ];
+	RezAtomicAdd( &slot->users, 1 );
+	if( RezAtomicLoad( &slot->handle ) != handle )
+	{
+		RezAtomicAdd( &slot->users, -1 );
+		return nil;
+	}
+	return slot->vPD;
+}
+
+static void LeaveInstance( int handle )
+{
+	RezAtomicAdd( &instances[ handle % INSTANCES ].users, -1 );
+}
+
+/*
+ * Stop the handle being entered and wait for any other call still using
+ * the instance to leave.  The caller has entered it itself.  Cleanup
+ * waits for the owner thread to finish anyway, so waiting here too costs
+ * the host nothing it was not already paying.
+ */
+static void RetireInstance( int handle )
+{
+	InstanceSlot *slot = &instances[ handle % INSTANCES ];
+
+	RezAtomicStore( &slot->handle, -1 );
+	while( RezAtomicLoad( &slot->users ) > 1 ) RezThreadSleep( 1 );
+}
+
+/*
+ * Once a retired instance is freed, leave it and free its slot.
+ */
+static void FreeInstance( int handle )
+{
+	InstanceSlot *slot = &instances[ handle % INSTANCES ];
+
+	slot->vPD = nil;
+	RezAtomicAdd( &slot->users, -1 );
+	RezAtomicStore( &slot->handle, 0 );
+}
+
+/*
+ * Central messaging and dispatch function.  Drawing happens here, on the
+ * host's thread, which owns the window.  Everything else is posted to the
+ * owner thread, which applies it in order; see OwnerMain.
  */
 static OSStatus VisualPluginHandler( OSType message, VisualPluginMessageInfo *messageInfo, void *refCon )
 {
 	VisualPluginData *vPD;
 	OSStatus status;
-	UInt8 oldSpeed = 0;
-	static int has_init = 0;
+	RezMessage posted;
+	int handle;
+	REZ_PROBE( messageStart )
+	REZ_HANDLER( handling )
 
-	vPD = ( VisualPluginData * ) refCon;
-	if (has_init) oldSpeed = vPD->motorSpeed;
-	
+	REZ_PROBE_START( messageStart );
+
+	/*
+	 * Windows does not promise that init comes first, and until it has
+	 * there is nothing to apply anything to.  Nor, after cleanup, is there
+	 * anything left.
+	 */
+	handle = 0;
+	vPD = nil;
+	if( message != kVisualPluginInitMessage )
+	{
+		handle = ( int ) ( size_t ) refCon;
+		vPD = EnterInstance( handle );
+		if( vPD == nil ) return noErr;
+	}
+	REZ_HANDLER_START( handling, MessageProbe( message ) );
+
+	posted.type = message;
+	posted.buffer = REZ_QUEUE_NONE;
+	posted.stamp = 0;
+	posted.positionMS = 0;
+	posted.value = 0;
+	posted.arrived = RezTimeNow();
 	status = noErr;
 	
 	switch( message )
@@ -171,57 +550,117 @@ static OSStatus VisualPluginHandler( OSType message, VisualPluginMessageInfo *me
 		 */
 		case kVisualPluginInitMessage:
 		{
-			int i = 0;
-			has_init = 1;
-			vPD = ( VisualPluginData * ) malloc(sizeof( VisualPluginData ) );
+			vPD = CreateInstance();
 			if( vPD == nil )
 			{
 				status = memFullErr;
 				break;
 			}
+			handle = OpenInstance( vPD );
+			if( handle == 0 )
+			{
+				DestroyInstance( vPD );
+				vPD = nil;
+				status = memFullErr;
+				break;
+			}
 
 			vPD->appCookie	= messageInfo->u.initMessage.appCookie;
 			vPD->appProc	= messageInfo->u.initMessage.appProc;
-			vPD->motorSpeed = 0;
+			vPD->hot->motorSpeed = 0;
+			vPD->hot->fullVolume = FULLVOLUME;
 			vPD->running = false;
-			vPD->hasVibe = false;
+			vPD->hot->showing = false;
+			vPD->hot->playing = false;
+			vPD->hot->hasVibe = false;
+			vPD->hot->hasActuator = false;
+			vPD->hot->active = false;
+			vPD->hot->resuming = false;
+			vPD->settled = false;
+			RezAtomicStore( &vPD->resting, 1 );
+
+			RezDetectorInit( &vPD->hot->detector );
+			vPD->hot->detector.now = RezTimeNow;
+			RezEnvelopeDefaults( &vPD->hot->envelope );
+			
+			vPD->destPort = nil;
+			RezMutexInit( &vPD->screenLock );
+			RezMutexInit( &vPD->saveLock );
+#if TARGET_OS_MAC
+			vPD->destColourSpace = CGColorSpaceCreateDeviceRGB();
+			vPD->destBitmap = nil;
+#else
+			vPD->destDC = nil;
+			MemClear( &vPD->destBitmapInfo, sizeof( vPD->destBitmapInfo ) );
+			vPD->destBitmapInfo.bmiHeader.biSize = sizeof( BITMAPINFOHEADER );
+			vPD->destBitmapInfo.bmiHeader.biPlanes = 1;
+			vPD->destBitmapInfo.bmiHeader.biBitCount = 32;
+			vPD->destBitmapInfo.bmiHeader.biCompression = BI_RGB;
+#endif
+			RezFramebufferInit( &vPD->framebuffer );
+			MemClear( &vPD->hot->visual, sizeof( vPD->hot->visual ) );
+			MemClear( &vPD->shownFrom, sizeof( vPD->shownFrom ) );
+			MemClear( &vPD->shownTo, sizeof( vPD->shownTo ) );
+			RezTripleInit( &vPD->published );
+			vPD->lastDraw = 0;
 
-			for(i = 0; i < FREQUENCYBANDS; ++i)
 			{
-				vPD->energyHistory[i] = (list_element*) malloc(sizeof(list_element));
-				vPD->energyHistory[i]->next = nil;
-				vPD->energyCount[i] = 0;
-				vPD->energyAggregate[i] = 0;
+				char directory[ REZ_CACHE_PATH ];
+
+				vPD->hasBeatCache = RezBeatCacheDefaultDirectory( directory, sizeof( directory ) ) &&
+									RezBeatCacheOpen( &vPD->beatCache, directory );
 			}
-			
-			vPD->tv = nil;
+			vPD->hot->hasTrack = false;
+			vPD->hasProfile = false;
+			vPD->hot->replayBeats = nil;
+			vPD->hasLookahead = RezLookaheadStart( &vPD->lookahead, RECORDBEATS );
+			vPD->hasTelemetry = RezTelemetryCreate( &vPD->telemetry );
+			vPD->hasEvents = RezEventsOpen( &vPD->events );
+			vPD->hot->eventSpeed = 0;
+			vPD->hot->latency = vPD->hasTelemetry ? vPD->telemetry.latency : &vPD->localLatency;
+			RezLatencyClear( vPD->hot->latency );
+			vPD->hot->hasDeliveryBase = false;
+			RezGovernorInit( &vPD->hot->governor, vPD->hasTelemetry ? &vPD->telemetry.header->governor : &vPD->localGovernor, FRAMEBUDGETMS * 1000 );
+			RezAtomicStore( &vPD->drawUS, 0 );
+			RezAtomicStore( &vPD->stagesShed, 0 );
+
 			SetupDevice(vPD);
-			messageInfo->u.initMessage.refCon = (void*) vPD;
+			vPD->hasOwner = RezThreadStart( &vPD->owner, OwnerMain, vPD, REZ_PRIORITY_NORMAL );
+			messageInfo->u.initMessage.refCon = (void*) ( size_t ) handle;
+			RezAtomicStore( &instances[ handle % INSTANCES ].handle, handle );
+			handle = 0;
 			break;
 		}
 		/*
-		 * Cleanup.
+		 * Cleanup.  The owner finishes whatever was posted before this,
+		 * and its own cleaning up, before it goes.
 		 */
 		case kVisualPluginCleanupMessage:
+			RetireInstance( handle );
+			if( vPD->hasOwner )
 			{
-				int i;
-				CleanupDevice( vPD );
-				for(i = 0; i < FREQUENCYBANDS; ++i)
-				{	
-					list_element* cleanup = vPD->energyHistory[i];
-					list_element* old_element;
-					while(cleanup != nil)
-					{
-						old_element = cleanup;
-						cleanup = cleanup->next;
-						free(old_element);
-					}
-				}
-				if( vPD != nil) free( vPD );
-				break;
+				while( !RezQueuePost( vPD->queue, &posted, true ) ) RezThreadSleep( 1 );
+				RezThreadJoin( &vPD->owner );
 			}
+			else
+				Apply( vPD, &posted );
+			SaveCalibration( vPD );
+			RezQueueDestroy( vPD->queue );
+			ReleaseScreen( vPD );
+			RezFramebufferRelease( &vPD->framebuffer );
+#if TARGET_OS_MAC
+			CGColorSpaceRelease( vPD->destColourSpace );
+#endif
+			RezMutexDestroy( &vPD->screenLock );
+			RezMutexDestroy( &vPD->saveLock );
+			DestroyInstance( vPD );
+			FreeInstance( handle );
+			handle = 0;
+			vPD = nil;
+			break;
 
 		case kVisualPluginShowWindowMessage:
+			RezMutexLock( &vPD->screenLock );
 			vPD->destOptions = messageInfo->u.showWindowMessage.options;
 			status = ChangeVisualPort( vPD,
 #if TARGET_OS_WIN32
@@ -232,59 +671,398 @@ static OSStatus VisualPluginHandler( OSType message, VisualPluginMessageInfo *me
 										&messageInfo->u.showWindowMessage.drawRect);			
 			vPD->destRect = messageInfo->u.showWindowMessage.drawRect;
 			vPD->running = true;
+			posted.value = true;
+			RezAtomicStore( &vPD->wantShowing, 1 );
+			Post( vPD, &posted, true );
 			if(status == noErr)
 			{
 				UpdateScreen( vPD );
 			}
+			RezMutexUnlock( &vPD->screenLock );
 			break;
 		
+		case kVisualPluginSetWindowMessage:
+			RezMutexLock( &vPD->screenLock );
+			vPD->destOptions = messageInfo->u.setWindowMessage.options;
+			status = ChangeVisualPort( vPD,
+#if TARGET_OS_WIN32
+										messageInfo->u.setWindowMessage.window,
+#else
+										messageInfo->u.setWindowMessage.port,
+#endif
+										&messageInfo->u.setWindowMessage.drawRect);
+			if(status == noErr)
+			{
+				UpdateScreen( vPD );
+			}
+			RezMutexUnlock( &vPD->screenLock );
+			break;
+
 		case kVisualPluginHideWindowMessage:
+			RezMutexLock( &vPD->screenLock );
 			vPD->running = false;
+			posted.value = false;
+			RezAtomicStore( &vPD->wantShowing, 0 );
+			Post( vPD, &posted, true );
+			ReleaseScreen( vPD );
+			RezFramebufferRelease( &vPD->framebuffer );
+			RezMutexUnlock( &vPD->screenLock );
 			break;
 		
+		/*
+		 * The host lost the window contents.  Our framebuffer still has
+		 * them, so copy it all back without redrawing.
+		 */
 		case kVisualPluginUpdateMessage:
-			UpdateScreen( vPD );
+			RezMutexLock( &vPD->screenLock );
+			if( vPD->running )
+			{
+				RezFramebufferInvalidate( &vPD->framebuffer );
+				vPD->settled = false;
+				UpdateScreen( vPD );
+			}
+			RezMutexUnlock( &vPD->screenLock );
 			break;
 		
+		/*
+		 * Detection happens on the owner thread.  The spectrum only lives
+		 * as long as this call, so it goes into a pooled buffer; if there
+		 * is none free the owner is far behind, and the frame is dropped.
+		 * At rest nothing is posted at all, so the owner is not woken.
+		 */
 		case kVisualPluginRenderMessage:
-			vPD->renderTimeStampID	= messageInfo->u.renderMessage.timeStampID;
-			ProcessRenderData( vPD, messageInfo->u.renderMessage.renderData );
-			UpdateScreen( vPD );
+			if( RezAtomicLoad( &vPD->resting ) ) break;
+			posted.stamp = messageInfo->u.renderMessage.timeStampID;
+			posted.positionMS = messageInfo->u.renderMessage.currentPositionInMS;
+			if( messageInfo->u.renderMessage.renderData != nil )
+			{
+				posted.buffer = RezQueueClaim( vPD->queue, false );
+				if( posted.buffer == REZ_QUEUE_NONE ) break;
+				*( RenderVisualData * ) RezQueueBuffer( vPD->queue, posted.buffer ) = *messageInfo->u.renderMessage.renderData;
+			}
+			Post( vPD, &posted, false );
 			break;
 		
+		case kVisualPluginChangeTrackMessage:
+			PostTrack( vPD, &posted, messageInfo->u.changeTrackMessage.trackInfoUnicode );
+			break;
+
 		case kVisualPluginPlayMessage:
-			vPD->volume = messageInfo->u.playMessage.volume;
+			posted.value = messageInfo->u.playMessage.volume;
+			RezAtomicStore( &vPD->wantVolume, ( int ) posted.value );
+			RezAtomicStore( &vPD->wantPlaying, 1 );
+			PostTrack( vPD, &posted, messageInfo->u.playMessage.trackInfoUnicode );
+			break;
+
+		case kVisualPluginSetPositionMessage:
+			posted.value = RezAtomicAdd( &vPD->seeks, 1 );
+			Post( vPD, &posted, true );
+			break;
+
 		case kVisualPluginUnpauseMessage:
-			vPD->playing = true;
+			RezAtomicStore( &vPD->wantPlaying, 1 );
+			Post( vPD, &posted, true );
 			break;
 
 		case kVisualPluginStopMessage:
 		case kVisualPluginPauseMessage:
-			vPD->playing = false;
+			RezAtomicStore( &vPD->wantPlaying, 0 );
+			Post( vPD, &posted, true );
 			break;
 
 		case kVisualPluginIdleMessage:
+			if( !vPD->hasOwner ) CollectLookahead( vPD );
+			SaveCalibration( vPD );
+			RezMutexLock( &vPD->screenLock );
+			if( vPD->running && RezTimeNow() - vPD->lastDraw >= REZ_MS( 1000 ) / DISPLAYHZ )
+				UpdateScreen( vPD );
+			RezMutexUnlock( &vPD->screenLock );
 			break;
 
+		/*
+		 * Options.  The first time runs the vibrator up slowly from
+		 * stopped, and the next says it can be felt, which calibrates a
+		 * unit that cannot be swept; see rezActuator.h.  The calibration
+		 * is saved at the next idle.
+		 */
+		case kVisualPluginConfigureMessage:
+			if( vPD->hot->hasActuator ) RezActuatorFeel( vPD->actuator );
+			break;
 		
 		case kVisualPluginEnableMessage:
 		case kVisualPluginDisableMessage:
-			return noErr;
+			break;
 
 		default:
 			status = unimpErr;
 			break;
 	}
-	
-	if( has_init == 1)
+
+	if( handle != 0 ) LeaveInstance( handle );
+	REZ_HANDLER_STOP( handling );
+	REZ_PROBE_STOP( messageStart, MessageProbe( message ) );
+	return noErr;	
+}
+
+/*
+ * Hand a message to the owner, or if there is no owner thread, apply it
+ * here and now.  The host's thread never waits for room.  A frame is
+ * dropped, along with its buffer, when the queue is full.  Essential
+ * messages have places kept for them that frames cannot take, and what
+ * they change is also left where the owner finds it, in wantShowing,
+ * wantPlaying, wantVolume and seeks, so that if even those places are
+ * taken the owner can catch up without the message; see CatchUp.  A
+ * track change cannot be rebuilt that way, so one that is lost is marked
+ * in lostTrack.
+ */
+static void Post( VisualPluginData *vPD, const RezMessage *posted, Boolean essential )
+{
+	if( !vPD->hasOwner )
+	{
+		Apply( vPD, posted );
+		return;
+	}
+	if( RezQueuePost( vPD->queue, posted, essential ) ) return;
+	RezQueueRelease( vPD->queue, posted->buffer );
+	if( posted->type == kVisualPluginChangeTrackMessage || posted->type == kVisualPluginPlayMessage )
+		RezAtomicStore( &vPD->lostTrack, 1 );
+}
+
+/*
+ * Track info goes in a buffer like the spectrum does, one of those kept
+ * for essential messages if need be.  With none free the track goes
+ * without, and is treated like a stream: played, but not cached.
+ */
+static void PostTrack( VisualPluginData *vPD, RezMessage *posted, const ITTrackInfo *trackInfo )
+{
+	if( trackInfo != nil )
 	{
-		if (vPD->playing == false || vPD->running == false) vPD->motorSpeed = 0;	
-		if (oldSpeed != vPD->motorSpeed && vPD->hasVibe == true ) SetSpeed( vPD );
+		posted->buffer = RezQueueClaim( vPD->queue, true );
+		if( posted->buffer != REZ_QUEUE_NONE )
+			*( ITTrackInfo * ) RezQueueBuffer( vPD->queue, posted->buffer ) = *trackInfo;
 	}
+	Post( vPD, posted, true );
+}
+
+/*
+ * The owner thread holds the detector, the track and the motor, and so
+ * sees messages one at a time, in the order the host sent them, however
+ * many threads it sent them from.  It looks for finished look-ahead maps
+ * whenever it wakes.
+ */
+static void OwnerMain( void *argument )
+{
+	VisualPluginData *vPD = ( VisualPluginData * ) argument;
+	RezMessage message;
+	REZ_HANDLER( handling )
+
+	for( ;; )
+	{
+		while( RezQueueTake( vPD->queue, &message ) )
+		{
+			Apply( vPD, &message );
+			if( message.type == kVisualPluginCleanupMessage ) return;
+		}
+		REZ_HANDLER_START( handling, REZ_PROBE_TRACK );
+		CatchUp( vPD );
+		CollectLookahead( vPD );
+		REZ_HANDLER_STOP( handling );
+		RezQueueWait( vPD->queue, vPD->hot->active ? OWNERWAKEMS : -1 );
+	}
+}
+
+/*
+ * Everything but drawing.  Any buffer that came with the message is given
+ * back once it has been used.
+ */
+static void Apply( VisualPluginData *vPD, const RezMessage *message )
+{
+	void *buffer = message->buffer == REZ_QUEUE_NONE ? nil : RezQueueBuffer( vPD->queue, message->buffer );
+	REZ_PROBE( applyStart )
+	REZ_HANDLER( handling )
+
+	REZ_PROBE_START( applyStart );
+	REZ_HANDLER_START( handling, MessageProbe( ( OSType ) message->type ) );
+	StartTrace( vPD, message->arrived );
 	
-	return noErr;	
+	switch( message->type )
+	{
+		case kVisualPluginCleanupMessage:
+			FinishTrack( vPD );
+			if( vPD->hasLookahead ) RezLookaheadStop( &vPD->lookahead );
+			CleanupDevice( vPD );
+			REZ_INSTRUMENT_DUMP( vPD->hasBeatCache ? vPD->beatCache.directory : NULL );
+			if( vPD->hasBeatCache )
+			{
+				RezLatencyDump( vPD->hot->latency, vPD->beatCache.directory );
+				RezBeatCacheClose( &vPD->beatCache );
+			}
+			if( vPD->hasTelemetry ) RezTelemetryClose( &vPD->telemetry );
+			if( vPD->hasEvents ) RezEventsClose( &vPD->events );
+			REZ_HANDLER_STOP( handling );
+			return;
+
+		case kVisualPluginShowWindowMessage:
+		case kVisualPluginHideWindowMessage:
+			vPD->hot->showing = message->value != 0;
+			break;
+
+		/*
+		 * Detection only.  Drawing picks the result up at display rate
+		 * from the idle message.  Frames posted before going to rest are
+		 * ignored.  The first frame back finds the detector as it was
+		 * left, which is right after a pause; if playback moved on
+		 * meanwhile it is warmed up as for a seek.
+		 */
+		case kVisualPluginRenderMessage:
+		{
+			RezTime started = RezTimeNow();
+			Boolean beat;
+
+			if( !vPD->hot->active ) break;
+			if( vPD->hot->resuming )
+			{
+				if( vPD->hot->hasPosition && ( message->positionMS < vPD->hot->positionMS || message->positionMS > vPD->hot->positionMS + SEEKMS ) )
+					WarmStart( vPD, true );
+				vPD->hot->resuming = false;
+			}
+			vPD->hot->renderTimeStampID	= message->stamp;
+			vPD->hot->trace.stamp = vPD->hot->renderTimeStampID;
+			vPD->hot->stageUS[ REZ_STAGE_DETAIL ] = ( unsigned long ) RezAtomicExchange( &vPD->drawUS, 0 );
+			beat = ProcessRenderData( vPD, ( const RenderVisualData * ) buffer );
+			vPD->hot->trace.detected = RezTimeNow();
+			vPD->hot->stageUS[ REZ_STAGE_HORIZONS ] = ( unsigned long ) ( vPD->hot->detector.historyTime / 1000 );
+			vPD->hot->striking = false;
+			if( !FollowTrack( vPD, message->positionMS, beat ) && beat )
+			{
+				vPD->hot->striking = true;
+				vPD->hot->strikePeak = vPD->hot->detector.motorSpeed;
+			}
+			vPD->hot->trace.decided = RezTimeNow();
+			RecordLatency( vPD, message->positionMS );
+			if( vPD->hot->striking ) Strike( vPD, vPD->hot->strikePeak );
+			vPD->hot->motorSpeed = RezEnvelopeLevel( &vPD->hot->envelope, RezEnvelopeTick( RezTimeNow() ) );
+			vPD->hot->hasVibe = vPD->hot->hasActuator && RezActuatorPresent( vPD->actuator );
+			PublishState( vPD );
+			if( !RezGovernorSheds( &vPD->hot->governor, REZ_STAGE_TELEMETRY ) ) RecordTelemetry( vPD );
+			else vPD->hot->stageUS[ REZ_STAGE_TELEMETRY ] = 0;
+			SendEvents( vPD );
+			Govern( vPD, started );
+			break;
+		}
+		
+		/*
+		 * iTunes pauses by stopping and then playing the same track again,
+		 * so only a different track ends the current one.
+		 */
+		case kVisualPluginChangeTrackMessage:
+			StartTrack( vPD, ( const ITTrackInfo * ) buffer );
+			vPD->hot->hasDeliveryBase = false;
+			break;
+
+		case kVisualPluginSetPositionMessage:
+			WarmStart( vPD, true );
+			vPD->seeksApplied = ( int ) message->value;
+			vPD->hot->hasDeliveryBase = false;
+			break;
+
+		case kVisualPluginPlayMessage:
+			SetVolume( vPD, ( SInt32 ) message->value );
+			StartTrack( vPD, ( const ITTrackInfo * ) buffer );
+		case kVisualPluginUnpauseMessage:
+			vPD->hot->playing = true;
+			vPD->hot->hasDeliveryBase = false;
+			break;
+
+		case kVisualPluginStopMessage:
+		case kVisualPluginPauseMessage:
+			vPD->hot->playing = false;
+			break;
+	}
+	RezQueueRelease( vPD->queue, message->buffer );
+
+	if( ( vPD->hot->playing && vPD->hot->showing ) != vPD->hot->active )
+		SetActive( vPD, vPD->hot->playing && vPD->hot->showing );
+	REZ_HANDLER_STOP( handling );
+	REZ_PROBE_STOP( applyStart, MessageProbe( ( OSType ) message->type ) );
+}
+
+/*
+ * Tell the detector the volume as a fraction of the loudest it can be.
+ */
+static void SetVolume( VisualPluginData *vPD, SInt32 volume )
+{
+	if( volume > vPD->hot->fullVolume ) vPD->hot->fullVolume = volume;
+	vPD->hot->volume = volume;
+	RezDetectorGain( &vPD->hot->detector, ( float ) volume / vPD->hot->fullVolume );
+}
+
+/*
+ * Put right whatever an essential message lost to a full queue would have
+ * changed.  This runs once the queue is empty, so every message that was
+ * posted has been applied, and anything still different here is newer.
+ */
+static void CatchUp( VisualPluginData *vPD )
+{
+	Boolean showing = RezAtomicLoad( &vPD->wantShowing ) != 0;
+	Boolean playing = RezAtomicLoad( &vPD->wantPlaying ) != 0;
+	SInt32 volume = RezAtomicLoad( &vPD->wantVolume );
+	int seeks = RezAtomicLoad( &vPD->seeks );
+
+	/*
+	 * Whatever was recorded since belongs to two tracks, so none of it is
+	 * kept.
+	 */
+	if( RezAtomicExchange( &vPD->lostTrack, 0 ) )
+	{
+		vPD->hot->recordValid = false;
+		vPD->hot->profileFrames = 0;
+		StartTrack( vPD, nil );
+		vPD->hot->hasDeliveryBase = false;
+	}
+	if( volume != vPD->hot->volume ) SetVolume( vPD, volume );
+	if( seeks != vPD->seeksApplied )
+	{
+		WarmStart( vPD, true );
+		vPD->seeksApplied = seeks;
+		vPD->hot->hasDeliveryBase = false;
+	}
+	if( playing != vPD->hot->playing )
+	{
+		vPD->hot->playing = playing;
+		vPD->hot->hasDeliveryBase = false;
+	}
+	vPD->hot->showing = showing;
+	if( ( playing && showing ) != vPD->hot->active )
+		SetActive( vPD, playing && showing );
 }
 
+#if REZ_INSTRUMENT
+/*
+ * Which histogram a message's handling time goes into.
+ */
+static int MessageProbe( OSType message )
+{
+	switch( message )
+	{
+		case kVisualPluginRenderMessage:		return REZ_PROBE_RENDER;
+		case kVisualPluginIdleMessage:			return REZ_PROBE_IDLE;
+		case kVisualPluginUpdateMessage:		return REZ_PROBE_UPDATE;
+		case kVisualPluginShowWindowMessage:
+		case kVisualPluginSetWindowMessage:
+		case kVisualPluginHideWindowMessage:	return REZ_PROBE_WINDOW;
+		case kVisualPluginChangeTrackMessage:
+		case kVisualPluginSetPositionMessage:	return REZ_PROBE_TRACK;
+		case kVisualPluginPlayMessage:
+		case kVisualPluginUnpauseMessage:		return REZ_PROBE_PLAY;
+		case kVisualPluginStopMessage:
+		case kVisualPluginPauseMessage:			return REZ_PROBE_PAUSE;
+		case kVisualPluginInitMessage:			return REZ_PROBE_INIT;
+		default:								return REZ_PROBE_MESSAGE;
+	}
+}
+#endif
+
 static OSStatus RegisterVisualPlugin( PluginMessageInfo *messageInfo )
 {
 	OSStatus			status;
@@ -310,9 +1088,9 @@ static OSStatus RegisterVisualPlugin( PluginMessageInfo *messageInfo )
 	#endif TARGET_OS_MAC
 
 #if TARGET_OS_MAC
-	playerMessageInfo.u.registerVisualPluginMessage.options					= kVisualProvidesUnicodeName;
+	playerMessageInfo.u.registerVisualPluginMessage.options					= kVisualProvidesUnicodeName | kVisualWantsIdleMessages | kVisualWantsConfigure;
 #else
-	playerMessageInfo.u.registerVisualPluginMessage.options					= 0;
+	playerMessageInfo.u.registerVisualPluginMessage.options					= kVisualWantsIdleMessages | kVisualWantsConfigure;
 #endif
 	playerMessageInfo.u.registerVisualPluginMessage.handler					= (VisualPluginProcPtr)VisualPluginHandler;
 	playerMessageInfo.u.registerVisualPluginMessage.registerRefCon			= 0;
@@ -340,172 +1118,638 @@ static void MemClear( LogicalAddress dest, SInt32 length )
 }
 
 /*
- * This function should be called every RETAINMS / RETAINSAMPLES milliseconds
- * with a new dump of processed spectrum data.  The spectrum is traversed in
- * bands, and an average sonic energy is determined for the band.
- *
- * This is compared with RETAINSAMPLES historical records to detect if the
- * criteria for a "beat" has been found.  If the beat, considered as a multiple
- * of the channels historical average is stronger than any previously recorded
- * beat, it becomes the current dominant beat.
- *
- * Dominant beats affect the motor speed in relation to which band they
- * were discovered in.  If no beat is found, the motor speed decays.
+ * Run the detector over the rows iTunes sent and keep what it saw for the
+ * visualiser.  The decision itself is RezDetectorProcess, shared with the
+ * offline analysis.
  */
 
-static void ProcessRenderData( VisualPluginData *vPD, const RenderVisualData *renderData )
+static Boolean ProcessRenderData( VisualPluginData *vPD, const RenderVisualData *renderData )
 {
-	int	bandindex, start, end;
-	float bestratio = 0;
+	static const UInt8 silence[ kVisualNumSpectrumEntries ] = { 0 };
+	const UInt8 *left, *right;
+	Boolean beat;
+	int	bandindex;
 	
-	if( renderData == nil ) return;
+	if( renderData == nil ) return false;
 	
-	start = end = 0;
-			
+	left = ( renderData->numSpectrumChannels > 0 ) ? renderData->spectrumData[ 0 ] : silence;
+	right = ( renderData->numSpectrumChannels > 1 ) ? renderData->spectrumData[ 1 ] : left;
+	beat = RezDetectorProcess( &vPD->hot->detector, left, right ) != 0;
+
 	for( bandindex = 0; bandindex < FREQUENCYBANDS; bandindex++ )
 	{
-		float energy, historicalAverage, ratio;
-		int channel, weight, index;
-		list_element* curr;
-		historicalAverage = energy = 0;
-		weight = 0;
-		
-		end = powf( 512.0,  ( bandindex + 1 ) / FREQUENCYBANDS );
+		vPD->hot->visual.energy[ bandindex ] = vPD->hot->detector.energy[ bandindex ];
+		vPD->hot->visual.average[ bandindex ] = vPD->hot->detector.average[ bandindex ];
+		vPD->hot->visual.threshold[ bandindex ] = vPD->hot->detector.threshold[ bandindex ];
+	}
+	vPD->hot->visual.confidence = vPD->hot->detector.confidence;
+	vPD->hot->visual.beats = vPD->hot->detector.beats;
+	vPD->hot->visual.frame++;
+	return beat;
+}
 
-		/*
-		 * "Instant" energy.
-		 */
-		for( index = start; index < end; index++ )
-			for( channel = 0; channel < renderData->numSpectrumChannels; channel++ )
+/*
+ * A track is known by a hash of its name, artist, album, length and size.
+ * Streams and anything without a length are not cached.
+ */
+
+static void StartTrack( VisualPluginData *vPD, const ITTrackInfo *trackInfo )
+{
+	RezTrackKey key = 0;
+	int i;
+
+	if( trackInfo == nil || !( trackInfo->validFields & kITTITotalTimeFieldMask ) || trackInfo->totalTimeInMS == 0 )
+	{
+		FinishTrack( vPD );
+		vPD->hasProfile = false;
+		WarmStart( vPD, false );
+		return;
+	}
+
+	if( trackInfo->validFields & kITTINameFieldMask )
+		key = RezTrackKeyHash( key, trackInfo->name, ( trackInfo->name[ 0 ] + 1 ) * sizeof( UniChar ) );
+	if( trackInfo->validFields & kITTIArtistFieldMask )
+		key = RezTrackKeyHash( key, trackInfo->artist, ( trackInfo->artist[ 0 ] + 1 ) * sizeof( UniChar ) );
+	if( trackInfo->validFields & kITTIAlbumFieldMask )
+		key = RezTrackKeyHash( key, trackInfo->album, ( trackInfo->album[ 0 ] + 1 ) * sizeof( UniChar ) );
+	key = RezTrackKeyHash( key, &trackInfo->totalTimeInMS, sizeof( trackInfo->totalTimeInMS ) );
+	if( trackInfo->validFields & kITTISizeFieldMask )
+		key = RezTrackKeyHash( key, &trackInfo->sizeInBytes, sizeof( trackInfo->sizeInBytes ) );
+
+	if( vPD->hot->hasTrack && vPD->trackKey == key ) return;
+	FinishTrack( vPD );
+	vPD->hasProfile = false;
+
+	vPD->hot->hasTrack = true;
+	vPD->trackKey = key;
+	vPD->trackLengthMS = trackInfo->totalTimeInMS;
+	vPD->hot->positionMS = vPD->hot->firstPositionMS = 0;
+	vPD->hot->hasPosition = false;
+	vPD->hot->recordCount = 0;
+	vPD->hot->recordValid = true;
+	vPD->hot->replayCursor = 0;
+	vPD->hot->profileFrames = 0;
+	for( i = 0; i < FREQUENCYBANDS; i++ ) vPD->hot->profileSum[ i ] = 0;
+	if( vPD->hasBeatCache )
+	{
+		vPD->hasProfile = RezBeatCacheLoadProfile( &vPD->beatCache, key, vPD->trackProfile ) != 0;
+		vPD->hot->replayBeats = RezBeatCacheLookup( &vPD->beatCache, key, &vPD->hot->replayCount );
+	}
+	if( vPD->hot->replayBeats == nil ) LookAhead( vPD, trackInfo );
+	WarmStart( vPD, false );
+}
+
+/*
+ * Store what was recorded if it covers the whole track, fold this play's
+ * band energies into the track's profile, and forget it.
+ */
+
+static void FinishTrack( VisualPluginData *vPD )
+{
+	if( !vPD->hot->hasTrack ) return;
+
+	if( vPD->hasBeatCache && vPD->hot->profileFrames >= PROFILEFRAMES )
+	{
+		float mean[ FREQUENCYBANDS ];
+		int band;
+
+		for( band = 0; band < FREQUENCYBANDS; band++ ) mean[ band ] = ( float ) ( vPD->hot->profileSum[ band ] / vPD->hot->profileFrames );
+		RezBeatCacheStoreProfile( &vPD->beatCache, vPD->trackKey, mean, vPD->hot->profileFrames );
+	}
+
+	if( vPD->hot->replayBeats == nil && vPD->hot->recordValid && vPD->hasBeatCache &&
+		vPD->hot->firstPositionMS <= CACHESTARTMS && vPD->hot->positionMS + CACHEENDMS >= vPD->trackLengthMS )
+		RezBeatCacheStore( &vPD->beatCache, vPD->trackKey, vPD->hot->recordBeats, vPD->hot->recordCount );
+
+	if( vPD->hasBeatCache ) RezBeatCacheRelease( &vPD->beatCache );
+	vPD->hot->replayBeats = nil;
+	vPD->hot->hasTrack = false;
+}
+
+/*
+ * After a jump, the history describes music that is no longer playing.
+ * Replace it with the track's long run band means if we have them.  For a
+ * seek within a track without a profile, the long history is the next
+ * best guess at the track's levels; a new track without one starts cold.
+ */
+
+static void WarmStart( VisualPluginData *vPD, Boolean sameTrack )
+{
+	float mean[ FREQUENCYBANDS ];
+	int band;
+
+	RezHistory *history = &vPD->hot->detector.history;
+
+	if( vPD->hasProfile )
+		RezHistoryFill( history, vPD->trackProfile );
+	else if( sameTrack && history->written > 0 )
+	{
+		for( band = 0; band < FREQUENCYBANDS; band++ )
+			mean[ band ] = RezHistoryAverage( history, history->horizons - 1, band );
+		RezHistoryFill( history, mean );
+	}
+	else
+		RezHistoryReset( history );
+}
+
+/*
+ * The visual API never says where a track's file is.  Some hosts put a
+ * full path in the file name, and only then can the file be analysed
+ * ahead of playback.  Nothing says which track is next either, so only
+ * the one starting now is looked at.
+ */
+
+static void LookAhead( VisualPluginData *vPD, const ITTrackInfo *trackInfo )
+{
+	const UniChar *name = &trackInfo->fileName[ 1 ];
+	int length = trackInfo->fileName[ 0 ];
+	char path[ REZ_CACHE_PATH ];
+
+	if( !vPD->hasLookahead || !vPD->hasBeatCache || !( trackInfo->validFields & kITTIFileNameFieldMask ) || length == 0 )
+		return;
+
+#if TARGET_OS_WIN32
+	if( !( length > 2 && name[ 1 ] == ':' ) && !( length > 2 && name[ 0 ] == '\\' && name[ 1 ] == '\\' ) ) return;
+	length = WideCharToMultiByte( CP_ACP, 0, name, length, path, sizeof( path ) - 1, NULL, NULL );
+	if( length == 0 ) return;
+	path[ length ] = 0;
+#else
+	/*
+	 * UTF-8 by hand, as a CFString would be allocated on every track
+	 * change.  The file system takes precomposed names as readily as the
+	 * decomposed ones it stores.
+	 */
+	{
+		unsigned long used = 0, c;
+		int i;
+
+		if( name[ 0 ] != '/' ) return;
+		for( i = 0; i < length; i++ )
+		{
+			c = name[ i ];
+			if( c >= 0xd800 && c < 0xdc00 && i + 1 < length && name[ i + 1 ] >= 0xdc00 && name[ i + 1 ] < 0xe000 )
 			{
-				energy += renderData->spectrumData[ channel ][ index ];
-				weight++;
+				c = 0x10000 + ( ( c - 0xd800 ) << 10 ) + ( name[ i + 1 ] - 0xdc00 );
+				i++;
 			}
-		if( energy ) energy /= weight;
-		
-		/*
-		 * "Historical" energy.
-		 */
-		historicalAverage = vPD->energyAggregate[ bandindex ] / vPD->energyCount[ bandindex ];
+			if( used + 4 >= sizeof( path ) ) return;
+			if( c < 0x80 ) path[ used++ ] = ( char ) c;
+			else if( c < 0x800 )
+			{
+				path[ used++ ] = ( char ) ( 0xc0 | c >> 6 );
+				path[ used++ ] = ( char ) ( 0x80 | ( c & 0x3f ) );
+			}
+			else if( c < 0x10000 )
+			{
+				path[ used++ ] = ( char ) ( 0xe0 | c >> 12 );
+				path[ used++ ] = ( char ) ( 0x80 | ( c >> 6 & 0x3f ) );
+				path[ used++ ] = ( char ) ( 0x80 | ( c & 0x3f ) );
+			}
+			else
+			{
+				path[ used++ ] = ( char ) ( 0xf0 | c >> 18 );
+				path[ used++ ] = ( char ) ( 0x80 | ( c >> 12 & 0x3f ) );
+				path[ used++ ] = ( char ) ( 0x80 | ( c >> 6 & 0x3f ) );
+				path[ used++ ] = ( char ) ( 0x80 | ( c & 0x3f ) );
+			}
+		}
+		path[ used ] = 0;
+	}
+#endif
+	RezLookaheadQueue( &vPD->lookahead, vPD->trackKey, path, true );
+}
+
+/*
+ * Store a finished look-ahead map, and if it belongs to the track that is
+ * playing and nothing is being replayed yet, start replaying it from
+ * where playback has got to.
+ */
+
+static void CollectLookahead( VisualPluginData *vPD )
+{
+	RezTrackKey key;
+	RezBeat *beats;
+	unsigned long count;
+
+	if( !vPD->hasLookahead || !RezLookaheadCollect( &vPD->lookahead, &key, &beats, &count ) ) return;
+
+	if( vPD->hasBeatCache && !( vPD->hot->hasTrack && vPD->trackKey == key && vPD->hot->replayBeats != nil ) )
+	{
+		Boolean resume = vPD->hot->replayBeats != nil;
 
 		/*
-		 * Comparisons.
+		 * Storing lets go of the map being replayed, so map it again.
 		 */
-		ratio = energy / historicalAverage;
-		if( energy > historicalAverage + MINPEAK && ratio > SENSITIVITY && ratio > bestratio )
+		RezBeatCacheStore( &vPD->beatCache, key, beats, count );
+		if( vPD->hot->hasTrack && ( resume || vPD->trackKey == key ) )
 		{
-			bestratio = ratio;
-			vPD->motorSpeed = 255 - ( ( bandindex + 1 ) / FREQUENCYBANDS ) * FALLOFF;
-		}
-	
-		/* 
-		 * Storage of the "Instant" record in the history buffer.
-		 */
-		if( vPD->energyCount[ bandindex ] >= RETAINSAMPLES )
-		{
-			list_element* deadnode = vPD->energyHistory[ bandindex ];
-			vPD->energyAggregate[ bandindex ] -= deadnode->value;
-			vPD->energyHistory[ bandindex ] = deadnode->next;
-			free(deadnode);
-			--vPD->energyCount[ bandindex ];
+			vPD->hot->replayBeats = RezBeatCacheLookup( &vPD->beatCache, vPD->trackKey, &vPD->hot->replayCount );
+			if( vPD->hot->replayBeats != nil && !resume ) SeekReplay( vPD, vPD->hot->positionMS );
 		}
+	}
+}
+
+/*
+ * Point the replay at the first beat still to come at positionMS.
+ */
+
+static void SeekReplay( VisualPluginData *vPD, UInt32 positionMS )
+{
+	unsigned long low = 0, high = vPD->hot->replayCount;
+
+	positionMS += MOTORLEADMS;
+	while( low < high )
+	{
+		unsigned long middle = ( low + high ) / 2;
+
+		if( REZ_BEAT_POSITION( vPD->hot->replayBeats[ middle ] ) < positionMS ) low = middle + 1;
+		else high = middle;
+	}
+	vPD->hot->replayCursor = low;
+}
+
+/*
+ * Called each frame with where playback is.  For a track whose beats are
+ * known the motor is struck by them instead of the detector, MOTORLEADMS
+ * ahead of the music, and this returns true.  Otherwise detected beats are
+ * recorded for next time, unless a seek leaves a hole in the recording.
+ */
+
+static Boolean FollowTrack( VisualPluginData *vPD, UInt32 positionMS, Boolean beat )
+{
+	Boolean seeked;
+	int i;
+
+	if( !vPD->hot->hasTrack ) return false;
+
+	if( vPD->hot->hasPosition )
+		seeked = ( positionMS < vPD->hot->positionMS || positionMS > vPD->hot->positionMS + SEEKMS );
+	else
+	{
+		vPD->hot->firstPositionMS = positionMS;
+		vPD->hot->hasPosition = true;
+		seeked = true;
+	}
+	vPD->hot->positionMS = positionMS;
+
+	for( i = 0; i < FREQUENCYBANDS; i++ ) vPD->hot->profileSum[ i ] += vPD->hot->visual.energy[ i ];
+	vPD->hot->profileFrames++;
 
-		curr = vPD->energyHistory[ bandindex ];		
-		while(curr->next != nil)
+	if( vPD->hot->replayBeats != nil )
+	{
+		if( seeked ) SeekReplay( vPD, positionMS );
+		while( vPD->hot->replayCursor < vPD->hot->replayCount &&
+			   REZ_BEAT_POSITION( vPD->hot->replayBeats[ vPD->hot->replayCursor ] ) <= positionMS + MOTORLEADMS )
 		{
-			curr = curr->next;
+			vPD->hot->strikePeak = REZ_BEAT_SPEED( vPD->hot->replayBeats[ vPD->hot->replayCursor ] );
+			vPD->hot->replayCursor++;
+			vPD->hot->striking = true;
 		}
-		curr->next = (list_element*)malloc(sizeof(list_element));
-		curr = curr->next;
-		curr->next = nil;
-		curr->value = energy;
-		vPD->energyAggregate[ bandindex ] += energy;
-		++vPD->energyCount[ bandindex ];
+		return true;
 	}
-	
-	/*
-	 * Decay.
-	 */
-	if( bestratio == 0 )
+
+	if( seeked && positionMS != vPD->hot->firstPositionMS ) vPD->hot->recordValid = false;
+	if( beat && vPD->hot->recordValid )
 	{
-		if( vPD->motorSpeed <= DECAY ) vPD->motorSpeed = 0;
-		else vPD->motorSpeed -= DECAY;	
+		if( vPD->hot->recordCount < RECORDBEATS && positionMS <= REZ_BEAT_MAX_POSITION )
+			vPD->hot->recordBeats[ vPD->hot->recordCount++ ] = REZ_BEAT( positionMS, vPD->hot->detector.motorSpeed );
+		else
+			vPD->hot->recordValid = false;
 	}
+	return false;
 }
 
 /*
- * Just a flood fill of the screen.  Done in reds if there is no vibrator connected,
- * or greys if one is.  The only complication here is that the rectangle is QuickDraw,
- * not Quartz, and so needs to be inverted within the dimensions of the viewport.
+ * Hand the detector's view of the music over to the drawing side.  This
+ * never waits, however far behind drawing is.
+ */
+
+static void PublishState( VisualPluginData *vPD )
+{
+	RezVisualState *slot = RezTripleWriteSlot( &vPD->published );
+
+	vPD->hot->visual.motorSpeed = vPD->hot->motorSpeed;
+	vPD->hot->visual.hasVibe = vPD->hot->hasVibe;
+	vPD->hot->visual.time = RezTimeNow();
+	*slot = vPD->hot->visual;
+	RezTriplePublish( &vPD->published );
+}
+
+/*
+ * Put this frame's detector state where an outside tool can watch it.
+ * Like PublishState, this never waits for anyone.  What writing it cost
+ * is that stage's cost for this frame, and goes in the next record.
+ */
+
+static void RecordTelemetry( VisualPluginData *vPD )
+{
+	RezTelemetryRecord *record;
+	RezTime started = RezTimeNow();
+	RezTime detectUS = ( vPD->hot->trace.detected - vPD->hot->trace.arrived ) / 1000;
+	RezTime decideUS = ( vPD->hot->trace.decided - vPD->hot->trace.detected ) / 1000;
+	int band, stage;
+
+	if( !vPD->hasTelemetry ) return;
+
+	record = RezTelemetryBegin( &vPD->telemetry );
+	record->time = vPD->hot->visual.time;
+	record->frame = ( unsigned int ) vPD->hot->visual.frame;
+	record->stamp = vPD->hot->renderTimeStampID;
+	record->positionMS = vPD->hot->positionMS;
+	record->beats = vPD->hot->detector.beats;
+	record->motorSpeed = vPD->hot->motorSpeed;
+	record->detectorSpeed = vPD->hot->detector.motorSpeed;
+	record->confidence = vPD->hot->detector.confidence;
+	record->detectUS = ( unsigned short ) ( detectUS > 65535 ? 65535 : detectUS );
+	record->decideUS = ( unsigned short ) ( decideUS > 65535 ? 65535 : decideUS );
+	for( stage = 0; stage < REZ_STAGES; stage++ )
+		record->stageUS[ stage ] = ( unsigned short ) ( vPD->hot->stageUS[ stage ] > 65535 ? 65535 : vPD->hot->stageUS[ stage ] );
+	record->flags = ( vPD->hot->playing ? REZ_TELEMETRY_PLAYING : 0 ) |
+					( vPD->hot->replayBeats != nil ? REZ_TELEMETRY_REPLAYING : 0 ) |
+					( vPD->hot->hasVibe ? REZ_TELEMETRY_VIBE : 0 );
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+	{
+		record->energy[ band ] = vPD->hot->detector.energy[ band ];
+		record->average[ band ] = vPD->hot->detector.average[ band ];
+		record->threshold[ band ] = vPD->hot->detector.threshold[ band ];
+		record->ratio[ band ] = vPD->hot->detector.ratio[ band ];
+	}
+	RezTelemetryCommit( &vPD->telemetry );
+	vPD->hot->stageUS[ REZ_STAGE_TELEMETRY ] = ( unsigned long ) ( ( RezTimeNow() - started ) / 1000 );
+}
+
+/*
+ * Every message starts a trace from when it reached the plugin, so that a
+ * speed it sets can be followed to the motor.  Only render messages get a
+ * stamp, and a detect and decide stage of their own.
+ */
+
+static void StartTrace( VisualPluginData *vPD, RezTime arrived )
+{
+	vPD->hot->trace.stamp = 0;
+	vPD->hot->trace.arrived = arrived;
+	vPD->hot->trace.detected = vPD->hot->trace.arrived;
+	vPD->hot->trace.decided = vPD->hot->trace.arrived;
+}
+
+/*
+ * A frame's delivery delay is how much further its arrival is from its
+ * playback position than the best case since playback last jumped.  The
+ * best case creeps towards every frame by 1 / DELIVERYFRAMES of the
+ * difference, so slow drift between the player's clock and ours is not
+ * taken for delay.
+ */
+
+static void RecordLatency( VisualPluginData *vPD, UInt32 positionMS )
+{
+	double offsetMS = vPD->hot->trace.arrived / 1000000.0 - positionMS;
+
+	if( !vPD->hot->hasDeliveryBase || offsetMS < vPD->hot->deliveryBaseMS )
+	{
+		vPD->hot->deliveryBaseMS = offsetMS;
+		vPD->hot->hasDeliveryBase = true;
+	}
+	RezLatencyRecord( vPD->hot->latency, REZ_LATENCY_DELIVERY, ( RezTime ) ( ( offsetMS - vPD->hot->deliveryBaseMS ) * 1000000.0 ) );
+	vPD->hot->deliveryBaseMS += ( offsetMS - vPD->hot->deliveryBaseMS ) / DELIVERYFRAMES;
+
+	RezLatencyRecord( vPD->hot->latency, REZ_LATENCY_DETECT, vPD->hot->trace.detected - vPD->hot->trace.arrived );
+	RezLatencyRecord( vPD->hot->latency, REZ_LATENCY_DECIDE, vPD->hot->trace.decided - vPD->hot->trace.detected );
+}
+
+/*
+ * A frame costs its own detection and telemetry here, and whatever
+ * drawing has been done since the last one.  Each stage's part of that
+ * is passed on as well, for the governor to report.  When the governor
+ * sheds a stage or brings one back, the detector and the drawing are
+ * told.
+ */
+
+static void Govern( VisualPluginData *vPD, RezTime started )
+{
+	RezGovernor *governor = &vPD->hot->governor;
+	unsigned long frameUS = ( unsigned long ) ( ( RezTimeNow() - started ) / 1000 ) + vPD->hot->stageUS[ REZ_STAGE_DETAIL ];
+
+	if( !RezGovernorFrame( governor, frameUS, vPD->hot->stageUS ) ) return;
+	RezDetectorFocus( &vPD->hot->detector, RezGovernorSheds( governor, REZ_STAGE_HORIZONS ) );
+	RezAtomicStore( &vPD->stagesShed, governor->stagesShed );
+}
+
+/*
+ * Tell any subscriber which bands fired this frame, how sure the detector
+ * was of an onset and where the motor speed went, in one batch.  Frames
+ * with none of these send nothing.
+ */
+
+static void SendEvents( VisualPluginData *vPD )
+{
+	int band;
+
+	if( !vPD->hasEvents ) return;
+
+	RezEventsBegin( &vPD->events, vPD->hot->renderTimeStampID, vPD->hot->positionMS );
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+		if( vPD->hot->detector.beats & ( 1u << band ) )
+			RezEventsAdd( &vPD->events, REZ_EVENT_BEAT, band, vPD->hot->motorSpeed, vPD->hot->detector.ratio[ band ] );
+	if( vPD->hot->detector.beats != 0 )
+		RezEventsAdd( &vPD->events, REZ_EVENT_ONSET, 0, vPD->hot->motorSpeed, vPD->hot->detector.confidence );
+	if( vPD->hot->motorSpeed != vPD->hot->eventSpeed )
+	{
+		RezEventsAdd( &vPD->events, REZ_EVENT_SPEED, 0, vPD->hot->motorSpeed, 0 );
+		vPD->hot->eventSpeed = vPD->hot->motorSpeed;
+	}
+	RezEventsSend( &vPD->events );
+}
+
+/*
+ * Draw the newest published state into the framebuffer, then copy whatever
+ * changed to the window.  Between detector frames the picture is eased
+ * from the previous frame to the newest one over one data interval, unless
+ * the governor has shed that, when the newest frame is drawn as it is.
+ * Once it has arrived and nothing newer comes, as when paused, there is
+ * nothing to redraw until the window is uncovered or changed.  The time
+ * taken is added to the next frame's cost.
  */
 
 static void UpdateScreen( VisualPluginData *vPD )
 {
+	const RezVisualState *latest;
+	int fresh;
+	float alpha;
+	RezTime started;
+	REZ_PROBE( draw )
+
+	latest = RezTripleAcquire( &vPD->published, &fresh );
+	if( fresh )
+	{
+		vPD->shownFrom = vPD->shownTo;
+		vPD->shownTo = *latest;
+		vPD->settled = false;
+	}
+	else if( vPD->settled ) return;
+
+	started = vPD->lastDraw = RezTimeNow();
+	alpha = ( float ) ( vPD->lastDraw - vPD->shownTo.time ) / REZ_MS( RETAINMS / RETAINSAMPLES );
+	if( RezAtomicLoad( &vPD->stagesShed ) > REZ_STAGE_DETAIL ) alpha = 1.0f;
+	RezVisualStateBlend( &vPD->shown, &vPD->shownFrom, &vPD->shownTo, alpha );
+	if( alpha >= 1.0f ) vPD->settled = true;
+
+	REZ_PROBE_START( draw );
+	RezRenderFrame( &vPD->framebuffer, &vPD->shown );
+	RezFramebufferPresent( &vPD->framebuffer, BlitScreen, vPD );
+	REZ_PROBE_STOP( draw, REZ_PROBE_DRAW );
+	RezAtomicAdd( &vPD->drawUS, ( int ) ( ( RezTimeNow() - started ) / 1000 ) );
+}
+
+/*
+ * Copy the dirty part of the framebuffer to the window.  The only
+ * complication on the Mac is that the rectangle is QuickDraw, not Quartz,
+ * and so needs to be inverted within the dimensions of the viewport.
+ * Quartz takes an image never to change and may cache what it decoded,
+ * so the framebuffer is never wrapped in one that outlives a frame:
+ * each blit takes a fresh snapshot of the bitmap context, which copies
+ * only on write, and draws it clipped to the dirty part.  The snapshot
+ * is made by CoreGraphics, on the heap, so its trips there are put down
+ * to drawing rather than to the message; see rezreplay.c.
+ */
+
+static void BlitScreen( void *context, const RezFramebuffer *fb, const RezRect *dirty )
+{
+	VisualPluginData *vPD = ( VisualPluginData * ) context;
+	int width = dirty->right - dirty->left;
+	int height = dirty->bottom - dirty->top;
 #if TARGET_OS_MAC
-	float motorcolour = vPD->motorSpeed / 255.0;
 	Rect *drawrect = &vPD->destRect;
 	CGContextRef cgcontext;
+	CGImageRef image;
 	Rect bounds;
-	CGRect blob;	
+	REZ_HANDLER( handling )
 	
-	GetPortBounds( vPD->destPort, &bounds );
-	blob = CGRectMake( bounds.left, bounds.bottom - drawrect->bottom, bounds.right - bounds.left, drawrect->bottom - drawrect->top );
-	
-	QDBeginCGContext( vPD->destPort, &cgcontext );
-	
-		if( vPD->hasVibe == false ) CGContextSetRGBFillColor( cgcontext, motorcolour, 0, 0, 1 );
-		else CGContextSetRGBFillColor( cgcontext, motorcolour, motorcolour, motorcolour, 1 );	
-		CGContextFillRect( cgcontext, blob );
-	
-	QDEndCGContext( vPD->destPort, &cgcontext );
-#else
+	if( vPD->destBitmap == nil ) return;
+	REZ_HANDLER_START( handling, REZ_PROBE_DRAW );
+	image = CGBitmapContextCreateImage( vPD->destBitmap );
+	if( image != NULL )
 	{
-		RECT	srcRect;
-		HBRUSH	hBrush;
-		HDC		hdc;
-		int motorcolour = vPD->motorSpeed;
-		srcRect.left = vPD->destRect.left;
-		srcRect.top = vPD->destRect.top;
-		srcRect.right = vPD->destRect.right;
-		srcRect.bottom = vPD->destRect.bottom;
-		
-		hdc = GetDC(vPD->destPort);		
-		if (!(vPD->hasVibe))
-			hBrush = CreateSolidBrush(RGB((UInt16)motorcolour,0,0));
-		else
-			hBrush = CreateSolidBrush(RGB((UInt16)motorcolour, (UInt16)motorcolour, (UInt16)motorcolour));
-		FillRect(hdc, &srcRect, hBrush);
-		DeleteObject(hBrush);
-		ReleaseDC(vPD->destPort, hdc);
+		GetPortBounds( vPD->destPort, &bounds );
+		QDBeginCGContext( vPD->destPort, &cgcontext );
+			CGContextClipToRect( cgcontext, CGRectMake( drawrect->left + dirty->left, bounds.bottom - ( drawrect->top + dirty->bottom ), width, height ) );
+			CGContextDrawImage( cgcontext, CGRectMake( drawrect->left, bounds.bottom - ( drawrect->top + fb->height ), fb->width, fb->height ), image );
+		QDEndCGContext( vPD->destPort, &cgcontext );
+		CGImageRelease( image );
 	}
+	REZ_HANDLER_STOP( handling );
+#else
+	/*
+	 * A negative height makes the DIB top-down, matching the framebuffer.
+	 * Only the dirty rows are described, so the source origin is always
+	 * the first of them.
+	 */
+	const RezPixel *origin = fb->pixels + dirty->top * fb->stride + dirty->left;
+
+	if( vPD->destDC == nil ) return;
+	vPD->destBitmapInfo.bmiHeader.biWidth = fb->stride;
+	vPD->destBitmapInfo.bmiHeader.biHeight = -height;
+	SetDIBitsToDevice( vPD->destDC, vPD->destRect.left + dirty->left, vPD->destRect.top + dirty->top, width, height,
+					   dirty->left, 0, 0, height, origin - dirty->left, &vPD->destBitmapInfo, DIB_RGB_COLORS );
 #endif
 }
 
+/*
+ * Start the thread that finds the vibrators and drives them.  It opens
+ * them in its own time and keeps looking for them while there are none,
+ * so iTunes does not wait on USB to start us, and a unit plugged in
+ * later is picked up.  Whether it has one is read on every render.  It
+ * is given the calibrations iTunes kept for us, if there are any, so a
+ * vibrator swept before is not swept again.
+ */
 static void SetupDevice( VisualPluginData *vPD )
 {
-	if(trancevibe_open(&(vPD->tv), 0) < 0) return;
-	vPD->hasVibe = true;	
+	UInt32 size = 0;
+
+	if( PlayerGetPluginNamedData( vPD->appCookie, vPD->appProc, ( ConstStringPtr ) CALIBRATIONNAME, &vPD->calibrations,
+								  sizeof( vPD->calibrations ), &size ) != noErr || size != sizeof( vPD->calibrations ) )
+		RezCalibrationStoreReset( &vPD->calibrations );
+	vPD->hot->hasActuator = RezActuatorStart( vPD->actuator, vPD->hot->latency, &vPD->calibrations );
+	if( vPD->hot->hasActuator ) RezActuatorPark( vPD->actuator, true );
 }
 
 /*
- * Set the speeds of the vibrators.
+ * Hand the calibrations to iTunes to keep once the actuator has made a
+ * new one, or once CleanupDevice has collected one on the way out.  This
+ * is on the host's thread, as every call into iTunes is.  Idles may come
+ * on more than one thread at once, so the copy, the flag and the save
+ * all happen under saveLock, and the store never changes while it is
+ * being saved.
  */
-static void SetSpeed( VisualPluginData *vPD )
+static void SaveCalibration( VisualPluginData *vPD )
+{
+	RezMutexLock( &vPD->saveLock );
+	if( vPD->hot->hasActuator && RezActuatorCalibration( vPD->actuator, &vPD->calibrations ) ) vPD->unsaved = true;
+	if( vPD->unsaved )
+	{
+		vPD->unsaved = false;
+		PlayerSetPluginNamedData( vPD->appCookie, vPD->appProc, ( ConstStringPtr ) CALIBRATIONNAME, &vPD->calibrations, sizeof( vPD->calibrations ) );
+	}
+	RezMutexUnlock( &vPD->saveLock );
+}
+
+/*
+ * Go to rest when playback stops or the window goes, and come back when
+ * both are there again.  At rest the motor is stopped for certain, the
+ * display shows it stopped and then settles, the actuator is parked and
+ * the owner sleeps until the host says something, so nothing of ours
+ * runs at all.  The detector keeps its history for coming back to.
+ */
+static void SetActive( VisualPluginData *vPD, Boolean active )
+{
+	vPD->hot->active = active;
+	if( active )
+	{
+		vPD->hot->resuming = true;
+		RezGovernorRestart( &vPD->hot->governor );
+		RezAtomicStore( &vPD->drawUS, 0 );
+		if( vPD->hot->hasActuator ) RezActuatorPark( vPD->actuator, false );
+		RezAtomicStore( &vPD->resting, 0 );
+		return;
+	}
+
+	RezAtomicStore( &vPD->resting, 1 );
+	RezEnvelopeStrike( &vPD->hot->envelope, RezEnvelopeTick( RezTimeNow() ), 0 );
+	if( vPD->hot->hasActuator ) RezActuatorPark( vPD->actuator, true );
+	vPD->hot->motorSpeed = 0;
+	PublishState( vPD );
+}
+
+/*
+ * Start the vibrators' envelope off towards peak, or stop them with 0.
+ * The actuator thread plays its envelope out to the device; our copy of
+ * it, given the same strikes, says what the motor is doing for the
+ * display.
+ */
+static void Strike( VisualPluginData *vPD, UInt8 peak )
 {		
-	if( vPD->hasVibe == false || vPD->tv == nil) return;
-	trancevibe_set_speed(vPD->tv, vPD->motorSpeed, 10);
+	REZ_PROBE( actuate )
+
+	REZ_PROBE_START( actuate );
+	RezEnvelopeStrike( &vPD->hot->envelope, RezEnvelopeTick( RezTimeNow() ), peak );
+	if( vPD->hot->hasActuator ) RezActuatorStrike( vPD->actuator, peak, &vPD->hot->trace );
+	REZ_PROBE_STOP( actuate, REZ_PROBE_ACTUATE );
 }
 
 /*
- * Clean up all our USB interface handles, etc.
+ * Clean up all our USB interface handles, etc.  A calibration the
+ * actuator finished since the last idle is picked up once it has
+ * stopped, for the host's thread to save once we are gone.
  */
 static void CleanupDevice( VisualPluginData *vPD )
 {
-	if( vPD->hasVibe == false ) return;
-	vPD->motorSpeed = 0;
-	SetSpeed( vPD );
-	trancevibe_close(vPD->tv);
-	vPD->hasVibe = false;
+	if( vPD->hot->hasActuator == false ) return;
+	vPD->hot->motorSpeed = 0;
+	RezActuatorStop( vPD->actuator );
+	RezMutexLock( &vPD->saveLock );
+	if( RezActuatorCalibration( vPD->actuator, &vPD->calibrations ) ) vPD->unsaved = true;
+	RezMutexUnlock( &vPD->saveLock );
+	vPD->hot->hasActuator = false;
+	vPD->hot->hasVibe = false;
 }
 
 /*
@@ -0,0 +1,236 @@
+/*
+ *  rezbench.c
+ *  rezTunes
+ *
+ *  Times the software renderer against the headless blit backend, so
+ *  drawing changes can be measured without iTunes or a window, and takes
+ *  a screenshot of the last frame.  It can also check that screenshot
+ *  against a reference, for testing the renderer on a headless machine.
+ *
+ *  Build from the top of the tree with:
+ *    cc -O2 -Isrc -o rezbench tools/rezbench.c src/rezRender.c
+ *
+ *  Usage: rezbench [ width height [ frames [ screenshot.ppm ] ] ]
+ *         rezbench -c reference.ppm [ -o screenshot.ppm ]
+ *    -c  draw CHECKFRAMES frames at CHECKWIDTH by CHECKHEIGHT and compare
+ *        the last with reference, exiting 1 if any pixel differs
+ *    -o  write what was drawn there too, to look at when the check fails
+ *
+ *  The frames are made up: levels wander, averages trail them and every
+ *  eighth frame a kick fires in the low bands, with the motor jumping and
+ *  decaying by 10 like the plugin.  They come from a generator of our
+ *  own, and every level is a whole number, which the renderer places
+ *  without rounding, so the same frames are drawn the same on any
+ *  machine.  The reference kept in the tree, tools/rezbench.ppm, was
+ *  made with
+ *    rezbench CHECKWIDTH CHECKHEIGHT CHECKFRAMES tools/rezbench.ppm
+ *  and must be made again the same way whenever the drawing is meant to
+ *  change.  A failed check prints how many pixels differ and where the
+ *  first is.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rezRender.h"
+
+/*
+ * CHECKWIDTH, CHECKHEIGHT - Size of the frames -c draws; small, so the
+ *   reference is, but big enough for every part of the layout.
+ * CHECKFRAMES - Frames -c draws, enough for the history strip to wrap.
+ */
+
+#define CHECKWIDTH 320
+#define CHECKHEIGHT 180
+#define CHECKFRAMES 240
+
+static double Now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The next made up frame.  Levels are kept as whole numbers, and only
+ * handed to the renderer as floats.
+ */
+
+static void NextFrame( RezVisualState *state, unsigned long frame, unsigned long *seed, int *energy, int *average )
+{
+	int band;
+
+	state->frame = frame;
+	state->beats = ( frame % 8 == 0 ) ? 0x7 : 0;
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+	{
+		int level;
+
+		*seed = ( *seed * 1103515245 + 12345 ) & 0xffffffffUL;
+		level = energy[ band ] + ( int ) ( ( *seed >> 16 ) % 21 ) - 10;
+		if( state->beats & ( 1u << band ) ) level += 80;
+		energy[ band ] = level < 0 ? 0 : level > 255 ? 255 : level;
+		average[ band ] += ( energy[ band ] - average[ band ] ) / 20;
+		state->energy[ band ] = ( float ) energy[ band ];
+		state->average[ band ] = ( float ) average[ band ];
+		state->threshold[ band ] = ( float ) ( average[ band ] * 9 / 5 );
+	}
+	if( state->beats ) state->motorSpeed = 255;
+	else state->motorSpeed = state->motorSpeed > 10 ? state->motorSpeed - 10 : 0;
+	state->confidence = state->beats ? 1.0f : 0;
+}
+
+/*
+ * Draw a blank first frame, which clears the whole window and is left
+ * out of the timing, then frames made up ones.  Every frame is new, so
+ * every frame is drawn.  Returns how many were, and the seconds taken.
+ */
+
+static int Draw( RezFramebuffer *fb, RezHeadless *headless, int frames, double *elapsed )
+{
+	RezVisualState state;
+	unsigned long seed = 1;
+	int energy[ FREQUENCYBANDS ], average[ FREQUENCYBANDS ];
+	int frame, drawn = 0;
+	double start;
+
+	memset( &state, 0, sizeof( state ) );
+	memset( energy, 0, sizeof( energy ) );
+	memset( average, 0, sizeof( average ) );
+	state.hasVibe = 1;
+	drawn += RezRenderFrame( fb, &state );
+	RezFramebufferPresent( fb, RezHeadlessBlit, headless );
+
+	start = Now();
+	for( frame = 1; frame <= frames; frame++ )
+	{
+		NextFrame( &state, ( unsigned long ) frame, &seed, energy, average );
+		drawn += RezRenderFrame( fb, &state );
+		RezFramebufferPresent( fb, RezHeadlessBlit, headless );
+	}
+	*elapsed = Now() - start;
+	return drawn;
+}
+
+/*
+ * Compare the framebuffer with a binary PPM, as RezFramebufferWritePPM
+ * writes them.  Returns how many pixels differ, or -1 if the reference
+ * cannot be read or is another size.
+ */
+
+static long Compare( const RezFramebuffer *fb, const char *path, int *firstX, int *firstY )
+{
+	FILE *file = fopen( path, "rb" );
+	int width, height, depth, x, y;
+	long differ = 0;
+
+	if( file == NULL ) return -1;
+	if( fscanf( file, "P6 %d %d %d", &width, &height, &depth ) != 3 || depth != 255 || fgetc( file ) == EOF ||
+		width != fb->width || height != fb->height )
+	{
+		fclose( file );
+		return -1;
+	}
+	for( y = 0; y < fb->height; y++ )
+	{
+		const RezPixel *row = fb->pixels + y * fb->stride;
+
+		for( x = 0; x < fb->width; x++ )
+		{
+			unsigned char rgb[ 3 ];
+
+			if( fread( rgb, 1, 3, file ) != 3 )
+			{
+				fclose( file );
+				return -1;
+			}
+			if( rgb[ 0 ] == ( unsigned char ) ( row[ x ] >> 16 ) && rgb[ 1 ] == ( unsigned char ) ( row[ x ] >> 8 ) &&
+				rgb[ 2 ] == ( unsigned char ) row[ x ] )
+				continue;
+			if( differ++ == 0 )
+			{
+				*firstX = x;
+				*firstY = y;
+			}
+		}
+	}
+	fclose( file );
+	return differ;
+}
+
+int main( int argc, char **argv )
+{
+	RezFramebuffer fb;
+	RezHeadless headless = { 0, 0 };
+	int width = 3840, height = 2160, frames = 1000, drawn, option, firstX = 0, firstY = 0;
+	const char *reference = NULL, *screenshot = NULL;
+	double elapsed;
+	long differ;
+
+	while( ( option = getopt( argc, argv, "c:o:" ) ) != -1 )
+	{
+		if( option == 'c' ) reference = optarg;
+		else if( option == 'o' ) screenshot = optarg;
+		else optind = argc + 1;
+	}
+	if( reference != NULL ? optind != argc : ( optind > argc || screenshot != NULL ) )
+	{
+		fprintf( stderr, "usage: rezbench [ width height [ frames [ screenshot.ppm ] ] ]\n"
+						 "       rezbench -c reference.ppm [ -o screenshot.ppm ]\n" );
+		return 1;
+	}
+	if( reference != NULL )
+	{
+		width = CHECKWIDTH;
+		height = CHECKHEIGHT;
+		frames = CHECKFRAMES;
+	}
+	else
+	{
+		if( argc > 2 )
+		{
+			width = atoi( argv[ 1 ] );
+			height = atoi( argv[ 2 ] );
+		}
+		if( argc > 3 ) frames = atoi( argv[ 3 ] );
+		if( argc > 4 ) screenshot = argv[ 4 ];
+	}
+
+	RezFramebufferInit( &fb );
+	if( !RezFramebufferResize( &fb, width, height ) )
+	{
+		fprintf( stderr, "rezbench: cannot allocate %dx%d framebuffer\n", width, height );
+		return 1;
+	}
+	drawn = Draw( &fb, &headless, frames, &elapsed );
+
+	printf( "%dx%d: %d frames, %d drawn, %lu blits, %lu pixels blitted, %.3f ms/frame\n",
+			width, height, frames, drawn, headless.blits, headless.pixels, elapsed * 1000.0 / ( frames > 0 ? frames : 1 ) );
+
+	if( screenshot != NULL && !RezFramebufferWritePPM( &fb, screenshot ) )
+	{
+		fprintf( stderr, "rezbench: cannot write %s\n", screenshot );
+		return 1;
+	}
+	if( reference != NULL )
+	{
+		differ = Compare( &fb, reference, &firstX, &firstY );
+		if( differ < 0 )
+		{
+			fprintf( stderr, "rezbench: cannot read %s as a %dx%d PPM\n", reference, width, height );
+			return 1;
+		}
+		if( differ > 0 )
+		{
+			fprintf( stderr, "rezbench: %ld pixels differ from %s, the first at %d,%d\n", differ, reference, firstX, firstY );
+			return 1;
+		}
+		printf( "matches %s\n", reference );
+	}
+	RezFramebufferRelease( &fb );
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ *  rezflood.c
+ *  rezTunes
+ *
+ *  Floods the beat event sender with frames while its subscriber reads
+ *  nothing, and checks that the sender never waits on it and throws away
+ *  the oldest batches, not the newest.
+ *
+ *  Build from the top of the tree with:
+ *    cc -O2 -Isrc -o rezflood tools/rezflood.c src/rezEvents.c src/rezTime.c
+ *
+ *  Usage: rezflood [ -n frames ]
+ *    -n  frames sent while the subscriber is stalled, default FRAMES
+ *
+ *  The subscriber is this program, bound at REZ_EVENTS_PATH as rezlisten
+ *  would be, so rezlisten must not be running.  Every frame carries a
+ *  beat and a speed.  Once they are all sent the subscriber reads what
+ *  was kept, with the sender catching up in between, and checks that
+ *  the batches came in order, that every batch was either read or
+ *  counted as dropped, and that the last one was read.  One line gives
+ *  the longest and mean time a frame took to send, how many took longer
+ *  than SLOWUS, and how many batches were read and dropped.
+ *
+ *  The exit status is 1 if any check fails or more than SLOWLIMIT of the
+ *  frames took longer than SLOWUS to send.  A sender that waited on the subscriber would
+ *  wait for ever, so the run is killed after TIMEOUTSECONDS.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "rezEvents.h"
+#include "rezTime.h"
+
+/*
+ * FRAMES - Frames sent unless -n says.
+ * SLOWUS - Time in microseconds a frame's send should stay under.  It
+ *   takes a few.
+ * SLOWLIMIT - Fraction of frames that may take longer, held up by the
+ *   scheduler rather than the subscriber.
+ * TIMEOUTSECONDS - Longest the whole run may take.
+ */
+
+#define FRAMES 100000
+#define SLOWUS 1000
+#define SLOWLIMIT 0.001
+#define TIMEOUTSECONDS 60
+
+static RezEvents events;
+
+int main( int argc, char **argv )
+{
+	struct sockaddr_un address;
+	RezEventBatch batch;
+	RezTime start, took, longest = 0, total = 0;
+	unsigned long frames = FRAMES, frame, slow = 0, received = 0;
+	unsigned int expected = 0;
+	int listener, option, failed = 0;
+
+	while( ( option = getopt( argc, argv, "n:" ) ) != -1 )
+	{
+		if( option == 'n' ) frames = strtoul( optarg, NULL, 10 );
+		else optind = argc + 1;
+	}
+	if( optind != argc || frames == 0 )
+	{
+		fprintf( stderr, "usage: rezflood [ -n frames ]\n" );
+		return 1;
+	}
+
+	listener = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	strncpy( address.sun_path, REZ_EVENTS_PATH, sizeof( address.sun_path ) - 1 );
+	unlink( REZ_EVENTS_PATH );
+	if( listener < 0 || bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) < 0 )
+	{
+		perror( "rezflood: " REZ_EVENTS_PATH );
+		return 1;
+	}
+	if( !RezEventsOpen( &events ) )
+	{
+		fprintf( stderr, "rezflood: cannot make the sender's socket\n" );
+		unlink( REZ_EVENTS_PATH );
+		return 1;
+	}
+
+	alarm( TIMEOUTSECONDS );
+	for( frame = 0; frame < frames; frame++ )
+	{
+		start = RezTimeNow();
+		RezEventsBegin( &events, ( unsigned int ) frame, ( unsigned int ) frame * 25 );
+		RezEventsAdd( &events, REZ_EVENT_BEAT, ( int ) ( frame % FREQUENCYBANDS ), 200, 2.0f );
+		RezEventsAdd( &events, REZ_EVENT_SPEED, 0, 200, 0.0f );
+		RezEventsSend( &events );
+		took = RezTimeNow() - start;
+		total += took;
+		if( took > longest ) longest = took;
+		if( took > ( RezTime ) SLOWUS * 1000 ) slow++;
+	}
+
+	/*
+	 * Read everything the socket holds, then let the sender catch up,
+	 * until neither has anything left.
+	 */
+
+	for( ;; )
+	{
+		long length = ( long ) recv( listener, &batch, sizeof( batch ), MSG_DONTWAIT );
+
+		if( length < 0 )
+		{
+			if( errno != EAGAIN && errno != EWOULDBLOCK ) break;
+			if( events.queued == 0 ) break;
+			RezEventsSend( &events );
+			continue;
+		}
+		if( length != ( long ) ( sizeof( RezEventHeader ) + batch.header.count * sizeof( RezEvent ) ) ||
+			batch.header.magic != REZ_EVENTS_MAGIC || batch.header.count != 2 )
+		{
+			fprintf( stderr, "rezflood: malformed batch\n" );
+			failed = 1;
+			continue;
+		}
+		if( received > 0 && batch.header.sequence < expected )
+		{
+			fprintf( stderr, "rezflood: batch %u came after %u\n", batch.header.sequence, expected - 1 );
+			failed = 1;
+		}
+		if( batch.header.stamp != batch.header.sequence )
+		{
+			fprintf( stderr, "rezflood: batch %u has the stamp of frame %u\n", batch.header.sequence, batch.header.stamp );
+			failed = 1;
+		}
+		expected = batch.header.sequence + 1;
+		received++;
+	}
+
+	printf( "%lu frames, longest send %lu us, mean %.2f us, %lu over %d us, %lu read, %u dropped\n", frames,
+		( unsigned long ) ( longest / 1000 ), total / 1000.0 / frames, slow, SLOWUS, received, events.dropped );
+	if( received + events.dropped != frames )
+	{
+		fprintf( stderr, "rezflood: %lu batches neither read nor dropped\n", frames - received - events.dropped );
+		failed = 1;
+	}
+	if( expected != frames )
+	{
+		fprintf( stderr, "rezflood: the last batch read was %u, not %lu\n", expected - 1, frames - 1 );
+		failed = 1;
+	}
+	if( slow > frames * SLOWLIMIT )
+	{
+		fprintf( stderr, "rezflood: too many frames took over %d us to send\n", SLOWUS );
+		failed = 1;
+	}
+
+	RezEventsClose( &events );
+	close( listener );
+	unlink( REZ_EVENTS_PATH );
+	return failed;
+}
@@ -0,0 +1,101 @@
+/*
+ *  rezlisten.c
+ *  rezTunes
+ *
+ *  Subscribes to the plugin's beat and speed events and prints one line
+ *  per event, as an example subscriber and for checking what a lighting
+ *  rig or the like would be sent.
+ *
+ *  Build from the top of the tree with:
+ *    cc -O2 -Isrc -o rezlisten tools/rezlisten.c
+ *
+ *  Usage: rezlisten [ -d delayms ]
+ *    -d  wait this long after each datagram, to play a slow subscriber
+ *
+ *  Each line is the batch sequence number, the frame's renderTimeStampID
+ *  and playback position, then the event: a beat with its band, the speed
+ *  and strength, an onset with the speed and confidence, or a new motor
+ *  speed.  Batches that were dropped on the
+ *  way, whether by the plugin or the socket, are reported as gaps.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "rezEvents.h"
+
+int main( int argc, char **argv )
+{
+	struct sockaddr_un address;
+	RezEventBatch batch;
+	unsigned int expected = 0;
+	int listener, delayMS = 0, started = 0, option;
+
+	while( ( option = getopt( argc, argv, "d:" ) ) != -1 )
+	{
+		if( option == 'd' ) delayMS = atoi( optarg );
+		else
+		{
+			fprintf( stderr, "usage: rezlisten [ -d delayms ]\n" );
+			return 1;
+		}
+	}
+
+	listener = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	memset( &address, 0, sizeof( address ) );
+	address.sun_family = AF_UNIX;
+	strncpy( address.sun_path, REZ_EVENTS_PATH, sizeof( address.sun_path ) - 1 );
+	unlink( REZ_EVENTS_PATH );
+	if( listener < 0 || bind( listener, ( struct sockaddr * ) &address, sizeof( address ) ) < 0 )
+	{
+		perror( "rezlisten: " REZ_EVENTS_PATH );
+		return 1;
+	}
+
+	for( ;; )
+	{
+		long length = ( long ) recv( listener, &batch, sizeof( batch ), 0 );
+		int e;
+
+		if( length < ( long ) sizeof( RezEventHeader ) || batch.header.magic != REZ_EVENTS_MAGIC ||
+			batch.header.version != REZ_EVENTS_VERSION ||
+			length != ( long ) ( sizeof( RezEventHeader ) + batch.header.count * sizeof( RezEvent ) ) )
+			continue;
+
+		if( started && batch.header.sequence != expected )
+			printf( "# gap of %u, %u dropped by sender\n", batch.header.sequence - expected, batch.header.dropped );
+		expected = batch.header.sequence + 1;
+		started = 1;
+
+		for( e = 0; e < batch.header.count; e++ )
+		{
+			const RezEvent *event = &batch.event[ e ];
+
+			printf( "%8u %10u %9.3fs ", batch.header.sequence, batch.header.stamp, batch.header.positionMS / 1000.0 );
+			if( event->type == REZ_EVENT_BEAT )
+				printf( "beat  band %u speed %3u strength %.2f\n", event->band, event->speed, event->strength );
+			else if( event->type == REZ_EVENT_ONSET )
+				printf( "onset speed %3u confidence %.2f\n", event->speed, event->strength );
+			else if( event->type == REZ_EVENT_SPEED )
+				printf( "speed %3u\n", event->speed );
+			else
+				printf( "type %u\n", event->type );
+		}
+		fflush( stdout );
+
+		if( delayMS > 0 )
+		{
+			struct timespec ts;
+
+			ts.tv_sec = delayMS / 1000;
+			ts.tv_nsec = ( long ) ( delayMS % 1000 ) * 1000000;
+			nanosleep( &ts, NULL );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,535 @@
+/*
+ *  rezreplay.c
+ *  rezTunes
+ *
+ *  Plays a spectrum capture into the plugin the way iTunes would, and
+ *  fails if the plugin touches the heap while its window is up.  On the
+ *  Mac the default malloc zone's entry points are swapped for ones that
+ *  count, so what the system libraries allocate for the plugin, drawing
+ *  in CoreGraphics among it, is counted as well; a zone a library makes
+ *  for itself is not watched.  Elsewhere the plugin is built into this
+ *  program and its calls to malloc, calloc, realloc and free come here
+ *  first.  From show window to hide window, any trip to the heap made
+ *  while a message other than init or a window message is being handled
+ *  is counted.  Setting up and tearing down may allocate; the frames in
+ *  between may not.  The one exception is the snapshot the Mac blit has
+ *  CoreGraphics make of the framebuffer every frame, which Quartz will not
+ *  let be kept from one frame to the next; its trips, put down to drawing,
+ *  are printed but do not fail the run.
+ *
+ *  Build on the Mac from the top of the tree with:
+ *    cc -arch i386 -DREZ_INSTRUMENT=1 -Isrc -o rezreplay tools/rezreplay.c src/iTunesAPI.c \
+ *       src/rez[A-Z]*.c -ltrancevibe -framework Carbon -framework CoreFoundation
+ *
+ *  Usage: rezreplay [ -f ] [ -i seconds ] [ -c feltms ] [ -p preferences ] capture.rzc
+ *    -f  send frames as fast as the plugin takes them, rather than at
+ *        the capture's own rate
+ *    -i  how long to stay paused at the end, default IDLESECONDS
+ *    -c  choose Options once the track starts and again this long after,
+ *        as someone calibrating the vibrator by hand would
+ *    -p  a file to keep the plugin's named preferences in from one run
+ *        to the next, as iTunes would; without it they last one run
+ *
+ *  The capture format is described in rezscan.c.  Along the way the
+ *  track is paused and resumed, seeked and changed, and the window asked
+ *  to redraw, so every kind of message is sent at least once.  One line
+ *  is printed for each kind of message that touched the heap, with how
+ *  many times, and the exit status is 1 if any but drawing did.  With REZ_FAKE_DEVICE
+ *  set no vibrator is needed.
+ *
+ *  At the end the track is paused with the window still up, idle messages
+ *  going on as iTunes sends them, and the processor time the process used
+ *  meanwhile is printed, with how many times a thread went to sleep other
+ *  than this one between idles.  A plugin at rest should use next to none.
+ *
+ *  How long the init message took is printed too.  Finding and opening
+ *  the vibrator is left to the actuator thread, so this should not grow
+ *  with the time the device takes to open: REZ_FAKE_DEVICE set to
+ *  "0,0,2000" gives a fake that takes two seconds.
+ *
+ *  Named preferences are kept for one name at a time, which is all the
+ *  plugin uses.  How many times the plugin saved them is printed; with
+ *  REZ_FAKE_DEVICE naming a stall speed, the first run sweeps the fake
+ *  and saves its calibration, and a run after that with the same -p file
+ *  should save nothing.  With -c the first Options starts the vibrator
+ *  running up and the second says it was felt, so a calibration is saved
+ *  every run, stall speed or not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "iTunesVisualAPI.h"
+#include "rezAtomic.h"
+#include "rezDetector.h"
+#include "rezInstrument.h"
+#include "rezMap.h"
+#include "rezThread.h"
+#include "rezTime.h"
+
+#if !REZ_INSTRUMENT
+#error "rezreplay needs REZ_INSTRUMENT defined to 1 to know which message is being handled"
+#endif
+
+/*
+ * WIDTH, HEIGHT - Size of the window drawn into.
+ * SETTLEMS - How long the owner thread is given to apply the last
+ *   messages before counting stops, and to come to rest before idling is
+ *   measured.
+ * IDLESECONDS - How long idling is measured for unless -i says.
+ * IDLEMS - Time between idle messages while paused, as iTunes sends them.
+ * NAMEDBYTES - Most bytes of named preferences kept.
+ */
+
+#define WIDTH 640
+#define HEIGHT 480
+#define SETTLEMS 500
+#define IDLESECONDS 2
+#define IDLEMS 16
+#define NAMEDBYTES 4096
+
+#define CAPTUREMAGIC 0x31435a52		/* 'RZC1' read little endian */
+
+extern OSStatus iTunesPluginMainMachO( OSType message, PluginMessageInfo *messageInfo, void *refCon );
+
+static VisualPluginProcPtr handler;
+static void *refCon;
+static RezAtomic counting;
+static RezAtomic touched[ REZ_PROBES ];
+static unsigned char namedName[ 256 ];
+static unsigned char namedData[ NAMEDBYTES ];
+static UInt32 namedSize;
+static int namedSaves;
+
+/*
+ * Called on every trip to the heap, from any thread, so it must not
+ * allocate itself.  Worker threads handle no messages and are not
+ * counted; what they do is out of the host's way.
+ */
+
+static void Touched( void )
+{
+	int probe;
+
+	if( !RezAtomicLoad( &counting ) ) return;
+	probe = RezInstrumentHandling();
+	if( probe == REZ_PROBE_NONE || probe == REZ_PROBE_WINDOW || probe == REZ_PROBE_INIT ) return;
+	RezAtomicAdd( &touched[ probe ], 1 );
+}
+
+/*
+ * On the Mac, malloc and everything built on it, in this program or in
+ * the system's libraries, goes to the default zone, so its entry points
+ * are swapped for these, which pass on to a copy of the originals.  The
+ * zone may be kept read only, and is left writable once changed.
+ * Elsewhere the plugin's own calls are caught by replacing malloc and
+ * the rest outright, passing on to glibc's own entry points.
+ */
+
+#if defined( __APPLE__ )
+#include <AvailabilityMacros.h>
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+
+static malloc_zone_t realZone;
+
+static void *ZoneMalloc( malloc_zone_t *zone, size_t size )
+{
+	Touched();
+	return realZone.malloc( zone, size );
+}
+
+static void *ZoneCalloc( malloc_zone_t *zone, size_t count, size_t size )
+{
+	Touched();
+	return realZone.calloc( zone, count, size );
+}
+
+static void *ZoneValloc( malloc_zone_t *zone, size_t size )
+{
+	Touched();
+	return realZone.valloc( zone, size );
+}
+
+static void *ZoneRealloc( malloc_zone_t *zone, void *pointer, size_t size )
+{
+	Touched();
+	return realZone.realloc( zone, pointer, size );
+}
+
+static void ZoneFree( malloc_zone_t *zone, void *pointer )
+{
+	if( pointer != NULL ) Touched();
+	realZone.free( zone, pointer );
+}
+
+#if defined( MAC_OS_X_VERSION_10_6 )
+static void *ZoneMemalign( malloc_zone_t *zone, size_t alignment, size_t size )
+{
+	Touched();
+	return realZone.memalign( zone, alignment, size );
+}
+
+static void ZoneFreeDefiniteSize( malloc_zone_t *zone, void *pointer, size_t size )
+{
+	Touched();
+	realZone.free_definite_size( zone, pointer, size );
+}
+#endif
+
+static int WatchHeap( void )
+{
+	malloc_zone_t *zone = malloc_default_zone();
+	vm_address_t page = ( vm_address_t ) zone & ~( vm_address_t ) ( vm_page_size - 1 );
+
+	if( vm_protect( mach_task_self(), page, ( vm_address_t ) ( zone + 1 ) - page, 0, VM_PROT_READ | VM_PROT_WRITE ) != KERN_SUCCESS )
+		return 0;
+	realZone = *zone;
+	zone->malloc = ZoneMalloc;
+	zone->calloc = ZoneCalloc;
+	zone->valloc = ZoneValloc;
+	zone->realloc = ZoneRealloc;
+	zone->free = ZoneFree;
+#if defined( MAC_OS_X_VERSION_10_6 )
+	if( zone->version >= 5 && zone->memalign != NULL ) zone->memalign = ZoneMemalign;
+	if( zone->version >= 6 && zone->free_definite_size != NULL ) zone->free_definite_size = ZoneFreeDefiniteSize;
+#endif
+	return 1;
+}
+#else
+extern void *__libc_malloc( size_t size );
+extern void *__libc_calloc( size_t count, size_t size );
+extern void *__libc_realloc( void *pointer, size_t size );
+extern void __libc_free( void *pointer );
+
+void *malloc( size_t size )
+{
+	Touched();
+	return __libc_malloc( size );
+}
+
+void *calloc( size_t count, size_t size )
+{
+	Touched();
+	return __libc_calloc( count, size );
+}
+
+void *realloc( void *pointer, size_t size )
+{
+	Touched();
+	return __libc_realloc( pointer, size );
+}
+
+void free( void *pointer )
+{
+	if( pointer == NULL ) return;
+	Touched();
+	__libc_free( pointer );
+}
+
+static int WatchHeap( void )
+{
+	return 1;
+}
+#endif
+
+/*
+ * The host's side of the plugin's calls.  Named preferences are called
+ * for on message threads, so they are kept in memory here and only read
+ * and written to disk before and after the run.
+ */
+
+static OSStatus AppProc( void *appCookie, OSType message, PlayerMessageInfo *messageInfo )
+{
+	( void ) appCookie;
+	switch( message )
+	{
+		case kPlayerRegisterVisualPluginMessage:
+			handler = messageInfo->u.registerVisualPluginMessage.handler;
+			return noErr;
+
+		case kPlayerSetPluginNamedDataMessage:
+		{
+			PlayerSetPluginNamedDataMessage *set = &messageInfo->u.setPluginNamedDataMessage;
+
+			if( set->dataSize > NAMEDBYTES ) return paramErr;
+			memcpy( namedName, set->dataName, set->dataName[ 0 ] + 1 );
+			memcpy( namedData, set->dataPtr, set->dataSize );
+			namedSize = set->dataSize;
+			namedSaves++;
+			return noErr;
+		}
+
+		case kPlayerGetPluginNamedDataMessage:
+		{
+			PlayerGetPluginNamedDataMessage *get = &messageInfo->u.getPluginNamedDataMessage;
+
+			if( namedSize == 0 || memcmp( namedName, get->dataName, get->dataName[ 0 ] + 1 ) != 0 ) return paramErr;
+			get->dataSize = namedSize < get->dataBufferSize ? namedSize : get->dataBufferSize;
+			memcpy( get->dataPtr, namedData, get->dataSize );
+			return noErr;
+		}
+	}
+	return unimpErr;
+}
+
+/*
+ * A preferences file is the name as a Pascal string, then the data.
+ */
+
+static void LoadNamed( const char *path )
+{
+	FILE *file = fopen( path, "rb" );
+
+	if( file == NULL ) return;
+	if( fread( namedName, 1, 1, file ) == 1 && fread( namedName + 1, 1, namedName[ 0 ], file ) == namedName[ 0 ] )
+		namedSize = ( UInt32 ) fread( namedData, 1, NAMEDBYTES, file );
+	fclose( file );
+}
+
+static void SaveNamed( const char *path )
+{
+	FILE *file;
+
+	if( namedSize == 0 || ( file = fopen( path, "wb" ) ) == NULL ) return;
+	fwrite( namedName, 1, namedName[ 0 ] + 1, file );
+	fwrite( namedData, 1, namedSize, file );
+	fclose( file );
+}
+
+static void Send( OSType message, VisualPluginMessageInfo *info )
+{
+	handler( message, info, refCon );
+}
+
+static void SendTrack( OSType message, ITTrackInfo *track, UniChar name, UInt32 lengthMS )
+{
+	VisualPluginMessageInfo info;
+
+	memset( track, 0, sizeof( ITTrackInfo ) );
+	track->validFields = kITTINameFieldMask | kITTITotalTimeFieldMask;
+	track->name[ 0 ] = 1;
+	track->name[ 1 ] = name;
+	track->totalTimeInMS = lengthMS;
+	memset( &info, 0, sizeof( info ) );
+	if( message == kVisualPluginPlayMessage )
+	{
+		info.u.playMessage.trackInfoUnicode = track;
+		info.u.playMessage.volume = 100;
+	}
+	else
+		info.u.changeTrackMessage.trackInfoUnicode = track;
+	Send( message, &info );
+}
+
+static unsigned long ReadLE32( const unsigned char *p )
+{
+	return p[ 0 ] | ( p[ 1 ] << 8 ) | ( p[ 2 ] << 16 ) | ( ( unsigned long ) p[ 3 ] << 24 );
+}
+
+static double UsedMS( const struct rusage *usage )
+{
+	return usage->ru_utime.tv_sec * 1000.0 + usage->ru_utime.tv_usec / 1000.0 + usage->ru_stime.tv_sec * 1000.0 + usage->ru_stime.tv_usec / 1000.0;
+}
+
+/*
+ * Pause with the window up and send idles for seconds, then say what the
+ * process used.  Each of our own sleeps is one of the voluntary switches,
+ * so they are taken off.
+ */
+
+static void MeasureIdle( int seconds )
+{
+	VisualPluginMessageInfo info;
+	struct rusage before, after;
+	long idles, sleeps;
+
+	memset( &info, 0, sizeof( info ) );
+	Send( kVisualPluginPauseMessage, &info );
+	RezThreadSleep( SETTLEMS );
+
+	getrusage( RUSAGE_SELF, &before );
+	for( idles = 0; idles < ( long ) seconds * 1000 / IDLEMS; idles++ )
+	{
+		Send( kVisualPluginIdleMessage, &info );
+		RezThreadSleep( IDLEMS );
+	}
+	getrusage( RUSAGE_SELF, &after );
+
+	sleeps = after.ru_nvcsw - before.ru_nvcsw - idles;
+	printf( "# idle: %.1f ms of processor, %ld other sleeps in %d s\n", UsedMS( &after ) - UsedMS( &before ), sleeps < 0 ? 0 : sleeps, seconds );
+	Send( kVisualPluginUnpauseMessage, &info );
+}
+
+int main( int argc, char **argv )
+{
+	PluginMessageInfo pluginInfo;
+	VisualPluginMessageInfo info;
+	RenderVisualData render;
+	ITTrackInfo track;
+	RezMapping mapping;
+	const unsigned char *p;
+	unsigned long frameMS, channels, frames, frame, rowBytes, total = 0;
+	RezTime start, initTime, feltAt = 0;
+	int flatOut = 0, idleSeconds = IDLESECONDS, feltMS = 0, option, probe;
+	const char *namedPath = NULL;
+	Rect bounds = { 0, 0, HEIGHT, WIDTH };
+	GWorldPtr world;
+
+	while( ( option = getopt( argc, argv, "c:fi:p:" ) ) != -1 )
+	{
+		if( option == 'c' ) feltMS = atoi( optarg );
+		else if( option == 'f' ) flatOut = 1;
+		else if( option == 'i' ) idleSeconds = atoi( optarg );
+		else if( option == 'p' ) namedPath = optarg;
+		else optind = argc;
+	}
+	if( optind != argc - 1 )
+	{
+		fprintf( stderr, "usage: rezreplay [ -f ] [ -i seconds ] [ -c feltms ] [ -p preferences ] capture.rzc\n" );
+		return 2;
+	}
+	if( !WatchHeap() )
+	{
+		fprintf( stderr, "rezreplay: cannot watch the heap\n" );
+		return 2;
+	}
+	if( !RezMapFile( &mapping, argv[ optind ], 0, 0 ) )
+	{
+		fprintf( stderr, "rezreplay: cannot read %s\n", argv[ optind ] );
+		return 2;
+	}
+	p = ( const unsigned char * ) mapping.base;
+	frameMS = mapping.size >= 16 ? ReadLE32( p + 4 ) : 0;
+	channels = mapping.size >= 16 ? ReadLE32( p + 8 ) : 0;
+	if( mapping.size < 16 || ReadLE32( p ) != CAPTUREMAGIC || frameMS == 0 || ( channels != 1 && channels != 2 ) )
+	{
+		fprintf( stderr, "rezreplay: %s is not a spectrum capture\n", argv[ optind ] );
+		return 2;
+	}
+	rowBytes = channels * REZ_SPECTRUM_ENTRIES;
+	frames = ReadLE32( p + 12 );
+	if( frames > ( mapping.size - 16 ) / rowBytes ) frames = ( mapping.size - 16 ) / rowBytes;
+
+	if( namedPath != NULL ) LoadNamed( namedPath );
+	memset( &pluginInfo, 0, sizeof( pluginInfo ) );
+	pluginInfo.u.initMessage.appProc = AppProc;
+	iTunesPluginMainMachO( kPluginInitMessage, &pluginInfo, NULL );
+	if( handler == NULL )
+	{
+		fprintf( stderr, "rezreplay: the plugin did not register\n" );
+		return 2;
+	}
+	memset( &info, 0, sizeof( info ) );
+	info.u.initMessage.appProc = AppProc;
+	start = RezTimeNow();
+	Send( kVisualPluginInitMessage, &info );
+	initTime = RezTimeNow() - start;
+	refCon = info.u.initMessage.refCon;
+	if( refCon == NULL )
+	{
+		fprintf( stderr, "rezreplay: the plugin would not start\n" );
+		return 2;
+	}
+
+	if( NewGWorld( &world, 32, &bounds, NULL, NULL, 0 ) != noErr )
+	{
+		fprintf( stderr, "rezreplay: no offscreen port to draw in\n" );
+		return 2;
+	}
+	memset( &info, 0, sizeof( info ) );
+	info.u.showWindowMessage.port = ( CGrafPtr ) world;
+	info.u.showWindowMessage.drawRect = bounds;
+	Send( kVisualPluginShowWindowMessage, &info );
+	RezAtomicStore( &counting, 1 );
+	SendTrack( kVisualPluginPlayMessage, &track, 'A', ( UInt32 ) ( frames * frameMS ) );
+	if( feltMS > 0 )
+	{
+		memset( &info, 0, sizeof( info ) );
+		Send( kVisualPluginConfigureMessage, &info );
+		feltAt = RezTimeNow() + REZ_MS( feltMS );
+	}
+
+	memset( &render, 0, sizeof( render ) );
+	render.numSpectrumChannels = ( UInt8 ) channels;
+	start = RezTimeNow();
+	for( frame = 0; frame < frames; frame++ )
+	{
+		const unsigned char *row = p + 16 + frame * rowBytes;
+
+		if( frame == frames / 4 )
+		{
+			memset( &info, 0, sizeof( info ) );
+			Send( kVisualPluginPauseMessage, &info );
+			Send( kVisualPluginUnpauseMessage, &info );
+		}
+		else if( frame == frames / 2 )
+		{
+			memset( &info, 0, sizeof( info ) );
+			info.u.setPositionMessage.positionTimeInMS = ( UInt32 ) ( frame * frameMS );
+			Send( kVisualPluginSetPositionMessage, &info );
+		}
+		else if( frame == frames * 3 / 4 )
+			SendTrack( kVisualPluginChangeTrackMessage, &track, 'B', ( UInt32 ) ( frames * frameMS ) );
+
+		memcpy( render.spectrumData[ 0 ], row, REZ_SPECTRUM_ENTRIES );
+		memcpy( render.spectrumData[ 1 ], channels > 1 ? row + REZ_SPECTRUM_ENTRIES : row, REZ_SPECTRUM_ENTRIES );
+		memset( &info, 0, sizeof( info ) );
+		info.u.renderMessage.renderData = &render;
+		info.u.renderMessage.timeStampID = ( UInt32 ) frame;
+		info.u.renderMessage.currentPositionInMS = ( UInt32 ) ( frame * frameMS );
+		Send( kVisualPluginRenderMessage, &info );
+
+		memset( &info, 0, sizeof( info ) );
+		Send( kVisualPluginIdleMessage, &info );
+		if( frame % 100 == 0 ) Send( kVisualPluginUpdateMessage, &info );
+		if( feltAt != 0 && RezTimeNow() >= feltAt )
+		{
+			Send( kVisualPluginConfigureMessage, &info );
+			feltAt = 0;
+		}
+
+		if( !flatOut )
+		{
+			RezTime due = start + REZ_MS( ( frame + 1 ) * frameMS ), now = RezTimeNow();
+
+			if( due > now ) RezThreadSleep( ( int ) ( ( due - now ) / REZ_MS( 1 ) ) );
+		}
+	}
+	if( feltAt != 0 )
+	{
+		RezTime now = RezTimeNow();
+
+		if( feltAt > now ) RezThreadSleep( ( int ) ( ( feltAt - now ) / REZ_MS( 1 ) ) );
+		memset( &info, 0, sizeof( info ) );
+		Send( kVisualPluginConfigureMessage, &info );
+	}
+	if( idleSeconds > 0 ) MeasureIdle( idleSeconds );
+
+	memset( &info, 0, sizeof( info ) );
+	Send( kVisualPluginStopMessage, &info );
+	Send( kVisualPluginHideWindowMessage, &info );
+	RezThreadSleep( SETTLEMS );
+	RezAtomicStore( &counting, 0 );
+
+	memset( &info, 0, sizeof( info ) );
+	Send( kVisualPluginCleanupMessage, &info );
+	DisposeGWorld( world );
+	RezUnmap( &mapping );
+	if( namedPath != NULL ) SaveNamed( namedPath );
+
+	for( probe = 0; probe < REZ_PROBES; probe++ )
+	{
+		unsigned long count = ( unsigned long ) RezAtomicLoad( &touched[ probe ] );
+
+		if( count == 0 ) continue;
+		printf( "%s\t%lu\n", RezInstrumentName( probe ), count );
+		if( probe != REZ_PROBE_DRAW ) total += count;
+	}
+	printf( "# init took %.2f ms\n", initTime / 1e6 );
+	printf( "# %d saves of named preferences\n", namedSaves );
+	printf( "# %lu frames, %lu trips to the heap between show and hide\n", frames, total );
+	return total == 0 ? 0 : 1;
+}
@@ -0,0 +1,718 @@
+/*
+ *  rezscan.c
+ *  rezTunes
+ *
+ *  Runs the beat detector over whole directory trees of audio files and
+ *  spectrum captures, on every core, to pre-compute beat maps and to find
+ *  the tracks where detection falls over.  Each file is memory mapped and
+ *  analysed with the same code the plugin runs live.
+ *
+ *  Build from the top of the tree with:
+ *    cc -O2 -Isrc -o rezscan tools/rezscan.c src/rezAnalyze.c src/rezAudio.c \
+ *       src/rezDetector.c src/rezEnvelope.c src/rezMap.c src/rezMotor.c src/rezThread.c \
+ *       -lm -lpthread
+ *
+ *  Usage: rezscan [ -j threads ] [ -m mapdir ] [ -s motor ] [ -t tracedir ] path ...
+ *
+ *  Paths may be files or directories, which are walked for .wav, .aif,
+ *  .aiff, .aifc and .rzc files.  With -m, each file's beat map is written
+ *  to mapdir in the beat cache's track file format, named after its path
+ *  with every '/' turned into '_' and .rzb on the end.
+ *
+ *  A spectrum capture (.rzc) is a header of four little endian 32 bit
+ *  words: 'RZC1', the frame interval in milliseconds, the number of
+ *  channels (1 or 2) and the number of frames.  The frames follow, each
+ *  one row of 512 bytes per channel, exactly as iTunes delivered them.
+ *
+ *  One line is printed per file, tab separated:
+ *    path, seconds, frames, beats, onsets, BPM, retrigger, offgrid, gap, verdict
+ *  where beats in neighbouring frames count as one onset, retrigger is
+ *  the fraction of beats that were not new onsets, offgrid the fraction
+ *  of onsets that fall off the estimated beat grid and gap the longest
+ *  stretch in seconds without one.  The verdict names whichever of these
+ *  looks wrong, or is "ok".  Totals and throughput follow on lines
+ *  starting with '#'.
+ *
+ *  With -s, the speeds the plugin would send, shaped by the envelope of
+ *  rezEnvelope.h, are also played into the model motor of rezMotor.h, in
+ *  simulated time, and three more columns
+ *  score how the rotor follows the beats:
+ *    lag, hits, swing
+ *  where hits is the fraction of onsets followed by a rotor peak within
+ *  ALIGNMS, lag the mean milliseconds from onset to that peak and swing
+ *  the mean rise into those peaks as a fraction of full speed.  Fewer
+ *  hits than HITLIMIT is reported as "sluggish".  motor is
+ *  "latency,jitter,spinup,spindown" in milliseconds, any of them left off
+ *  or empty taking the defaults, so "-s ," simulates the default motor.
+ *  With -t as well, each file's simulation is written to tracedir, named
+ *  like the maps but ending .trace: a line for every command sent,
+ *    command, time, speed, time it landed, rotor speed when sent
+ *  and one for every rotor peak,
+ *    peak, time, rotor speed
+ *  with times in milliseconds.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "rezAnalyze.h"
+#include "rezEnvelope.h"
+#include "rezMotor.h"
+#include "rezThread.h"
+
+#define MAXTHREADS 256
+#define MAXBEATS 65536
+
+#define CAPTUREMAGIC 0x31435a52		/* 'RZC1' read little endian */
+
+/*
+ * Heuristics.
+ *   ONSETMS - Beats closer together than this are one onset.
+ *   MINBPM, MAXBPM - Tempo estimates are folded into this range.
+ *   GRIDSLACK - How far, as a fraction of half a beat, an onset may be
+ *     from the grid and still be on it.
+ *   Anything past RETRIGGERLIMIT, OFFGRIDLIMIT or GAPLIMIT seconds is
+ *   reported as detection falling over.
+ */
+
+#define ONSETMS 100
+#define MINBPM 60
+#define MAXBPM 200
+#define GRIDSLACK 0.2
+#define RETRIGGERLIMIT 0.5
+#define OFFGRIDLIMIT 0.5
+#define GAPLIMIT 15.0
+
+/*
+ * Motor simulation.
+ *   STEPMS - The rotor is looked at this often for peaks.
+ *   ALIGNMS - A peak this long after an onset still belongs to it.
+ *   HITLIMIT - Fewer onsets than this followed by a peak is too few.
+ */
+
+#define STEPMS 1
+#define ALIGNMS 250
+#define HITLIMIT 0.5
+
+struct ScanFile {
+	char				*path;
+	unsigned long		size;
+	int					analysed;
+	double				seconds;
+	unsigned long		frames;
+	unsigned long		beats;
+	unsigned long		onsets;
+	double				bpm;
+	double				retrigger;
+	double				offGrid;
+	double				gap;
+	unsigned long		frameMS;
+	double				lag;
+	double				hits;
+	double				swing;
+};
+typedef struct ScanFile ScanFile;
+
+/*
+ * Each worker owns a range of the file order, which it works through
+ * from the front.  A worker that runs dry steals the back half of
+ * someone else's range.  Ranges only ever shrink, so once a sweep over
+ * every other worker finds nothing there is nothing left anywhere.
+ */
+
+struct Worker {
+	RezThread			thread;
+	RezMutex			lock;
+	unsigned long		next;
+	unsigned long		end;
+	int					id;
+	unsigned long		steals;
+	unsigned long		frames;
+	RezAnalyzer			analyzer;
+	RezBeat				beats[ MAXBEATS ];
+	unsigned long		onset[ MAXBEATS ];
+	RezMotor			motor;
+	RezEnvelope			envelope;
+	unsigned long		peak[ MAXBEATS ];
+	float				rise[ MAXBEATS ];
+};
+typedef struct Worker Worker;
+
+static ScanFile *files;
+static unsigned long fileCount, fileCapacity;
+static unsigned long *order;
+static Worker *workers;
+static int workerCount;
+static const char *mapDirectory;
+static const char *traceDirectory;
+static int simulate;
+static double motorSetting[ 4 ] = { REZ_MOTOR_LATENCYMS, REZ_MOTOR_JITTERMS, REZ_MOTOR_SPINUPMS, REZ_MOTOR_SPINDOWNMS };
+
+static double Now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int HasExtension( const char *name, const char *extension )
+{
+	const char *dot = strrchr( name, '.' );
+
+	if( dot == NULL ) return 0;
+	while( *dot && tolower( ( unsigned char ) *dot ) == *extension ) dot++, extension++;
+	return *dot == 0 && *extension == 0;
+}
+
+static int Wanted( const char *name )
+{
+	static const char *extensions[] = { ".wav", ".wave", ".aif", ".aiff", ".aifc", ".rzc" };
+	unsigned int i;
+
+	for( i = 0; i < sizeof( extensions ) / sizeof( extensions[ 0 ] ); i++ )
+		if( HasExtension( name, extensions[ i ] ) ) return 1;
+	return 0;
+}
+
+static void AddFile( const char *path, unsigned long size )
+{
+	if( fileCount == fileCapacity )
+	{
+		fileCapacity = fileCapacity ? fileCapacity * 2 : 1024;
+		files = ( ScanFile * ) realloc( files, fileCapacity * sizeof( ScanFile ) );
+		if( files == NULL )
+		{
+			fprintf( stderr, "rezscan: out of memory\n" );
+			exit( 1 );
+		}
+	}
+	memset( &files[ fileCount ], 0, sizeof( ScanFile ) );
+	files[ fileCount ].path = strdup( path );
+	if( files[ fileCount ].path == NULL )
+	{
+		fprintf( stderr, "rezscan: out of memory\n" );
+		exit( 1 );
+	}
+	files[ fileCount ].size = size;
+	fileCount++;
+}
+
+/*
+ * Symbolic links to directories are not followed, so a tree with a loop
+ * in it is still only walked once.
+ */
+
+static void Walk( const char *path, int top )
+{
+	struct stat info;
+	DIR *directory;
+	struct dirent *entry;
+
+	if( ( top ? stat( path, &info ) : lstat( path, &info ) ) < 0 )
+	{
+		if( top ) fprintf( stderr, "rezscan: cannot find %s\n", path );
+		return;
+	}
+	if( S_ISREG( info.st_mode ) )
+	{
+		if( top || Wanted( path ) ) AddFile( path, ( unsigned long ) info.st_size );
+		return;
+	}
+	if( !S_ISDIR( info.st_mode ) || ( directory = opendir( path ) ) == NULL ) return;
+
+	while( ( entry = readdir( directory ) ) != NULL )
+	{
+		size_t length = strlen( path ) + strlen( entry->d_name ) + 2;
+		char *child;
+
+		if( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 ) continue;
+		child = ( char * ) malloc( length );
+		if( child == NULL ) continue;
+		snprintf( child, length, "%s/%s", path, entry->d_name );
+		Walk( child, 0 );
+		free( child );
+	}
+	closedir( directory );
+}
+
+static unsigned long ReadLE32( const unsigned char *p )
+{
+	return p[ 0 ] | ( p[ 1 ] << 8 ) | ( p[ 2 ] << 16 ) | ( ( unsigned long ) p[ 3 ] << 24 );
+}
+
+/*
+ * Captures skip the transform and feed their rows to the detector as
+ * they are.  Both kinds of file return the number of beats, or -1 if the
+ * file cannot be read or its beats do not fit.
+ */
+
+static long AnalyseCapture( Worker *worker, const char *path, ScanFile *file )
+{
+	RezMapping mapping;
+	const unsigned char *p;
+	unsigned long frameMS, channels, frames, frame, rowBytes;
+	long count = 0;
+
+	if( !RezMapFile( &mapping, path, 0, 0 ) ) return -1;
+	p = ( const unsigned char * ) mapping.base;
+	if( mapping.size < 16 || ReadLE32( p ) != CAPTUREMAGIC ) goto fail;
+	frameMS = ReadLE32( p + 4 );
+	channels = ReadLE32( p + 8 );
+	frames = ReadLE32( p + 12 );
+	rowBytes = channels * REZ_SPECTRUM_ENTRIES;
+	if( frameMS == 0 || ( channels != 1 && channels != 2 ) ) goto fail;
+	if( frames > ( mapping.size - 16 ) / rowBytes ) frames = ( mapping.size - 16 ) / rowBytes;
+
+	RezDetectorInit( &worker->analyzer.detector );
+	for( frame = 0; frame < frames; frame++ )
+	{
+		const unsigned char *left = p + 16 + frame * rowBytes;
+		const unsigned char *right = channels > 1 ? left + REZ_SPECTRUM_ENTRIES : left;
+
+		if( RezDetectorProcess( &worker->analyzer.detector, left, right ) )
+		{
+			if( count >= MAXBEATS || frame * frameMS > REZ_BEAT_MAX_POSITION ) goto fail;
+			worker->beats[ count++ ] = REZ_BEAT( frame * frameMS, worker->analyzer.detector.motorSpeed );
+		}
+	}
+	file->frames = frames;
+	file->frameMS = frameMS;
+	file->seconds = frames * frameMS / 1000.0;
+	RezUnmap( &mapping );
+	return count;
+
+fail:
+	RezUnmap( &mapping );
+	return -1;
+}
+
+static long AnalyseAudio( Worker *worker, const char *path, ScanFile *file )
+{
+	RezAudio audio;
+	unsigned long count;
+	int complete;
+
+	if( !RezAudioOpen( &audio, path ) ) return -1;
+	complete = RezAnalyzeAudio( &worker->analyzer, &audio, worker->beats, MAXBEATS, &count, NULL );
+	file->seconds = ( double ) audio.frames / audio.rate;
+	file->frameMS = RETAINMS / RETAINSAMPLES;
+	file->frames = ( unsigned long ) ( file->seconds * 1000 / file->frameMS ) + 1;
+	RezAudioClose( &audio );
+	return complete ? ( long ) count : -1;
+}
+
+/*
+ * Tempo is the most common spacing between an onset and the next few,
+ * folded into MINBPM to MAXBPM and smoothed over neighbouring BPMs.
+ * Onsets are then checked against a grid of half beats.
+ */
+
+static void Summarise( Worker *worker, ScanFile *file, unsigned long count )
+{
+	static const int reach = 4;
+	const RezBeat *beats = worker->beats;
+	unsigned long *onset = worker->onset;
+	double votes[ MAXBPM + 2 ], best = 0, previous;
+	unsigned long onsets = 0, i, j, offGrid = 0;
+	int bpm;
+
+	for( i = 0; i < count; i++ )
+	{
+		unsigned long position = REZ_BEAT_POSITION( beats[ i ] );
+
+		if( i == 0 || position - REZ_BEAT_POSITION( beats[ i - 1 ] ) > ONSETMS ) onset[ onsets++ ] = position;
+	}
+	file->beats = count;
+	file->onsets = onsets;
+	file->retrigger = count ? ( double ) ( count - onsets ) / count : 0;
+
+	memset( votes, 0, sizeof( votes ) );
+	for( i = 0; i < onsets; i++ )
+	{
+		for( j = i + 1; j < onsets && j <= i + reach; j++ )
+		{
+			double tempo = 60000.0 / ( onset[ j ] - onset[ i ] );
+
+			while( tempo < MINBPM ) tempo *= 2;
+			while( tempo > MAXBPM ) tempo /= 2;
+			votes[ ( int ) ( tempo + 0.5 ) ] += 1.0 / ( j - i );
+		}
+	}
+	file->bpm = 0;
+	for( bpm = MINBPM; bpm <= MAXBPM; bpm++ )
+	{
+		double score = votes[ bpm ] + 0.5 * ( votes[ bpm - 1 ] + votes[ bpm + 1 ] );
+
+		if( score > best )
+		{
+			best = score;
+			file->bpm = bpm;
+		}
+	}
+
+	file->gap = 0;
+	previous = 0;
+	for( i = 0; i < onsets; i++ )
+	{
+		double seconds = onset[ i ] / 1000.0;
+
+		if( seconds - previous > file->gap ) file->gap = seconds - previous;
+		if( i > 0 && file->bpm > 0 )
+		{
+			double halves = ( onset[ i ] - onset[ i - 1 ] ) / ( 30000.0 / file->bpm );
+
+			if( halves < 0.5 || fabs( halves - floor( halves + 0.5 ) ) > GRIDSLACK ) offGrid++;
+		}
+		previous = seconds;
+	}
+	if( file->seconds - previous > file->gap ) file->gap = file->seconds - previous;
+	file->offGrid = onsets > 1 ? ( double ) offGrid / ( onsets - 1 ) : 0;
+}
+
+/*
+ * The name a file's output goes by in directory: its path with every '/'
+ * turned into '_', and extension on the end.  The caller frees it.
+ */
+
+static char *OutputPath( const char *directory, const ScanFile *file, const char *extension )
+{
+	const char *name = file->path;
+	size_t length, i;
+	char *path;
+
+	while( *name == '/' ) name++;
+	length = strlen( directory ) + strlen( name ) + strlen( extension ) + 2;
+	path = ( char * ) malloc( length );
+	if( path == NULL ) return NULL;
+	snprintf( path, length, "%s/%s%s", directory, name, extension );
+	for( i = strlen( directory ) + 1; path[ i ]; i++ )
+		if( path[ i ] == '/' ) path[ i ] = '_';
+	return path;
+}
+
+static void WriteMap( const ScanFile *file, const RezBeat *beats, unsigned long count )
+{
+	char *path = OutputPath( mapDirectory, file, ".rzb" );
+	FILE *out;
+
+	if( path == NULL ) return;
+	out = fopen( path, "wb" );
+	if( out == NULL || fwrite( beats, sizeof( RezBeat ), count, out ) != count )
+		fprintf( stderr, "rezscan: cannot write %s\n", path );
+	if( out != NULL ) fclose( out );
+	free( path );
+}
+
+/*
+ * Play the file's beats into the model motor the way the plugin would:
+ * each frame's beat strikes the envelope, which is asked for a speed to
+ * send every tick.  The rotor is followed in STEPMS steps of simulated
+ * time, and every local maximum is a peak.  Then each onset is matched
+ * to the first peak after it.
+ */
+
+static void Simulate( Worker *worker, ScanFile *file, unsigned long count )
+{
+	RezMotor *motor = &worker->motor;
+	RezEnvelope *envelope = &worker->envelope;
+	unsigned long t, end = file->frames * file->frameMS, beat = 0, peaks = 0, hits = 0, i, p = 0;
+	double rotor = 0, previous = 0, trough = 0, lag = 0, swing = 0;
+	int speed, rising = 0;
+	FILE *trace = NULL;
+
+	RezMotorInit( motor, motorSetting[ 0 ], motorSetting[ 1 ], motorSetting[ 2 ], motorSetting[ 3 ] );
+	RezEnvelopeDefaults( envelope );
+	if( traceDirectory != NULL )
+	{
+		char *path = OutputPath( traceDirectory, file, ".trace" );
+
+		if( path != NULL && ( trace = fopen( path, "w" ) ) == NULL ) fprintf( stderr, "rezscan: cannot write %s\n", path );
+		free( path );
+	}
+
+	for( t = 0; t < end; t += STEPMS )
+	{
+		if( t % file->frameMS == 0 && beat < count && REZ_BEAT_POSITION( worker->beats[ beat ] ) < t + file->frameMS )
+		{
+			RezEnvelopeStrike( envelope, t / ENVELOPETICKMS, REZ_BEAT_SPEED( worker->beats[ beat ] ) );
+			while( beat < count && REZ_BEAT_POSITION( worker->beats[ beat ] ) < t + file->frameMS ) beat++;
+		}
+		if( t % ENVELOPETICKMS == 0 && RezEnvelopeNext( envelope, t / ENVELOPETICKMS, &speed ) )
+		{
+			double landMS = RezMotorCommand( motor, t, speed );
+
+			if( trace != NULL ) fprintf( trace, "command\t%lu\t%d\t%.1f\t%.1f\n", t, speed, landMS, rotor );
+		}
+
+		rotor = RezMotorAdvance( motor, t + STEPMS );
+		if( rotor > previous ) rising = 1;
+		else if( rotor < previous && rising )
+		{
+			if( peaks < MAXBEATS )
+			{
+				worker->peak[ peaks ] = t;
+				worker->rise[ peaks ] = ( float ) ( ( previous - trough ) / 255 );
+				peaks++;
+			}
+			if( trace != NULL ) fprintf( trace, "peak\t%lu\t%.1f\n", t, previous );
+			rising = 0;
+			trough = previous;
+		}
+		if( !rising && rotor < trough ) trough = rotor;
+		previous = rotor;
+	}
+	if( trace != NULL ) fclose( trace );
+
+	for( i = 0; i < file->onsets; i++ )
+	{
+		unsigned long onset = worker->onset[ i ];
+
+		while( p < peaks && worker->peak[ p ] < onset ) p++;
+		if( p < peaks && worker->peak[ p ] - onset <= ALIGNMS )
+		{
+			hits++;
+			lag += worker->peak[ p ] - onset;
+			swing += worker->rise[ p ];
+		}
+	}
+	file->hits = file->onsets ? ( double ) hits / file->onsets : 0;
+	file->lag = hits ? lag / hits : 0;
+	file->swing = hits ? swing / hits : 0;
+}
+
+static int TakeOwn( Worker *worker, unsigned long *index )
+{
+	int taken = 0;
+
+	RezMutexLock( &worker->lock );
+	if( worker->next < worker->end )
+	{
+		*index = worker->next++;
+		taken = 1;
+	}
+	RezMutexUnlock( &worker->lock );
+	return taken;
+}
+
+static int Steal( Worker *worker, unsigned long *index )
+{
+	int i;
+
+	for( i = 1; i < workerCount; i++ )
+	{
+		Worker *victim = &workers[ ( worker->id + i ) % workerCount ];
+		unsigned long start = 0, end = 0;
+
+		RezMutexLock( &victim->lock );
+		if( victim->next < victim->end )
+		{
+			end = victim->end;
+			start = end - ( end - victim->next + 1 ) / 2;
+			victim->end = start;
+		}
+		RezMutexUnlock( &victim->lock );
+
+		if( start < end )
+		{
+			RezMutexLock( &worker->lock );
+			worker->next = start + 1;
+			worker->end = end;
+			RezMutexUnlock( &worker->lock );
+			worker->steals++;
+			*index = start;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void WorkerMain( void *argument )
+{
+	Worker *worker = ( Worker * ) argument;
+	unsigned long index;
+
+	while( TakeOwn( worker, &index ) || Steal( worker, &index ) )
+	{
+		ScanFile *file = &files[ order[ index ] ];
+		long count;
+
+		if( HasExtension( file->path, ".rzc" ) ) count = AnalyseCapture( worker, file->path, file );
+		else count = AnalyseAudio( worker, file->path, file );
+		if( count < 0 ) continue;
+
+		file->analysed = 1;
+		worker->frames += file->frames;
+		Summarise( worker, file, ( unsigned long ) count );
+		if( simulate ) Simulate( worker, file, ( unsigned long ) count );
+		if( mapDirectory != NULL ) WriteMap( file, worker->beats, ( unsigned long ) count );
+	}
+}
+
+static int LargestFirst( const void *a, const void *b )
+{
+	unsigned long sa = files[ *( const unsigned long * ) a ].size, sb = files[ *( const unsigned long * ) b ].size;
+
+	return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+static const char *Verdict( const ScanFile *file )
+{
+	if( !file->analysed ) return "unreadable";
+	if( file->onsets == 0 ) return "nobeats";
+	if( file->retrigger > RETRIGGERLIMIT ) return "retrigger";
+	if( file->offGrid > OFFGRIDLIMIT ) return "offgrid";
+	if( file->gap > GAPLIMIT ) return "gap";
+	if( simulate && file->hits < HITLIMIT ) return "sluggish";
+	return "ok";
+}
+
+/*
+ * Read "latency,jitter,spinup,spindown", keeping the default for any
+ * left empty.  Returns 0 for anything else: a field that is not a number,
+ * a negative one or more than four.
+ */
+
+static int ParseMotor( const char *setting )
+{
+	int i;
+
+	for( i = 0; i < 4; i++ )
+	{
+		char *next;
+		double value = strtod( setting, &next );
+
+		if( next != setting )
+		{
+			if( value < 0 ) return 0;
+			motorSetting[ i ] = value;
+		}
+		if( *next == '\0' ) return 1;
+		if( *next != ',' ) return 0;
+		setting = next + 1;
+	}
+	return 0;
+}
+
+int main( int argc, char **argv )
+{
+	unsigned long i, analysed = 0, flagged = 0, frames = 0, steals = 0;
+	double start, elapsed, seconds = 0, bytes = 0;
+	int threads = ( int ) sysconf( _SC_NPROCESSORS_ONLN ), option, w;
+
+	while( ( option = getopt( argc, argv, "j:m:s:t:" ) ) != -1 )
+	{
+		if( option == 'j' ) threads = atoi( optarg );
+		else if( option == 'm' ) mapDirectory = optarg;
+		else if( option == 's' )
+		{
+			if( !ParseMotor( optarg ) )
+			{
+				fprintf( stderr, "rezscan: bad motor setting %s\n", optarg );
+				return 1;
+			}
+			simulate = 1;
+		}
+		else if( option == 't' ) traceDirectory = optarg;
+		else optind = argc;
+	}
+	if( optind >= argc || ( traceDirectory != NULL && !simulate ) )
+	{
+		fprintf( stderr, "usage: rezscan [ -j threads ] [ -m mapdir ] [ -s motor ] [ -t tracedir ] path ...\n" );
+		return 1;
+	}
+	for( ; optind < argc; optind++ ) Walk( argv[ optind ], 1 );
+	if( fileCount == 0 ) return 0;
+
+	if( threads < 1 ) threads = 1;
+	if( threads > MAXTHREADS ) threads = MAXTHREADS;
+	if( ( unsigned long ) threads > fileCount ) threads = ( int ) fileCount;
+
+	/*
+	 * Biggest files first, dealt round the workers in turn, so the long
+	 * ones start early and the short ones fill in the gaps at the end.
+	 * Each worker's share is then one contiguous range of the order.
+	 */
+	order = ( unsigned long * ) malloc( fileCount * sizeof( unsigned long ) );
+	workers = ( Worker * ) calloc( threads, sizeof( Worker ) );
+	if( order == NULL || workers == NULL )
+	{
+		fprintf( stderr, "rezscan: out of memory\n" );
+		return 1;
+	}
+	{
+		unsigned long *sorted = ( unsigned long * ) malloc( fileCount * sizeof( unsigned long ) );
+		unsigned long slot = 0;
+
+		if( sorted == NULL )
+		{
+			fprintf( stderr, "rezscan: out of memory\n" );
+			return 1;
+		}
+		for( i = 0; i < fileCount; i++ ) sorted[ i ] = i;
+		qsort( sorted, fileCount, sizeof( unsigned long ), LargestFirst );
+		for( w = 0; w < threads; w++ )
+		{
+			workers[ w ].next = slot;
+			for( i = w; i < fileCount; i += threads ) order[ slot++ ] = sorted[ i ];
+			workers[ w ].end = slot;
+		}
+		free( sorted );
+	}
+
+	workerCount = threads;
+	for( w = 0; w < threads; w++ )
+	{
+		workers[ w ].id = w;
+		RezMutexInit( &workers[ w ].lock );
+		RezAnalyzerInit( &workers[ w ].analyzer );
+	}
+	start = Now();
+	for( w = 0; w < threads; w++ )
+	{
+		if( !RezThreadStart( &workers[ w ].thread, WorkerMain, &workers[ w ], 0 ) )
+		{
+			fprintf( stderr, "rezscan: cannot start thread %d\n", w );
+			return 1;
+		}
+	}
+	for( w = 0; w < threads; w++ )
+	{
+		RezThreadJoin( &workers[ w ].thread );
+		frames += workers[ w ].frames;
+		steals += workers[ w ].steals;
+	}
+	elapsed = Now() - start;
+
+	printf( "path\tseconds\tframes\tbeats\tonsets\tbpm\tretrigger\toffgrid\tgap\t%sverdict\n",
+			simulate ? "lag\thits\tswing\t" : "" );
+	for( i = 0; i < fileCount; i++ )
+	{
+		const ScanFile *file = &files[ i ];
+		const char *verdict = Verdict( file );
+
+		printf( "%s\t%.1f\t%lu\t%lu\t%lu\t%.0f\t%.2f\t%.2f\t%.1f\t", file->path, file->seconds, file->frames,
+				file->beats, file->onsets, file->bpm, file->retrigger, file->offGrid, file->gap );
+		if( simulate ) printf( "%.0f\t%.2f\t%.2f\t", file->lag, file->hits, file->swing );
+		printf( "%s\n", verdict );
+		if( file->analysed )
+		{
+			analysed++;
+			seconds += file->seconds;
+			bytes += file->size;
+		}
+		if( strcmp( verdict, "ok" ) != 0 ) flagged++;
+	}
+
+	printf( "# %lu files, %lu analysed, %lu flagged\n", fileCount, analysed, flagged );
+	printf( "# %d threads, %lu steals, %.3f s\n", threads, steals, elapsed );
+	printf( "# %.0f frames/s, %.1f MB/s, %.0fx real time\n", frames / elapsed, bytes / elapsed / 1048576, seconds / elapsed );
+	return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ *  rezseek.c
+ *  rezTunes
+ *
+ *  Replays seek-heavy sessions over spectrum captures and checks that the
+ *  detector, warmed up after each jump the way the plugin does it, makes
+ *  the beats it would have made had the track been played straight
+ *  through.
+ *
+ *  Build from the top of the tree with:
+ *    cc -O2 -Isrc -o rezseek tools/rezseek.c src/rezDetector.c src/rezMap.c -lm
+ *
+ *  Usage: rezseek [ -n seeks ] [ -w windowms ] [ -r seed ] capture.rzc ...
+ *    -n  jumps per session, default SEEKS
+ *    -w  how long is played, and judged, after each jump, default WINDOWMS
+ *    -r  seed for where the jumps go, so a session can be run again
+ *
+ *  The capture format is described in rezscan.c.  Each capture is first
+ *  played straight through, which gives the beats to judge by and, as an
+ *  earlier play would, the track's mean band energies.  Then one session
+ *  of jumps to random places is played once for each way of treating the
+ *  history after a jump:
+ *    stale - left as it was, describing music no longer playing
+ *    cold - forgotten, as for a new track with nothing known about it
+ *    mean - filled with its own long average, as the plugin does for a
+ *      seek in a track it has no profile for
+ *    profile - filled with the track's mean band energies, as the plugin
+ *      does for a track it has a profile for
+ *  A beat within a frame either side of one of the straight play's beats
+ *  agrees with it.  One line is printed per capture, tab separated:
+ *    path, seeks, beats, then false and missed for each way in turn
+ *  where beats is how many the straight play made inside the judged
+ *  windows, false how many the session made that it did not and missed
+ *  how many it made that the session did not.  Totals follow on a line
+ *  starting with '#'.
+ *
+ *  The exit status is 1 if, over all the captures, either warm start
+ *  makes more mistakes than leaving the history stale, or the profile
+ *  warm start misses more than MISSLIMIT of the beats.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rezDetector.h"
+#include "rezMap.h"
+
+/*
+ * SEEKS - Jumps in a session unless -n says.
+ * WINDOWMS - Time played after each jump unless -w says.
+ * MISSLIMIT - Most of the straight play's beats the profile warm start
+ *   may miss.
+ */
+
+#define SEEKS 50
+#define WINDOWMS 2000
+#define MISSLIMIT 0.2
+
+#define CAPTUREMAGIC 0x31435a52		/* 'RZC1' read little endian */
+
+enum {
+	WARM_STALE = 0,
+	WARM_COLD,
+	WARM_MEAN,
+	WARM_PROFILE,
+	WARMS
+};
+
+static const char *warmNames[ WARMS ] = { "stale", "cold", "mean", "profile" };
+
+struct Capture {
+	RezMapping			mapping;
+	const unsigned char	*rows;
+	unsigned long		frameMS;
+	unsigned long		channels;
+	unsigned long		frames;
+	unsigned char		*straight;
+	unsigned char		*session;
+	float				profile[ FREQUENCYBANDS ];
+};
+typedef struct Capture Capture;
+
+struct Score {
+	unsigned long		beats;
+	unsigned long		wrong[ WARMS ];
+	unsigned long		missed[ WARMS ];
+};
+typedef struct Score Score;
+
+static RezDetector detector;
+static unsigned long seeks = SEEKS, windowMS = WINDOWMS, seed = 1;
+
+static unsigned long ReadLE32( const unsigned char *p )
+{
+	return p[ 0 ] | ( p[ 1 ] << 8 ) | ( p[ 2 ] << 16 ) | ( ( unsigned long ) p[ 3 ] << 24 );
+}
+
+static int OpenCapture( Capture *capture, const char *path )
+{
+	const unsigned char *p;
+	unsigned long rowBytes;
+
+	memset( capture, 0, sizeof( Capture ) );
+	if( !RezMapFile( &capture->mapping, path, 0, 0 ) ) return 0;
+	p = ( const unsigned char * ) capture->mapping.base;
+	if( capture->mapping.size < 16 || ReadLE32( p ) != CAPTUREMAGIC ) goto fail;
+	capture->frameMS = ReadLE32( p + 4 );
+	capture->channels = ReadLE32( p + 8 );
+	capture->frames = ReadLE32( p + 12 );
+	if( capture->frameMS == 0 || ( capture->channels != 1 && capture->channels != 2 ) ) goto fail;
+	rowBytes = capture->channels * REZ_SPECTRUM_ENTRIES;
+	if( capture->frames > ( capture->mapping.size - 16 ) / rowBytes ) capture->frames = ( capture->mapping.size - 16 ) / rowBytes;
+	capture->rows = p + 16;
+	capture->straight = ( unsigned char * ) calloc( capture->frames + 1, 1 );
+	capture->session = ( unsigned char * ) calloc( capture->frames + 1, 1 );
+	if( capture->straight == NULL || capture->session == NULL ) goto fail;
+	return 1;
+
+fail:
+	free( capture->straight );
+	free( capture->session );
+	RezUnmap( &capture->mapping );
+	return 0;
+}
+
+static void CloseCapture( Capture *capture )
+{
+	free( capture->straight );
+	free( capture->session );
+	RezUnmap( &capture->mapping );
+}
+
+static int Play( const Capture *capture, unsigned long frame )
+{
+	const unsigned char *left = capture->rows + frame * capture->channels * REZ_SPECTRUM_ENTRIES;
+	const unsigned char *right = capture->channels > 1 ? left + REZ_SPECTRUM_ENTRIES : left;
+
+	return RezDetectorProcess( &detector, left, right );
+}
+
+/*
+ * The straight play, and the profile an earlier play would have saved:
+ * the mean of every frame's band energies, as the plugin keeps it.
+ */
+
+static void PlayStraight( Capture *capture )
+{
+	double sum[ FREQUENCYBANDS ];
+	unsigned long frame;
+	int band;
+
+	memset( sum, 0, sizeof( sum ) );
+	RezDetectorInit( &detector );
+	for( frame = 0; frame < capture->frames; frame++ )
+	{
+		capture->straight[ frame ] = ( unsigned char ) ( Play( capture, frame ) != 0 );
+		for( band = 0; band < FREQUENCYBANDS; band++ ) sum[ band ] += detector.energy[ band ];
+	}
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+		capture->profile[ band ] = ( float ) ( capture->frames ? sum[ band ] / capture->frames : 0 );
+}
+
+/*
+ * What the plugin's WarmStart does after a seek, for each way.
+ */
+
+static void WarmStart( const Capture *capture, int warm )
+{
+	RezHistory *history = &detector.history;
+	float mean[ FREQUENCYBANDS ];
+	int band;
+
+	switch( warm )
+	{
+		case WARM_COLD:
+			RezHistoryReset( history );
+			break;
+
+		case WARM_MEAN:
+			if( history->written == 0 ) break;
+			for( band = 0; band < FREQUENCYBANDS; band++ )
+				mean[ band ] = RezHistoryAverage( history, history->horizons - 1, band );
+			RezHistoryFill( history, mean );
+			break;
+
+		case WARM_PROFILE:
+			RezHistoryFill( history, capture->profile );
+			break;
+	}
+}
+
+/*
+ * A beat at frame agrees with one in beats within a frame either side.
+ */
+
+static int Near( const Capture *capture, const unsigned char *beats, unsigned long frame )
+{
+	return beats[ frame ] || ( frame > 0 && beats[ frame - 1 ] ) || ( frame + 1 < capture->frames && beats[ frame + 1 ] );
+}
+
+/*
+ * One session: play a window from the start, then jump, warm up and play
+ * a window after each jump, judging only what follows a jump.  The jumps
+ * go to the same places for every way.
+ */
+
+static void PlaySession( Capture *capture, int warm, Score *score )
+{
+	unsigned long window = windowMS / capture->frameMS, state = seed, position = 0, frame, end, jump;
+
+	RezDetectorInit( &detector );
+	for( jump = 0; jump <= seeks; jump++ )
+	{
+		end = position + window < capture->frames ? position + window : capture->frames;
+		for( frame = position; frame < end; frame++ ) capture->session[ frame ] = ( unsigned char ) ( Play( capture, frame ) != 0 );
+		if( jump > 0 )
+		{
+			for( frame = position; frame < end; frame++ )
+			{
+				if( capture->session[ frame ] && !Near( capture, capture->straight, frame ) ) score->wrong[ warm ]++;
+				if( capture->straight[ frame ] )
+				{
+					if( warm == 0 ) score->beats++;
+					if( !Near( capture, capture->session, frame ) ) score->missed[ warm ]++;
+				}
+			}
+		}
+		state = state * 1103515245 + 12345;
+		position = ( state >> 8 ) % ( capture->frames > window ? capture->frames - window : 1 );
+		WarmStart( capture, warm );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	Score total;
+	int option, warm, failed;
+
+	while( ( option = getopt( argc, argv, "n:r:w:" ) ) != -1 )
+	{
+		if( option == 'n' ) seeks = strtoul( optarg, NULL, 10 );
+		else if( option == 'r' ) seed = strtoul( optarg, NULL, 10 );
+		else if( option == 'w' ) windowMS = strtoul( optarg, NULL, 10 );
+		else optind = argc;
+	}
+	if( optind >= argc || seeks == 0 || windowMS == 0 )
+	{
+		fprintf( stderr, "usage: rezseek [ -n seeks ] [ -w windowms ] [ -r seed ] capture.rzc ...\n" );
+		return 1;
+	}
+
+	memset( &total, 0, sizeof( total ) );
+	printf( "path\tseeks\tbeats" );
+	for( warm = 0; warm < WARMS; warm++ ) printf( "\t%s false\t%s missed", warmNames[ warm ], warmNames[ warm ] );
+	printf( "\n" );
+	for( ; optind < argc; optind++ )
+	{
+		Capture capture;
+		Score score;
+
+		if( !OpenCapture( &capture, argv[ optind ] ) )
+		{
+			fprintf( stderr, "rezseek: cannot read %s\n", argv[ optind ] );
+			continue;
+		}
+		memset( &score, 0, sizeof( score ) );
+		PlayStraight( &capture );
+		for( warm = 0; warm < WARMS; warm++ ) PlaySession( &capture, warm, &score );
+		CloseCapture( &capture );
+
+		printf( "%s\t%lu\t%lu", argv[ optind ], seeks, score.beats );
+		total.beats += score.beats;
+		for( warm = 0; warm < WARMS; warm++ )
+		{
+			printf( "\t%lu\t%lu", score.wrong[ warm ], score.missed[ warm ] );
+			total.wrong[ warm ] += score.wrong[ warm ];
+			total.missed[ warm ] += score.missed[ warm ];
+		}
+		printf( "\n" );
+	}
+
+	failed = total.missed[ WARM_PROFILE ] > total.beats * MISSLIMIT;
+	printf( "# %lu beats", total.beats );
+	for( warm = 0; warm < WARMS; warm++ )
+	{
+		printf( ", %s %lu false %lu missed", warmNames[ warm ], total.wrong[ warm ], total.missed[ warm ] );
+		if( ( warm == WARM_MEAN || warm == WARM_PROFILE ) &&
+			total.wrong[ warm ] + total.missed[ warm ] > total.wrong[ WARM_STALE ] + total.missed[ WARM_STALE ] )
+			failed = 1;
+	}
+	printf( "\n" );
+	return failed;
+}
@@ -0,0 +1,375 @@
+/*
+ *  rezstress.c
+ *  rezTunes
+ *
+ *  Sends the plugin messages from several threads at once, as iTunes on
+ *  Windows may, and checks that none of them keeps the host waiting.
+ *  Several instances run side by side, with frames, track and playback
+ *  changes, and windows coming and going, all at the same time.  Along
+ *  the way messages are sent before init and after cleanup, and one
+ *  instance is cleaned up while the other threads are still sending it
+ *  messages.
+ *
+ *  Build on the Mac from the top of the tree with:
+ *    cc -arch i386 -Isrc -o rezstress tools/rezstress.c src/iTunesAPI.c \
+ *       src/rez[A-Z]*.c -ltrancevibe -framework Carbon -framework CoreFoundation
+ *  adding -fsanitize=address or -fsanitize=thread where the compiler has
+ *  them, to have memory errors and races caught as well.
+ *
+ *  Usage: rezstress [ -n frames ] [ -t threads ] [ -i instances ]
+ *    -n  frames each thread sends each instance, default FRAMES
+ *    -t  host threads, default THREADS
+ *    -i  instances, default INSTANCES
+ *
+ *  Every thread sends each instance a frame and an idle, a millisecond
+ *  apart.  The first also plays, pauses, resumes, seeks, changes the
+ *  track and chooses Options every so often, and the second hides and shows the window and
+ *  asks for it to be redrawn.  Each call is timed.  One line is printed
+ *  for each kind of message, tab separated:
+ *    kind, calls, longest in milliseconds, calls over SLOWMS
+ *  followed by how long init and cleanup took on lines starting with '#'.
+ *  Init and cleanup may wait on threads; nothing else may.
+ *
+ *  The exit status is 1 if an instance would not start, or more than
+ *  SLOWLIMIT of the frame or playback messages took longer than SLOWMS.
+ *  With REZ_FAKE_DEVICE set no vibrator is needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "iTunesVisualAPI.h"
+#include "rezDetector.h"
+#include "rezThread.h"
+#include "rezTime.h"
+
+/*
+ * FRAMES - Frames each thread sends each instance unless -n says.
+ * THREADS - Host threads unless -t says.  At least two, so that one
+ *   changes playback and another the window.
+ * INSTANCES - Instances unless -i says.
+ * MOST - Most threads or instances.
+ * WIDTH, HEIGHT - Size of each window.
+ * CONTROLEVERY - Frames between playback changes.
+ * WINDOWEVERY - Frames between window changes.
+ * SLOWMS - A frame or playback message that takes longer than this has
+ *   kept the host waiting.
+ * SLOWLIMIT - Fraction of them that may, held up by the scheduler rather
+ *   than the plugin.
+ */
+
+#define FRAMES 2000
+#define THREADS 3
+#define INSTANCES 2
+#define MOST 16
+#define WIDTH 320
+#define HEIGHT 240
+#define CONTROLEVERY 25
+#define WINDOWEVERY 40
+#define SLOWMS 5
+#define SLOWLIMIT 0.001
+
+enum {
+	KIND_FRAME = 0,
+	KIND_CONTROL,
+	KIND_WINDOW,
+	KINDS
+};
+
+static const char *kindNames[ KINDS ] = { "frame", "control", "window" };
+
+struct Kind {
+	unsigned long		calls;
+	unsigned long		slow;
+	RezTime				longest;
+};
+typedef struct Kind Kind;
+
+struct Host {
+	RezThread			thread;
+	int					index;
+	unsigned int		seed;
+	Kind				kind[ KINDS ];
+};
+typedef struct Host Host;
+
+extern OSStatus iTunesPluginMainMachO( OSType message, PluginMessageInfo *messageInfo, void *refCon );
+
+static VisualPluginProcPtr handler;
+static void *refCons[ MOST ];
+static GWorldPtr worlds[ MOST ];
+static Host hosts[ MOST ];
+static int frames = FRAMES, threads = THREADS, instances = INSTANCES;
+static Rect bounds = { 0, 0, HEIGHT, WIDTH };
+
+static OSStatus AppProc( void *appCookie, OSType message, PlayerMessageInfo *messageInfo )
+{
+	( void ) appCookie;
+	if( message != kPlayerRegisterVisualPluginMessage ) return unimpErr;
+	handler = messageInfo->u.registerVisualPluginMessage.handler;
+	return noErr;
+}
+
+/*
+ * Send a message and count how long it took under kind.
+ */
+
+static void Send( Host *host, int kind, OSType message, VisualPluginMessageInfo *info, void *refCon )
+{
+	RezTime start = RezTimeNow(), took;
+
+	handler( message, info, refCon );
+	took = RezTimeNow() - start;
+	host->kind[ kind ].calls++;
+	if( took > host->kind[ kind ].longest ) host->kind[ kind ].longest = took;
+	if( took > REZ_MS( SLOWMS ) ) host->kind[ kind ].slow++;
+}
+
+static void SendTrack( Host *host, OSType message, void *refCon, UniChar name )
+{
+	VisualPluginMessageInfo info;
+	ITTrackInfo track;
+
+	memset( &track, 0, sizeof( track ) );
+	track.validFields = kITTINameFieldMask | kITTITotalTimeFieldMask;
+	track.name[ 0 ] = 1;
+	track.name[ 1 ] = name;
+	track.totalTimeInMS = ( UInt32 ) frames * 10;
+	memset( &info, 0, sizeof( info ) );
+	if( message == kVisualPluginPlayMessage )
+	{
+		info.u.playMessage.trackInfoUnicode = &track;
+		info.u.playMessage.volume = 100;
+	}
+	else
+		info.u.changeTrackMessage.trackInfoUnicode = &track;
+	Send( host, KIND_CONTROL, message, &info, refCon );
+}
+
+static void ShowWindow( Host *host, int instance )
+{
+	VisualPluginMessageInfo info;
+
+	memset( &info, 0, sizeof( info ) );
+	info.u.showWindowMessage.port = ( CGrafPtr ) worlds[ instance ];
+	info.u.showWindowMessage.drawRect = bounds;
+	Send( host, KIND_WINDOW, kVisualPluginShowWindowMessage, &info, refCons[ instance ] );
+}
+
+/*
+ * The first thread changes playback, the second the window, of every
+ * instance in turn.
+ */
+
+static void Change( Host *host, int frame, int instance )
+{
+	VisualPluginMessageInfo info;
+	void *refCon = refCons[ instance ];
+	int step;
+
+	memset( &info, 0, sizeof( info ) );
+	if( host->index == 0 && frame % CONTROLEVERY == 0 )
+	{
+		step = frame / CONTROLEVERY;
+		switch( step % 6 )
+		{
+			case 0:
+				Send( host, KIND_CONTROL, kVisualPluginPauseMessage, &info, refCon );
+				break;
+			case 1:
+				Send( host, KIND_CONTROL, kVisualPluginUnpauseMessage, &info, refCon );
+				break;
+			case 2:
+				info.u.setPositionMessage.positionTimeInMS = ( UInt32 ) ( frames - frame ) * 10;
+				Send( host, KIND_CONTROL, kVisualPluginSetPositionMessage, &info, refCon );
+				break;
+			case 3:
+				SendTrack( host, kVisualPluginChangeTrackMessage, refCon, ( UniChar ) ( 'A' + step % 26 ) );
+				break;
+			case 4:
+				SendTrack( host, kVisualPluginPlayMessage, refCon, ( UniChar ) ( 'A' + step % 26 ) );
+				break;
+			case 5:
+				Send( host, KIND_CONTROL, kVisualPluginConfigureMessage, &info, refCon );
+				break;
+		}
+	}
+	else if( host->index == 1 && frame % WINDOWEVERY == 0 )
+	{
+		step = frame / WINDOWEVERY;
+		if( step % 3 == 0 ) Send( host, KIND_WINDOW, kVisualPluginHideWindowMessage, &info, refCon );
+		else if( step % 3 == 1 ) ShowWindow( host, instance );
+		else Send( host, KIND_WINDOW, kVisualPluginUpdateMessage, &info, refCon );
+	}
+}
+
+/*
+ * A spectrum with a burst in the low bands every twentieth frame, so the
+ * detector has beats to find, and noise the rest of the time.
+ */
+
+static void HostMain( void *argument )
+{
+	Host *host = ( Host * ) argument;
+	VisualPluginMessageInfo info;
+	RenderVisualData render;
+	int frame, instance, bin;
+
+	memset( &render, 0, sizeof( render ) );
+	render.numSpectrumChannels = 2;
+	for( frame = 0; frame < frames; frame++ )
+	{
+		for( bin = 0; bin < REZ_SPECTRUM_ENTRIES; bin++ )
+		{
+			host->seed = host->seed * 1103515245 + 12345;
+			render.spectrumData[ 0 ][ bin ] = ( UInt8 ) ( frame % 20 < 2 && bin < 20 ? 250 : ( host->seed >> 16 ) % 40 );
+			render.spectrumData[ 1 ][ bin ] = render.spectrumData[ 0 ][ bin ];
+		}
+		for( instance = 0; instance < instances; instance++ )
+		{
+			memset( &info, 0, sizeof( info ) );
+			info.u.renderMessage.renderData = &render;
+			info.u.renderMessage.timeStampID = ( UInt32 ) ( frame * threads + host->index );
+			info.u.renderMessage.currentPositionInMS = ( UInt32 ) frame * 10;
+			Send( host, KIND_FRAME, kVisualPluginRenderMessage, &info, refCons[ instance ] );
+			memset( &info, 0, sizeof( info ) );
+			Send( host, KIND_FRAME, kVisualPluginIdleMessage, &info, refCons[ instance ] );
+			Change( host, frame, instance );
+		}
+		RezThreadSleep( 1 );
+	}
+}
+
+/*
+ * Messages to an instance that is not there, whether never made or
+ * already cleaned up, must be ignored.
+ */
+
+static void SendStray( Host *host, void *refCon )
+{
+	VisualPluginMessageInfo info;
+
+	memset( &info, 0, sizeof( info ) );
+	Send( host, KIND_FRAME, kVisualPluginRenderMessage, &info, refCon );
+	Send( host, KIND_FRAME, kVisualPluginIdleMessage, &info, refCon );
+	Send( host, KIND_CONTROL, kVisualPluginPauseMessage, &info, refCon );
+	Send( host, KIND_WINDOW, kVisualPluginUpdateMessage, &info, refCon );
+	Send( host, KIND_WINDOW, kVisualPluginHideWindowMessage, &info, refCon );
+}
+
+static void Cleanup( Host *host, int instance )
+{
+	VisualPluginMessageInfo info;
+	RezTime start;
+
+	memset( &info, 0, sizeof( info ) );
+	start = RezTimeNow();
+	handler( kVisualPluginCleanupMessage, &info, refCons[ instance ] );
+	printf( "# cleanup %d took %.2f ms\n", instance, ( RezTimeNow() - start ) / 1e6 );
+	SendStray( host, refCons[ instance ] );
+}
+
+int main( int argc, char **argv )
+{
+	PluginMessageInfo pluginInfo;
+	VisualPluginMessageInfo info;
+	Host mainHost;
+	Kind total[ KINDS ];
+	RezTime start;
+	int option, instance, thread, kind, failed = 0;
+
+	while( ( option = getopt( argc, argv, "i:n:t:" ) ) != -1 )
+	{
+		if( option == 'i' ) instances = atoi( optarg );
+		else if( option == 'n' ) frames = atoi( optarg );
+		else if( option == 't' ) threads = atoi( optarg );
+		else optind = argc + 1;
+	}
+	if( optind != argc || frames <= 0 || threads < 2 || threads > MOST || instances < 1 || instances > MOST )
+	{
+		fprintf( stderr, "usage: rezstress [ -n frames ] [ -t threads ] [ -i instances ]\n" );
+		return 2;
+	}
+
+	memset( &pluginInfo, 0, sizeof( pluginInfo ) );
+	pluginInfo.u.initMessage.appProc = AppProc;
+	iTunesPluginMainMachO( kPluginInitMessage, &pluginInfo, NULL );
+	if( handler == NULL )
+	{
+		fprintf( stderr, "rezstress: the plugin did not register\n" );
+		return 2;
+	}
+
+	memset( &mainHost, 0, sizeof( mainHost ) );
+	SendStray( &mainHost, NULL );
+	SendTrack( &mainHost, kVisualPluginPlayMessage, NULL, 'A' );
+
+	for( instance = 0; instance < instances; instance++ )
+	{
+		memset( &info, 0, sizeof( info ) );
+		info.u.initMessage.appProc = AppProc;
+		start = RezTimeNow();
+		handler( kVisualPluginInitMessage, &info, NULL );
+		printf( "# init %d took %.2f ms\n", instance, ( RezTimeNow() - start ) / 1e6 );
+		refCons[ instance ] = info.u.initMessage.refCon;
+		if( refCons[ instance ] == NULL || NewGWorld( &worlds[ instance ], 32, &bounds, NULL, NULL, 0 ) != noErr )
+		{
+			fprintf( stderr, "rezstress: instance %d would not start\n", instance );
+			return 1;
+		}
+		ShowWindow( &mainHost, instance );
+		SendTrack( &mainHost, kVisualPluginPlayMessage, refCons[ instance ], 'A' );
+	}
+
+	for( thread = 0; thread < threads; thread++ )
+	{
+		hosts[ thread ].index = thread;
+		hosts[ thread ].seed = ( unsigned int ) thread + 1;
+		if( !RezThreadStart( &hosts[ thread ].thread, HostMain, &hosts[ thread ], REZ_PRIORITY_NORMAL ) )
+		{
+			fprintf( stderr, "rezstress: cannot start thread %d\n", thread );
+			return 2;
+		}
+	}
+
+	/*
+	 * With more than one instance, the last goes halfway through, under
+	 * the other threads' feet.
+	 */
+	if( instances > 1 )
+	{
+		RezThreadSleep( frames / 2 );
+		Cleanup( &mainHost, instances - 1 );
+	}
+	for( thread = 0; thread < threads; thread++ ) RezThreadJoin( &hosts[ thread ].thread );
+
+	for( instance = 0; instance < ( instances > 1 ? instances - 1 : instances ); instance++ )
+	{
+		memset( &info, 0, sizeof( info ) );
+		Send( &mainHost, KIND_CONTROL, kVisualPluginStopMessage, &info, refCons[ instance ] );
+		Send( &mainHost, KIND_WINDOW, kVisualPluginHideWindowMessage, &info, refCons[ instance ] );
+		Cleanup( &mainHost, instance );
+	}
+	for( instance = 0; instance < instances; instance++ ) DisposeGWorld( worlds[ instance ] );
+
+	memset( total, 0, sizeof( total ) );
+	for( thread = 0; thread <= threads; thread++ )
+	{
+		Host *host = thread < threads ? &hosts[ thread ] : &mainHost;
+
+		for( kind = 0; kind < KINDS; kind++ )
+		{
+			total[ kind ].calls += host->kind[ kind ].calls;
+			total[ kind ].slow += host->kind[ kind ].slow;
+			if( host->kind[ kind ].longest > total[ kind ].longest ) total[ kind ].longest = host->kind[ kind ].longest;
+		}
+	}
+	printf( "kind\tcalls\tlongest\tslow\n" );
+	for( kind = 0; kind < KINDS; kind++ )
+	{
+		printf( "%s\t%lu\t%.2f\t%lu\n", kindNames[ kind ], total[ kind ].calls, total[ kind ].longest / 1e6, total[ kind ].slow );
+		if( kind != KIND_WINDOW && total[ kind ].slow > total[ kind ].calls * SLOWLIMIT ) failed = 1;
+	}
+	return failed;
+}
@@ -0,0 +1,139 @@
+/*
+ *  reztail.c
+ *  rezTunes
+ *
+ *  Follows the plugin's telemetry ring from outside iTunes and prints one
+ *  line per detector frame, so the detector can be watched and tuned
+ *  live without a debugger.
+ *
+ *  Build from the top of the tree with:
+ *    cc -O2 -Isrc -o reztail tools/reztail.c src/rezTelemetry.c src/rezLatency.c src/rezGovernor.c -lrt
+ *
+ *  Usage: reztail [ -a ] [ -r ] [ -e every ] [ -l ]
+ *    -a  start with the oldest frame still in the ring, not the newest
+ *    -r  show each band's ratio to its history rather than its energy
+ *    -e  print only every Nth frame
+ *    -l  print the latency of each stage on the way to the motor so far,
+ *        and how often each optional stage has been shed and what it
+ *        costs, then stop
+ *
+ *  Each line is the frame's playback position, the speed the motor was
+ *  sent, the speed the detector wanted and its onset confidence, flags
+ *  (P playing, R replaying a beat map, V vibrator present), then a column
+ *  per band, marked with '*' where that band fired, then how many
+ *  microseconds detection and the decision took, and last how many each
+ *  optional stage cost: drawing, the memories and telemetry.  Frames the
+ *  viewer fell too far behind to read are reported as skipped.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "rezTelemetry.h"
+
+/*
+ * POLLMS - How long to sleep when there is nothing new.
+ * REATTACHMS - With nothing new for this long, look for a newer segment
+ *   in case the plugin was restarted.
+ */
+
+#define POLLMS 5
+#define REATTACHMS 2000
+
+static void SleepMS( int ms )
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = ( long ) ( ms % 1000 ) * 1000000;
+	nanosleep( &ts, NULL );
+}
+
+static void Print( const RezTelemetryRecord *record, int ratios )
+{
+	int band;
+
+	printf( "%8u %9.3fs %3u %3u %4.2f %c%c%c |", record->index, record->positionMS / 1000.0, record->motorSpeed,
+			record->detectorSpeed, record->confidence, ( record->flags & REZ_TELEMETRY_PLAYING ) ? 'P' : '-',
+			( record->flags & REZ_TELEMETRY_REPLAYING ) ? 'R' : '-', ( record->flags & REZ_TELEMETRY_VIBE ) ? 'V' : '-' );
+	for( band = 0; band < FREQUENCYBANDS; band++ )
+		printf( " %6.2f%c", ratios ? record->ratio[ band ] : record->energy[ band ],
+				( record->beats & ( 1u << band ) ) ? '*' : ' ' );
+	printf( " | %5u %5u | %5u %5u %5u\n", record->detectUS, record->decideUS, record->stageUS[ REZ_STAGE_DETAIL ],
+			record->stageUS[ REZ_STAGE_HORIZONS ], record->stageUS[ REZ_STAGE_TELEMETRY ] );
+}
+
+int main( int argc, char **argv )
+{
+	RezTelemetry telemetry;
+	RezTelemetryRecord record;
+	unsigned int next = 0;
+	unsigned long skipped = 0, reported = 0;
+	int oldest = 0, ratios = 0, every = 1, latency = 0, idleMS = 0, option;
+
+	while( ( option = getopt( argc, argv, "are:l" ) ) != -1 )
+	{
+		if( option == 'a' ) oldest = 1;
+		else if( option == 'r' ) ratios = 1;
+		else if( option == 'e' ) every = atoi( optarg );
+		else if( option == 'l' ) latency = 1;
+		else
+		{
+			fprintf( stderr, "usage: reztail [ -a ] [ -r ] [ -e every ] [ -l ]\n" );
+			return 1;
+		}
+	}
+	if( every < 1 ) every = 1;
+
+	if( latency )
+	{
+		if( !RezTelemetryAttach( &telemetry ) )
+		{
+			fprintf( stderr, "reztail: rezTunes is not running\n" );
+			return 1;
+		}
+		RezLatencyPrint( telemetry.latency, stdout );
+		printf( "\n" );
+		RezGovernorPrint( &telemetry.header->governor, stdout );
+		RezTelemetryClose( &telemetry );
+		return 0;
+	}
+
+	for( ;; )
+	{
+		unsigned int written;
+
+		if( !RezTelemetryAttach( &telemetry ) )
+		{
+			fprintf( stderr, "reztail: waiting for rezTunes\n" );
+			while( !RezTelemetryAttach( &telemetry ) ) SleepMS( 1000 );
+		}
+		written = ( unsigned int ) telemetry.header->written;
+		next = written;
+		if( oldest ) next = written > REZ_TELEMETRY_RECORDS ? written - REZ_TELEMETRY_RECORDS : 0;
+		oldest = 0;
+		idleMS = 0;
+
+		while( idleMS < REATTACHMS )
+		{
+			if( !RezTelemetryRead( &telemetry, &next, &record, &skipped ) )
+			{
+				fflush( stdout );
+				SleepMS( POLLMS );
+				idleMS += POLLMS;
+				continue;
+			}
+			idleMS = 0;
+			if( skipped != reported )
+			{
+				printf( "# skipped %lu\n", skipped - reported );
+				reported = skipped;
+			}
+			if( record.index % every == 0 ) Print( &record, ratios );
+		}
+		RezTelemetryClose( &telemetry );
+	}
+	return 0;
+}